@@ -90,7 +90,7 @@ void run_scientific_calculator(void) {
     
     // Main calculator loop
     while (1) {
-        unsigned char key = keyboard_get_char();
+        unsigned char key = keyboard_wait_char();
         
         if (key != 0) {
             if (key == 27) { // ESC key or ESC button
@@ -248,9 +248,6 @@ void run_scientific_calculator(void) {
                     calc_draw_display();
                 }
             }
-        } else {
-            // Small delay to prevent excessive CPU usage
-            for (volatile int i = 0; i < 1000; i++) {}
         }
     }
 }
@@ -670,34 +667,6 @@ long calc_string_to_long(const char* str) {
     return negative ? -result : result;
 }
 
-// Simple long to string conversion
-void calc_long_to_string(long num, char* str) {
-    if (num == 0) {
-        str[0] = '0';
-        str[1] = '\0';
-        return;
-    }
-    
-    if (num < 0) {
-        str[0] = '-';
-        str++;
-        num = -num;
-    }
-    
-    char temp[32];
-    int i = 0;
-    
-    while (num > 0) {
-        temp[i++] = (num % 10) + '0';
-        num /= 10;
-    }
-    
-    for (int j = 0; j < i; j++) {
-        str[j] = temp[i - 1 - j];
-    }
-    str[i] = '\0';
-}
-
 // Helper string functions
 int calc_strlen(const char* str) {
     int len = 0;
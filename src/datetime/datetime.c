@@ -1,5 +1,6 @@
 #include "datetime.h"
 #include "print.h"
+#include "stdio.h"
 
 #define CMOS_ADDRESS 0x70
 #define CMOS_DATA 0x71
@@ -45,48 +46,7 @@ void adjust_time_for_nepal(struct tm* time) {
     }
 }
 
-int print_num(char* buffer, int num, int width) {
-    int n = num;
-    int len = 0;
-    while (n > 0) {
-        len++;
-        n /= 10;
-    }
-    for (int i = len; i < width; i++) {
-        *buffer++ = '0';
-    }
-    char temp[10];
-    int idx = 0;
-    do {
-        temp[idx++] = '0' + (num % 10);
-        num /= 10;
-    } while (num > 0);
-    for (int i = idx - 1; i >= 0; i--) {
-        *buffer++ = temp[i];
-    }
-    return width > len ? width : len;
-}
-
-void simple_snprintf(char* buffer, int year, int month, int day, int hour, int minute, int second) {
-    char* p = buffer;
-    p += print_num(p, year, 4);
-    *p++ = '-';
-    p += print_num(p, month, 2);
-    *p++ = '-';
-    p += print_num(p, day, 2);
-    *p++ = ' ';
-    p += print_num(p, hour, 2);
-    *p++ = ':';
-    p += print_num(p, minute, 2);
-    *p++ = ':';
-    p += print_num(p, second, 2);
-    *p = '\0';
-}
-
 void print_time(const struct tm* time) {
-    char buffer[256];
-    int year = time->tm_year + 1900;
-    int month = time->tm_mon + 1;
-    simple_snprintf(buffer, year, month, time->tm_mday, time->tm_hour, time->tm_min, time->tm_sec);
-    print_str(buffer);
+    kprintf("%04d-%02d-%02d %02d:%02d:%02d", time->tm_year + 1900, time->tm_mon + 1, time->tm_mday,
+            time->tm_hour, time->tm_min, time->tm_sec);
 }
\ No newline at end of file
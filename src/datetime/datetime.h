@@ -15,6 +15,5 @@ struct tm {
 void adjust_time_for_nepal(struct tm* time);
 struct tm get_rtc_time();
 void print_time(const struct tm* time);
-void simple_snprintf(char* buffer, int year, int month, int day, int hour, int minute, int second);
 
 #endif
\ No newline at end of file
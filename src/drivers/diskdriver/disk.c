@@ -1,5 +1,8 @@
 #include <stdint.h>
 #include "disk.h"
+#include "ktime.h"
+#include "workpool.h"
+#include "thread.h"
 
 #define ATA_PRIMARY_IO        0x1F0   // Primary IO base
 #define ATA_PRIMARY_CONTROL   0x3F6   // Primary control port
@@ -8,6 +11,18 @@
 #define ATA_CMD_READ         0x20    // Read command
 #define ATA_CMD_WRITE        0x30    // Write command
 #define SECTOR_SIZE          512     // Sector size in bytes
+#define ATA_TIMEOUT_NS       (100 * NSEC_PER_MSEC) // Per-phase wait limit
+#define CHECKSUM_BATCH       64      // Sectors read per parallel checksum pass
+#define CHECKSUM_GRAIN       8       // Sectors per work-stealing chunk
+
+#define ATA_SR_ERR  0x01
+#define ATA_SR_DRQ  0x08
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_BSY  0x80
+
+// One command at a time on the channel: a PIO sequence is a dozen port
+// accesses that another thread's command must not land in the middle of
+static mutex_t ata_lock = MUTEX_INIT;
 
 static inline uint8_t inb(uint16_t port) {
     uint8_t ret;
@@ -33,6 +48,19 @@ static inline void io_wait() {
     __asm__ volatile ("outb %%al, $0x80" : : "a"(0));
 }
 
+// Wait until (status & mask) == value, bounded by wall time rather than iterations.
+// Returns -1 on timeout, or on ERR when check_error is set.
+static int ata_poll(uint8_t mask, uint8_t value, int check_error) {
+    uint64_t deadline = ktime_now() + ATA_TIMEOUT_NS;
+    uint8_t status;
+
+    while (((status = inb(ATA_PRIMARY_IO + 7)) & mask) != value) {
+        if (check_error && (status & ATA_SR_ERR)) return -1;
+        if (ktime_now() >= deadline) return -1;
+    }
+    return 0;
+}
+
 void ata_wait_ready() {
     while (inb(ATA_PRIMARY_IO + 7) & 0x80);
 }
@@ -52,22 +80,14 @@ void ata_send_command(uint8_t command) {
     outb(ATA_PRIMARY_IO + 7, command);
 }
 
-int ata_read_sector(uint32_t lba, uint8_t* buffer) {
+static int read_sector(uint32_t lba, uint8_t* buffer) {
     uint8_t status;
-    int timeout = 10000;
     
-    while (((status = inb(ATA_PRIMARY_IO + 7)) & 0x80) && timeout > 0) {
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+    if (ata_poll(ATA_SR_BSY, 0, 0) < 0) return -1;
 
     outb(ATA_PRIMARY_IO + 6, 0xE0 | ((lba >> 24) & 0x0F));
     
-    timeout = 10000;
-    while (!(inb(ATA_PRIMARY_IO + 7) & 0x40) && timeout > 0) {
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+    if (ata_poll(ATA_SR_DRDY, ATA_SR_DRDY, 0) < 0) return -1;
 
     outb(ATA_PRIMARY_IO + 1, 0x00);
     outb(ATA_PRIMARY_IO + 2, 1);
@@ -77,13 +97,7 @@ int ata_read_sector(uint32_t lba, uint8_t* buffer) {
 
     outb(ATA_PRIMARY_IO + 7, ATA_CMD_READ);
     
-    timeout = 10000;
-    while (!(inb(ATA_PRIMARY_IO + 7) & 0x08) && timeout > 0) {
-        status = inb(ATA_PRIMARY_IO + 7);
-        if (status & 0x01) return -1;
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+    if (ata_poll(ATA_SR_DRQ, ATA_SR_DRQ, 1) < 0) return -1;
 
     for (int i = 0; i < SECTOR_SIZE / 2; i++) {
         ((uint16_t*)buffer)[i] = inw(ATA_PRIMARY_IO);
@@ -95,22 +109,12 @@ int ata_read_sector(uint32_t lba, uint8_t* buffer) {
     return 0;
 }
 
-int ata_write_sector(uint32_t lba, const uint8_t* buffer) {
-    uint8_t status;
-    int timeout = 10000;
-    
-    while (((status = inb(ATA_PRIMARY_IO + 7)) & 0x80) && timeout > 0) {
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+static int write_sector(uint32_t lba, const uint8_t* buffer) {
+    if (ata_poll(ATA_SR_BSY, 0, 0) < 0) return -1;
 
     outb(ATA_PRIMARY_IO + 6, 0xE0 | ((lba >> 24) & 0x0F));
     
-    timeout = 10000;
-    while (!(inb(ATA_PRIMARY_IO + 7) & 0x40) && timeout > 0) {
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+    if (ata_poll(ATA_SR_DRDY, ATA_SR_DRDY, 0) < 0) return -1;
 
     outb(ATA_PRIMARY_IO + 1, 0x00);
     outb(ATA_PRIMARY_IO + 2, 1);
@@ -120,13 +124,7 @@ int ata_write_sector(uint32_t lba, const uint8_t* buffer) {
 
     outb(ATA_PRIMARY_IO + 7, ATA_CMD_WRITE);
     
-    timeout = 10000;
-    while (!(inb(ATA_PRIMARY_IO + 7) & 0x08) && timeout > 0) {
-        status = inb(ATA_PRIMARY_IO + 7);
-        if (status & 0x01) return -1;
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+    if (ata_poll(ATA_SR_DRQ, ATA_SR_DRQ, 1) < 0) return -1;
 
     for (int i = 0; i < SECTOR_SIZE / 2; i++) {
         outw(ATA_PRIMARY_IO, ((uint16_t*)buffer)[i]);
@@ -134,18 +132,95 @@ int ata_write_sector(uint32_t lba, const uint8_t* buffer) {
 
     outb(ATA_PRIMARY_IO + 7, 0xE7);
     
-    timeout = 10000;
-    while ((inb(ATA_PRIMARY_IO + 7) & 0x80) && timeout > 0) {
-        timeout--;
-    }
-    if (timeout == 0) return -1;
+    if (ata_poll(ATA_SR_BSY, 0, 0) < 0) return -1;
 
     return 0;
 }
 
+int ata_read_sector(uint32_t lba, uint8_t* buffer) {
+    mutex_lock(&ata_lock);
+    int result = read_sector(lba, buffer);
+    mutex_unlock(&ata_lock);
+    return result;
+}
+
+int ata_write_sector(uint32_t lba, const uint8_t* buffer) {
+    mutex_lock(&ata_lock);
+    int result = write_sector(lba, buffer);
+    mutex_unlock(&ata_lock);
+    return result;
+}
+
 void ata_wait_for_drive_ready_with_timeout() {
-    int timeout = 10000;
-    while (!(inb(ATA_PRIMARY_IO + 7) & 0x08)) {
-        if (--timeout <= 0) return;
+    ata_poll(ATA_SR_DRQ, ATA_SR_DRQ, 0);
+}
+typedef struct {
+    const uint8_t* buffer;
+    uint32_t first_index; // Position of buffer[0] within the whole run
+    volatile uint32_t sum;
+} checksum_job_t;
+
+// Fletcher-32 over one sector
+static uint32_t sector_fletcher32(const uint8_t* sector) {
+    const uint16_t* words = (const uint16_t*)sector;
+    uint32_t a = 0xFFFF, b = 0xFFFF;
+    for (int i = 0; i < SECTOR_SIZE / 2; i++) {
+        a += words[i];
+        b += a;
+        if ((i & 127) == 127) {
+            a = (a & 0xFFFF) + (a >> 16);
+            b = (b & 0xFFFF) + (b >> 16);
+        }
     }
-}
\ No newline at end of file
+    a = (a & 0xFFFF) + (a >> 16);
+    b = (b & 0xFFFF) + (b >> 16);
+    return (b << 16) | a;
+}
+
+static void checksum_range(size_t begin, size_t end, void* arg) {
+    checksum_job_t* job = arg;
+    uint32_t sum = 0;
+    for (size_t i = begin; i < end; i++) {
+        // Weight by position so reordered sectors change the result
+        sum += sector_fletcher32(job->buffer + i * SECTOR_SIZE) * (job->first_index + (uint32_t)i + 1);
+    }
+    __atomic_add_fetch(&job->sum, sum, __ATOMIC_RELAXED);
+}
+
+// Position-weighted sum of per-sector Fletcher-32 values. The PIO reads
+// stay serial; the sectors of each batch are checksummed on every CPU.
+// The lock is held throughout, as it also guards the batch buffer.
+int ata_checksum_sectors(uint32_t lba, uint32_t count, uint32_t* checksum) {
+    static uint8_t batch[CHECKSUM_BATCH * SECTOR_SIZE];
+    uint32_t sum = 0;
+    int result = 0;
+
+    mutex_lock(&ata_lock);
+
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = count - done;
+        if (n > CHECKSUM_BATCH) {
+            n = CHECKSUM_BATCH;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (read_sector(lba + done + i, batch + i * SECTOR_SIZE) < 0) {
+                result = -1;
+                break;
+            }
+        }
+        if (result < 0) {
+            break;
+        }
+
+        checksum_job_t job = { batch, done, 0 };
+        parallel_for(0, n, CHECKSUM_GRAIN, checksum_range, &job);
+        sum += job.sum;
+        done += n;
+    }
+
+    mutex_unlock(&ata_lock);
+    if (result == 0) {
+        *checksum = sum;
+    }
+    return result;
+}
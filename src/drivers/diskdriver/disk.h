@@ -16,7 +16,7 @@ void ata_wait_for_drive_ready(void);
 void ata_wait_for_drive_ready_with_timeout(void); 
 void ata_send_command(uint8_t command);  
 void ata_select_drive(uint8_t drive);   
+int ata_checksum_sectors(uint32_t lba, uint32_t count, uint32_t* checksum);
 void print_str(const char *str);  
-void itoaa(int num, char* str, int base);
 
 #endif
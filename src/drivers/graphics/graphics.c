@@ -1,6 +1,10 @@
 #include "graphics.h"
+#include "workpool.h"
+#include "../../memory/vmm.h"
 #include <string.h>
 
+#define CLEAR_ROW_GRAIN 32 // Rows per work-stealing chunk
+
 static graphics_info_t g_graphics;
 
 // High-quality modern 16x24 font bitmap with 8-level anti-aliasing
@@ -113,47 +117,45 @@ static int8_t get_kerning(char left, char right) {
     return 0;
 }
 
-void graphics_init(void* multiboot_info) {
-    // Parse multiboot2 framebuffer info
-    // This is a simplified version - you'd need to properly parse multiboot2 tags
-    
-    // Try common framebuffer addresses
-    uint32_t* test_addresses[] = {
-        (uint32_t*)0xFD000000,  // Common QEMU address
-        (uint32_t*)0xE0000000,  // Alternative address
-        (uint32_t*)0xF0000000,  // Another common address
-        (uint32_t*)0xA0000000   // VGA memory area
-    };
-    
-    // For now, use the first address (QEMU default)
-    g_graphics.framebuffer = test_addresses[0];
-    g_graphics.width = 1024;
-    g_graphics.height = 768;
-    g_graphics.pitch = g_graphics.width * 4; // 4 bytes per pixel (32-bit)
-    g_graphics.bpp = 32;
+void graphics_init(const boot_info_t* info) {
+    g_graphics.initialized = false;
+
+    // Only a 32-bit linear framebuffer from the boot loader is usable; in
+    // EGA text mode there is nothing to draw on
+    if (!info || !info->has_framebuffer) return;
+    const boot_framebuffer_t* fb = &info->framebuffer;
+    if (fb->type != BOOT_FRAMEBUFFER_RGB || fb->bpp != 32) return;
+
+    uint32_t* framebuffer = vmm_map_mmio(fb->address, (uint64_t)fb->pitch * fb->height, VMM_WRITE | VMM_WRITE_COMBINING);
+    if (!framebuffer) return;
+
+    g_graphics.framebuffer = framebuffer;
+    g_graphics.width = fb->width;
+    g_graphics.height = fb->height;
+    g_graphics.pitch = fb->pitch;
+    g_graphics.bpp = fb->bpp;
     g_graphics.initialized = true;
     
-    // Test if framebuffer is accessible by trying to write/read
-    uint32_t test_value = 0x12345678;
-    g_graphics.framebuffer[0] = test_value;
-    if (g_graphics.framebuffer[0] != test_value) {
-        // Framebuffer not accessible, disable graphics
-        g_graphics.initialized = false;
-        return;
-    }
-    
     // Clear screen to black
     graphics_clear(COLOR_BLACK);
 }
 
-void graphics_clear(uint32_t color) {
-    if (!g_graphics.initialized) return;
-    
-    for (uint32_t y = 0; y < g_graphics.height; y++) {
+static void clear_rows(size_t begin, size_t end, void* arg) {
+    uint32_t color = *(uint32_t*)arg;
+    for (size_t y = begin; y < end; y++) {
+        uint32_t* row = g_graphics.framebuffer + y * (g_graphics.pitch / 4);
         for (uint32_t x = 0; x < g_graphics.width; x++) {
-            graphics_put_pixel(x, y, color);
+            row[x] = color;
         }
     }
+    // Drain this CPU's write-combining buffers before reporting the chunk done
+    __asm__ volatile("sfence" ::: "memory");
+}
+
+void graphics_clear(uint32_t color) {
+    if (!g_graphics.initialized) return;
+    
+    parallel_for(0, g_graphics.height, CLEAR_ROW_GRAIN, clear_rows, &color);
 }
 
 void graphics_put_pixel(uint32_t x, uint32_t y, uint32_t color) {
@@ -161,7 +163,7 @@ void graphics_put_pixel(uint32_t x, uint32_t y, uint32_t color) {
         return;
     }
     
-    uint32_t offset = y * g_graphics.width + x;
+    uint32_t offset = y * (g_graphics.pitch / 4) + x;
     g_graphics.framebuffer[offset] = color;
 }
 
@@ -170,7 +172,7 @@ uint32_t graphics_get_pixel(uint32_t x, uint32_t y) {
         return 0;
     }
     
-    uint32_t offset = y * g_graphics.width + x;
+    uint32_t offset = y * (g_graphics.pitch / 4) + x;
     return g_graphics.framebuffer[offset];
 }
 
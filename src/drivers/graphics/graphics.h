@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "boot_info.h"
 
 // Font size enumeration - Modern scaling
 typedef enum {
@@ -35,7 +36,7 @@ typedef struct {
 } graphics_info_t;
 
 // Core graphics functions
-void graphics_init(void* multiboot_info);
+void graphics_init(const boot_info_t* info);
 void graphics_clear(uint32_t color);
 void graphics_put_pixel(uint32_t x, uint32_t y, uint32_t color);
 uint32_t graphics_get_pixel(uint32_t x, uint32_t y);
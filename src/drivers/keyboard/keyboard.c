@@ -1,5 +1,7 @@
 #include "keyboard.h"
 #include "../intf/print.h"
+#include "interrupts.h"
+#include "idle.h"
 
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
@@ -11,6 +13,21 @@
 #define LCTRL 0x1D
 #define RCTRL 0x1D
 #define CTRL_RELEASE 0x9D
+#define ALT 0x38 // Right Alt sends the same code after 0xE0
+#define F1 0x3B // F1 .. F10 are consecutive
+
+// Decoded keys are queued by the IRQ1 handler and drained by keyboard_get_char().
+// Single producer (the ISR) and single consumer, so head and tail each have one writer.
+// Each virtual console has its own queue: keys go to the one on screen
+// and are read by the threads drawing on it.
+#define KEYBOARD_BUFFER_SIZE 256 // must be a power of two
+#define KEYBOARD_BUFFER_MASK (KEYBOARD_BUFFER_SIZE - 1)
+
+static unsigned char key_buffer[PRINT_CONSOLES][KEYBOARD_BUFFER_SIZE];
+static uint32_t key_head[PRINT_CONSOLES]; // written by the ISR only
+static uint32_t key_tail[PRINT_CONSOLES]; // written by the consumer only
+static uint32_t keys_dropped = 0;
+static int keyboard_initialized = 0;
 
 void save_current_file(void);
 
@@ -43,18 +60,13 @@ static inline unsigned char inb(unsigned short port) {
     return ret;
 }
 
-unsigned char keyboard_get_char() {
+// Translate one scancode into a key code, tracking modifier state. Runs in IRQ context.
+static unsigned char keyboard_decode(unsigned char scancode) {
     static int shift = 0;   
     static int ctrl = 0;    
+    static int alt = 0;
     unsigned char c = 0;
 
-    // Quick check if keyboard has data
-    if (!(inb(KEYBOARD_STATUS_PORT) & 1)) {
-        return 0; // No data available
-    }
-
-    unsigned char scancode = inb(KEYBOARD_DATA_PORT);
-
     if (scancode & 0x80) {
         // Key release
         scancode -= 0x80;
@@ -62,6 +74,8 @@ unsigned char keyboard_get_char() {
             shift = 0;
         } else if (scancode == LCTRL || scancode == RCTRL) {
             ctrl = 0;
+        } else if (scancode == ALT) {
+            alt = 0;
         }
     } else {
         // Key press
@@ -69,6 +83,10 @@ unsigned char keyboard_get_char() {
             shift = 1;
         } else if (scancode == LCTRL || scancode == RCTRL) {
             ctrl = 1;
+        } else if (scancode == ALT) {
+            alt = 1;
+        } else if (alt && scancode >= F1 && scancode < F1 + PRINT_CONSOLES) {
+            print_show_console(scancode - F1);
         } else if (scancode == UP_ARROW || scancode == DOWN_ARROW || scancode == LEFT_ARROW || scancode == RIGHT_ARROW ||
                    scancode == PAGE_UP || scancode == PAGE_DOWN || scancode == HOME_KEY || scancode == END_KEY) {
             // Handle special navigation keys - return SPECIAL CODES, not scancodes
@@ -125,6 +143,75 @@ unsigned char keyboard_get_char() {
     return c;
 }
 
+static void keyboard_push(int console, unsigned char c) {
+    uint32_t head = key_head[console];
+    uint32_t tail = __atomic_load_n(&key_tail[console], __ATOMIC_ACQUIRE);
+
+    if (head - tail >= KEYBOARD_BUFFER_SIZE) {
+        keys_dropped++;
+        return;
+    }
+
+    key_buffer[console][head & KEYBOARD_BUFFER_MASK] = c;
+    __atomic_store_n(&key_head[console], head + 1, __ATOMIC_RELEASE);
+}
+
+// The PIC delivers IRQs to the boot CPU one at a time, so the keyboard
+// and the serial port never feed keys concurrently
+void keyboard_feed(unsigned char c) {
+    int console = print_visible_console();
+    if (console != PRINT_LOG_CONSOLE) {
+        keyboard_push(console, c);
+    } else if (c == NAV_PAGE_UP || c == NAV_PAGE_DOWN) {
+        // Nobody reads keys on the log, so it pages here
+        print_scrollback(c == NAV_PAGE_UP ? VGA_HEIGHT - 1 : -(VGA_HEIGHT - 1));
+    } else {
+        print_scrollback_end();
+    }
+}
+
+static void keyboard_irq_handler(interrupt_frame_t* frame) {
+    (void)frame;
+
+    // Drain everything the controller has so a burst costs one interrupt
+    while (inb(KEYBOARD_STATUS_PORT) & 1) {
+        unsigned char c = keyboard_decode(inb(KEYBOARD_DATA_PORT));
+        if (c != 0) {
+            keyboard_feed(c);
+        }
+    }
+}
+
+// Both read the queue of the caller's console
+int keyboard_has_char() {
+    int console = print_console();
+    return __atomic_load_n(&key_head[console], __ATOMIC_ACQUIRE) != key_tail[console];
+}
+
+// Non-blocking: returns 0 when no key is queued
+unsigned char keyboard_get_char() {
+    int console = print_console();
+    uint32_t tail = key_tail[console];
+
+    if (__atomic_load_n(&key_head[console], __ATOMIC_ACQUIRE) == tail) {
+        return 0;
+    }
+
+    unsigned char c = key_buffer[console][tail & KEYBOARD_BUFFER_MASK];
+    __atomic_store_n(&key_tail[console], tail + 1, __ATOMIC_RELEASE);
+    return c;
+}
+
+// Blocking: halts the CPU until the keyboard interrupt has queued a key
+unsigned char keyboard_wait_char() {
+    wait_event(keyboard_has_char());
+    return keyboard_get_char();
+}
+
+uint32_t keyboard_dropped_keys() {
+    return keys_dropped;
+}
+
 void handle_keypress() {
     unsigned char c = keyboard_get_char();
     if (c == 0x1B) {
@@ -139,5 +226,15 @@ void handle_keypress() {
 }
 
 void init_keyboard(){
-    
+    if (keyboard_initialized) {
+        return;
+    }
+
+    // Discard anything buffered before the handler existed
+    while (inb(KEYBOARD_STATUS_PORT) & 1) {
+        inb(KEYBOARD_DATA_PORT);
+    }
+
+    irq_register_handler(IRQ_KEYBOARD, keyboard_irq_handler);
+    keyboard_initialized = 1;
 }
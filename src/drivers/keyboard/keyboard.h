@@ -1,8 +1,16 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <stdint.h>
+
 void init_keyboard();
 unsigned char keyboard_get_char();
+unsigned char keyboard_wait_char();
+int keyboard_has_char();
+uint32_t keyboard_dropped_keys();
+// Queue a decoded key for the visible console as if it had been typed;
+// for other input devices. Interrupt context only.
+void keyboard_feed(unsigned char c);
 void switch_to_shell();
 
 #define UP_ARROW 0x48
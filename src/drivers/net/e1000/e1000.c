@@ -1,4 +1,6 @@
 #include "e1000.h"
+#include "../../../memory/memory.h"
+#include "../../../memory/vmm.h"
 #include <string.h>
 
 static volatile void* e1000_base;
@@ -29,6 +31,10 @@ static struct e1000_tx_desc tx_descs[E1000_NUM_TX_DESC] __attribute__((aligned(1
 static struct e1000_rx_desc rx_descs[E1000_NUM_RX_DESC] __attribute__((aligned(16)));
 static void* tx_buffers[E1000_NUM_TX_DESC];
 static void* rx_buffers[E1000_NUM_RX_DESC];
+static kmem_cache_t* packet_cache;
+
+#define E1000_PACKET_SIZE 2048 // Matches E1000_RCTL_BSIZE_2048
+#define E1000_MMIO_SIZE 0x20000 // Register space behind BAR0
 
 #define REG_RDBAL    0x2800
 #define REG_RDBAH    0x2804
@@ -70,7 +76,10 @@ static inline uint32_t e1000_read_reg(uint16_t reg) {
 }
 
 void e1000_init(uint32_t bar) {
-    e1000_base = (void*)(uintptr_t)bar;
+    e1000_base = vmm_map_mmio(bar, E1000_MMIO_SIZE, VMM_WRITE | VMM_UNCACHED);
+    if (!e1000_base) {
+        return;
+    }
     e1000_init_rx();
     e1000_init_tx();
 }
@@ -86,14 +95,22 @@ bool e1000_receive_packet(void* buffer, uint16_t* length) {
 static void e1000_init_rx(void) {
     memset(rx_descs, 0, sizeof(rx_descs));
 
+    if (!packet_cache) {
+        packet_cache = kmem_cache_create("e1000_packet", E1000_PACKET_SIZE, 64, 0);
+    }
+
     for (int i = 0; i < E1000_NUM_RX_DESC; i++) {
-        rx_buffers[i] = (void*)(uintptr_t)(0x200000 + i * 2048); 
-        rx_descs[i].addr = (uint64_t)(uintptr_t)rx_buffers[i];
+        if (!rx_buffers[i] && packet_cache) {
+            rx_buffers[i] = kmem_cache_alloc(packet_cache);
+        }
+        rx_descs[i].addr = vmm_virt_to_phys(rx_buffers[i]);
         rx_descs[i].status = 0;
     }
 
-    e1000_write_reg(REG_RDBAL, (uint32_t)(uintptr_t)rx_descs);
-    e1000_write_reg(REG_RDBAH, (uint32_t)((uintptr_t)rx_descs >> 32));
+    // The NIC reads descriptors and buffers by physical address
+    uint64_t rx_ring = vmm_virt_to_phys(rx_descs);
+    e1000_write_reg(REG_RDBAL, (uint32_t)rx_ring);
+    e1000_write_reg(REG_RDBAH, (uint32_t)(rx_ring >> 32));
     e1000_write_reg(REG_RDLEN, E1000_NUM_RX_DESC * sizeof(struct e1000_rx_desc));
 
     e1000_write_reg(REG_RDH, 0);
@@ -107,8 +124,9 @@ static void e1000_init_rx(void) {
 
 static void e1000_init_tx(void) {
     memset(tx_descs, 0, sizeof(tx_descs));
-    e1000_write_reg(REG_TDBAL, (uint32_t)(uintptr_t)tx_descs);
-    e1000_write_reg(REG_TDBAH, (uint32_t)((uintptr_t)tx_descs >> 32));
+    uint64_t tx_ring = vmm_virt_to_phys(tx_descs);
+    e1000_write_reg(REG_TDBAL, (uint32_t)tx_ring);
+    e1000_write_reg(REG_TDBAH, (uint32_t)(tx_ring >> 32));
     e1000_write_reg(REG_TDLEN, E1000_NUM_TX_DESC * sizeof(struct e1000_tx_desc));
     e1000_write_reg(REG_TDH, 0);
     e1000_write_reg(REG_TDT, 0);
@@ -1,34 +1,126 @@
 #include "filesystem.h"
 #include "../drivers/diskdriver/disk.h"
+#include "workpool.h"
+#include "../memory/vmm.h"
+#include "thread.h"
 #include <string.h>
-#include <stdarg.h>
+#include <stdio.h>
 #include <stdint.h>
 
-int custom_snprintf(char* str, size_t size, const char* format, ...);
-
 #define FILE_TABLE_START 1000
 #define MAX_FILE_CONTENT ATA_SECTOR_SIZE  
+#define FILE_SCAN_GRAIN 64 // Entries per work-stealing chunk
 
-FileEntry file_table[MAX_FILES];
+FileEntry* file_table = NULL;
 static int file_table_loaded = 0;
 static int file_table_dirty = 0;
+// Held by every fs_* and file call, so the editor's autosave and the
+// shell cannot interleave table updates; the static helpers below
+// expect it held
+static mutex_t fs_lock = MUTEX_INIT;
 
-void init_fs() {
-    for (int i = 0; i < MAX_FILES; i++) {
-        memset(&file_table[i], 0, sizeof(FileEntry));  
+typedef int (*file_match_t)(const FileEntry* entry, const char* filename);
+
+typedef struct {
+    file_match_t match;
+    const char* filename;
+    volatile int found; // Lowest matching index so far, MAX_FILES if none
+} file_search_t;
+
+static int match_name(const FileEntry* entry, const char* filename) {
+    return strncmp(entry->filename, filename, FILENAME_LENGTH) == 0;
+}
+
+static int match_occupied_name(const FileEntry* entry, const char* filename) {
+    return entry->is_occupied && match_name(entry, filename);
+}
+
+static int match_unnamed(const FileEntry* entry, const char* filename) {
+    (void)filename;
+    return entry->filename[0] == '\0';
+}
+
+static int match_unoccupied(const FileEntry* entry, const char* filename) {
+    (void)filename;
+    return !entry->is_occupied;
+}
+
+static void file_search_range(size_t begin, size_t end, void* arg) {
+    file_search_t* search = arg;
+    for (size_t i = begin; i < end; i++) {
+        int found = __atomic_load_n(&search->found, __ATOMIC_RELAXED);
+        if ((int)i >= found) {
+            return; // An earlier chunk already matched
+        }
+        if (search->match(&file_table[i], search->filename)) {
+            while ((int)i < found &&
+                   !__atomic_compare_exchange_n(&search->found, &found, (int)i, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            }
+            return;
+        }
     }
-    file_table_loaded = 1;
-    file_table_dirty = 1;
-    save_file_table();  
 }
 
-void ensure_file_table_loaded() {
+// First index matching, as a sequential scan would find, or -1
+static int file_table_find(file_match_t match, const char* filename) {
+    file_search_t search = { match, filename, MAX_FILES };
+    parallel_for(0, MAX_FILES, FILE_SCAN_GRAIN, file_search_range, &search);
+    return search.found < MAX_FILES ? search.found : -1;
+}
+
+// The table takes no memory until the filesystem is first used. Loading
+// it reads every entry, so it is committed whole then rather than page by
+// page. Returns -1 if there was no memory for it.
+static int file_table_alloc(void) {
+    if (!file_table) {
+        file_table = vmm_alloc("file_table", sizeof(FileEntry) * MAX_FILES, VMM_WRITE);
+    }
+    return file_table ? 0 : -1;
+}
+
+static void table_save(void) {
+    if (file_table && file_table_dirty) {
+        for (int i = 0; i < MAX_FILES; i++) {
+            ata_write_sector(FILE_TABLE_START + i, (uint8_t*)&file_table[i]);
+        }
+        file_table_dirty = 0;
+    }
+}
+
+// Returns -1 if the table could not be allocated; every operation then
+// fails instead of touching it
+static int table_load(void) {
+    if (file_table_alloc() < 0) {
+        return -1;
+    }
     if (!file_table_loaded) {
         for (int i = 0; i < MAX_FILES; i++) {
             ata_read_sector(FILE_TABLE_START + i, (uint8_t*)&file_table[i]);
         }
         file_table_loaded = 1;
     }
+    return 0;
+}
+
+void init_fs() {
+    mutex_lock(&fs_lock);
+    if (file_table_alloc() < 0) {
+        mutex_unlock(&fs_lock);
+        return;
+    }
+    for (int i = 0; i < MAX_FILES; i++) {
+        memset(&file_table[i], 0, sizeof(FileEntry));  
+    }
+    file_table_loaded = 1;
+    file_table_dirty = 1;
+    table_save();
+    mutex_unlock(&fs_lock);
+}
+
+void ensure_file_table_loaded() {
+    mutex_lock(&fs_lock);
+    table_load();
+    mutex_unlock(&fs_lock);
 }
 
 void load_file_table() {
@@ -36,36 +128,37 @@ void load_file_table() {
 }
 
 void save_file_table() {
-    if (file_table_dirty) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            ata_write_sector(FILE_TABLE_START + i, (uint8_t*)&file_table[i]);
-        }
-        file_table_dirty = 0;
-    }
+    mutex_lock(&fs_lock);
+    table_save();
+    mutex_unlock(&fs_lock);
+}
+
+// Checksum of the file table as stored on disk
+int fs_checksum(uint32_t* checksum) {
+    mutex_lock(&fs_lock);
+    int result = ata_checksum_sectors(FILE_TABLE_START, MAX_FILES, checksum);
+    mutex_unlock(&fs_lock);
+    return result;
 }
 
 void mark_file_table_dirty() {
+    mutex_lock(&fs_lock);
     file_table_dirty = 1;
+    mutex_unlock(&fs_lock);
 }
 
-int create_file(const char* filename, const uint8_t* content, uint32_t size) {
-    ensure_file_table_loaded();
+static int create_file_locked(const char* filename, const uint8_t* content, uint32_t size) {
+    if (table_load() < 0) {
+        return -2;
+    }
     
     // Check if file already exists
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (strncmp(file_table[i].filename, filename, FILENAME_LENGTH) == 0) {
-            return -1;  
-        }
+    if (file_table_find(match_name, filename) >= 0) {
+        return -1;  
     }
 
     // Find empty slot
-    int file_index = -1;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].filename[0] == '\0') {
-            file_index = i;
-            break;
-        }
-    }
+    int file_index = file_table_find(match_unnamed, filename);
 
     if (file_index == -1) {
         return -2;  
@@ -80,94 +173,93 @@ int create_file(const char* filename, const uint8_t* content, uint32_t size) {
     memcpy(file_table[file_index].content, content, size);
     file_table[file_index].is_occupied = 1;  
 
-    mark_file_table_dirty();
-    save_file_table();  
+    file_table_dirty = 1;
+    table_save();
     return 0;  
 }
 
-int save_file(const char* filename, const char* content, uint32_t size) {
-    ensure_file_table_loaded();
+static int save_file_locked(const char* filename, const char* content, uint32_t size) {
+    if (table_load() < 0) {
+        return -1;
+    }
     
     if (size > MAX_FILE_CONTENT) {
         return -1;  
     }
     
     // Try to update existing file
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].is_occupied && 
-            strncmp(file_table[i].filename, filename, FILENAME_LENGTH) == 0) {
-            file_table[i].size = size;
-            memcpy(file_table[i].content, content, size);
-            file_table[i].content[size] = '\0';  
-            mark_file_table_dirty();
-            save_file_table();  
-            return 0;  
-        }
+    int i = file_table_find(match_occupied_name, filename);
+    if (i >= 0) {
+        file_table[i].size = size;
+        memcpy(file_table[i].content, content, size);
+        file_table[i].content[size] = '\0';  
+        file_table_dirty = 1;
+        table_save();
+        return 0;  
     }
     
     // Create new file
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!file_table[i].is_occupied) {
-            memset(&file_table[i], 0, sizeof(FileEntry));  
-            strncpy(file_table[i].filename, filename, FILENAME_LENGTH - 1);
-            file_table[i].filename[FILENAME_LENGTH - 1] = '\0';  
-            file_table[i].size = size;
-            memcpy(file_table[i].content, content, size);
-            file_table[i].content[MAX_FILE_CONTENT - 1] = '\0';  
-            file_table[i].is_occupied = 1;  
-            mark_file_table_dirty();
-            save_file_table();  
-            return 0;  
-        }
+    i = file_table_find(match_unoccupied, filename);
+    if (i >= 0) {
+        memset(&file_table[i], 0, sizeof(FileEntry));  
+        strncpy(file_table[i].filename, filename, FILENAME_LENGTH - 1);
+        file_table[i].filename[FILENAME_LENGTH - 1] = '\0';  
+        file_table[i].size = size;
+        memcpy(file_table[i].content, content, size);
+        file_table[i].content[MAX_FILE_CONTENT - 1] = '\0';  
+        file_table[i].is_occupied = 1;  
+        file_table_dirty = 1;
+        table_save();
+        return 0;  
     }
     
     return -1;  
 }
 
-int delete_file(const char* filename) {
-    ensure_file_table_loaded();
+static int delete_file_locked(const char* filename) {
+    if (table_load() < 0) {
+        return -1;
+    }
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (strncmp(file_table[i].filename, filename, FILENAME_LENGTH) == 0) {
-            memset(&file_table[i], 0, sizeof(FileEntry)); 
-            mark_file_table_dirty();
-            save_file_table();  
-            return 0;  
-        }
+    int i = file_table_find(match_name, filename);
+    if (i >= 0) {
+        memset(&file_table[i], 0, sizeof(FileEntry)); 
+        file_table_dirty = 1;
+        table_save();
+        return 0;  
     }
 
     return -1;  
 }
 
-int read_file(const char* filename, uint8_t* buffer, uint32_t size) {
-    ensure_file_table_loaded();
+static int read_file_locked(const char* filename, uint8_t* buffer, uint32_t size) {
+    if (table_load() < 0) {
+        return -1;
+    }
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (strncmp(file_table[i].filename, filename, FILENAME_LENGTH) == 0) {
-            if (size > file_table[i].size) {
-                size = file_table[i].size;
-            }
-            memcpy(buffer, file_table[i].content, size);
-            return size;
+    int i = file_table_find(match_name, filename);
+    if (i >= 0) {
+        if (size > file_table[i].size) {
+            size = file_table[i].size;
         }
+        memcpy(buffer, file_table[i].content, size);
+        return size;
     }
     return -1;
 }
 
-int fs_open(const char* filename) {
-    ensure_file_table_loaded();
-    
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (strncmp(file_table[i].filename, filename, FILENAME_LENGTH) == 0) {
-            return i;  
-        }
+static int fs_open_locked(const char* filename) {
+    if (table_load() < 0) {
+        return -1;
     }
-
-    return -1;
+    
+    return file_table_find(match_name, filename);
 }
 
-int fs_read(int file_index, uint8_t* buffer, uint32_t size) {
-    ensure_file_table_loaded();
+static int fs_read_locked(int file_index, uint8_t* buffer, uint32_t size) {
+    if (table_load() < 0) {
+        return -1;
+    }
     
     if (file_index < 0 || file_index >= MAX_FILES || file_table[file_index].filename[0] == '\0') {
         return -1;
@@ -182,24 +274,30 @@ int fs_read(int file_index, uint8_t* buffer, uint32_t size) {
     return size;  
 }
 
-char* list_files() {
+static char* list_files_locked(void) {
     static char buffer[4096];
     int pos = 0;
     buffer[0] = '\0';
-    ensure_file_table_loaded();
+    if (table_load() < 0) {
+        return NULL;
+    }
 
     for (int i = 0; i < MAX_FILES; i++) {
         if (file_table[i].filename[0] != '\0') {
-            pos += custom_snprintf(buffer + pos, sizeof(buffer) - pos, "File: %s\n",
-                             file_table[i].filename, file_table[i].size);
+            pos += snprintf(buffer + pos, sizeof(buffer) - pos, "File: %s\n", file_table[i].filename);
+            if (pos >= (int)sizeof(buffer)) {
+                break; // Truncated
+            }
         }
     }
 
     return buffer;
 }
 
-int fs_close(int file_index) {
-    ensure_file_table_loaded();
+static int fs_close_locked(int file_index) {
+    if (table_load() < 0) {
+        return -1;
+    }
 
     if (file_index < 0 || file_index >= MAX_FILES || file_table[file_index].filename[0] == '\0') {
         return -1;
@@ -210,50 +308,64 @@ int fs_close(int file_index) {
     }
 
     file_table[file_index].is_open = 0;
-    mark_file_table_dirty();
-    save_file_table();
+    file_table_dirty = 1;
+    table_save();
 
     return 0;
 }
 
-int custom_snprintf(char* str, size_t size, const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    int i = 0;
+int create_file(const char* filename, const uint8_t* content, uint32_t size) {
+    mutex_lock(&fs_lock);
+    int result = create_file_locked(filename, content, size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
 
-    for (int j = 0; format[j] != '\0'; j++) {
-        if (i >= size - 1) break;
+int save_file(const char* filename, const char* content, uint32_t size) {
+    mutex_lock(&fs_lock);
+    int result = save_file_locked(filename, content, size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
 
-        if (format[j] == '%' && format[j + 1] == 's') {
-            j++;
-            char* s = va_arg(args, char*);
-            while (*s != '\0') {
-                str[i++] = *s++;
-                if (i >= size - 1) break;
-            }
-        } else if (format[j] == '%' && format[j + 1] == 'd') {
-            j++;
-            int num = va_arg(args, int);
-            if (num == 0) {
-                str[i++] = '0';
-            } else {
-                char buf[10];
-                int n = 0;
-                while (num > 0) {
-                    buf[n++] = '0' + (num % 10);
-                    num /= 10;
-                }
-                for (int k = n - 1; k >= 0; k--) {
-                    str[i++] = buf[k];
-                    if (i >= size - 1) break;
-                }
-            }
-        } else {
-            str[i++] = format[j];
-        }
-    }
+int delete_file(const char* filename) {
+    mutex_lock(&fs_lock);
+    int result = delete_file_locked(filename);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int read_file(const char* filename, uint8_t* buffer, uint32_t size) {
+    mutex_lock(&fs_lock);
+    int result = read_file_locked(filename, buffer, size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_open(const char* filename) {
+    mutex_lock(&fs_lock);
+    int result = fs_open_locked(filename);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_read(int file_index, uint8_t* buffer, uint32_t size) {
+    mutex_lock(&fs_lock);
+    int result = fs_read_locked(file_index, buffer, size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
 
-    str[i] = '\0';
-    va_end(args);
-    return i;
+char* list_files() {
+    mutex_lock(&fs_lock);
+    char* result = list_files_locked();
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_close(int file_index) {
+    mutex_lock(&fs_lock);
+    int result = fs_close_locked(file_index);
+    mutex_unlock(&fs_lock);
+    return result;
 }
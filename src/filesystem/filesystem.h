@@ -18,7 +18,7 @@ typedef struct {
     int is_open;      
 } FileEntry;
 
-extern FileEntry file_table[MAX_FILES];
+extern FileEntry* file_table; // MAX_FILES entries, allocated on first use; NULL until then
 
 
 typedef struct {
@@ -38,5 +38,6 @@ void ensure_file_table_loaded();
 void mark_file_table_dirty();
 int save_file(const char* filename, const char* content, uint32_t size);
 int fs_close(int file_index);
+int fs_checksum(uint32_t* checksum);
 
 #endif 
@@ -0,0 +1,40 @@
+#include "idle.h"
+#include "ktime.h"
+#include "thread.h"
+#include "smp.h"
+#include "print.h"
+
+void cpu_idle(void) {
+    // Nothing left to do until an interrupt, so the screen catches up now
+    print_flush();
+
+    // Only the idle thread halts; anyone else sleeps and lets others run
+    if (thread_wait_interrupt() == 0) {
+        interrupts_enable();
+        return;
+    }
+
+    uint64_t start = tsc_read();
+    __asm__ volatile("sti; hlt" ::: "memory");
+    // The idle thread can be switched out mid-halt, so its share is
+    // taken from the scheduler's accounting instead
+    cpu_local_t* cpu = this_cpu();
+    if (!cpu->thread) {
+        cpu->idle_cycles += tsc_read() - start;
+    }
+    cpu->halt_count++;
+}
+
+uint64_t cpu_idle_time_ns(const cpu_local_t* cpu) {
+    // On the boot CPU, time in the idle thread is halted time too
+    uint64_t threaded = cpu->index == 0 ? thread_idle_time_ns() : 0;
+    return ktime_cycles_to_ns(cpu->idle_cycles) + threaded;
+}
+
+uint64_t idle_time_ns(void) {
+    return cpu_idle_time_ns(this_cpu());
+}
+
+uint64_t idle_halt_count(void) {
+    return this_cpu()->halt_count;
+}
@@ -5,24 +5,43 @@
 #include "../datetime/datetime.h"
 #include "../calculator/calculator.h"
 #include "../snake/snake.h"
+#include "interrupts.h"
+#include "ktime.h"
+#include "idle.h"
+#include "timer.h"
+#include "thread.h"
+#include "smp.h"
+#include "acpi.h"
+#include "gdt.h"
+#include "boot_info.h"
+#include "memops.h"
+#include "serial.h"
+#include "../memory/memory.h"
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define CLOCK_UPDATE_MS 500
+
+static ktimer_t clock_timer;
+static volatile int clock_due = 0;
 
 void run_shell();
 void display_welcome_animation_vga();
 
 void fill_screen(char color) {
-    // More efficient screen filling - direct VGA memory access
-    unsigned char* video_memory = (unsigned char*)0xB8000;
-    unsigned char screen_color = PRINT_COLOR_WHITE | (color << 4);
-    
-    for (int i = 0; i < 80 * 25; i++) {
-        video_memory[i * 2] = ' ';
-        video_memory[i * 2 + 1] = screen_color;
-    }
+    print_fill(0, 0, VGA_WIDTH * VGA_HEIGHT, PRINT_COLOR_WHITE, color);
     print_set_cursor(0, 0);
 }
 
+static void clock_tick(void* data) {
+    (void)data;
+    clock_due = 1;
+}
+
 void reset_screen() {
+    // The header clock only exists on the main interface
+    timer_cancel(&clock_timer);
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
     print_clear();
 }
@@ -32,8 +51,8 @@ void update_datetime() {
     struct tm current_time = get_rtc_time();
     adjust_time_for_nepal(&current_time);
     char buffer[20];
-    simple_snprintf(buffer, current_time.tm_year + 1900, current_time.tm_mon + 1, current_time.tm_mday, 
-                    current_time.tm_hour, current_time.tm_min, current_time.tm_sec);
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d", current_time.tm_year + 1900, current_time.tm_mon + 1,
+             current_time.tm_mday, current_time.tm_hour, current_time.tm_min, current_time.tm_sec);
     
     // Only update if time actually changed
     if (strcmp(buffer, last_buffer) != 0) {
@@ -55,7 +74,7 @@ void update_datetime() {
 
 void display_font_demo() {
     // Try to initialize graphics mode
-    graphics_init(0);
+    graphics_init(boot_info());
     graphics_info_t* gfx = graphics_get_info();
     
     if (gfx && gfx->initialized) {
@@ -121,7 +140,7 @@ void display_font_demo() {
         graphics_draw_string_aa(50, 460, "AV WA TO - Kerned pairs look perfect!", COLOR_GRAY, COLOR_BLACK, &normal_style);
         
         // Wait for a moment to show the demo
-        for (volatile int k = 0; k < 200000000; k++) {}
+        msleep(3000);
         
         // Switch to modern graphics-based terminal
         gfx_print_clear();
@@ -162,14 +181,14 @@ void display_welcome_animation_vga() {
         print_set_cursor(start_x + welcome_len, start_y);
         print_str("...");
         
-        for (volatile int k = 0; k < 20000000; k++) {}
+        msleep(300);
         
         print_set_cursor(start_x + welcome_len, start_y);
         print_str("   ");
        
-        for (volatile int k = 0; k < 10000000; k++) {}
+        msleep(150);
     }
-    for (volatile int k = 0; k < 100000000; k++) {}
+    msleep(1000);
 
     print_clear();
 }
@@ -192,12 +211,33 @@ void initialize_kernel_interface() {
     // Ensure cursor is properly positioned and updated
     print_set_cursor(1, 1);
     print_update_cursor();
+
+    clock_due = 1;
+    timer_start_periodic(&clock_timer, CLOCK_UPDATE_MS, clock_tick, 0);
 }
 
 void kernel_main() {
     static int first_run = 1;
 
     if (first_run) {
+        smp_init_bsp();
+        memops_init();
+        interrupts_init();
+        serial_init();
+        ktime_init();
+        timer_init();
+        init_memory(boot_info());
+        gdt_init(0);
+        thread_init();
+        klog("Memory and scheduler up");
+        if (serial_present()) {
+            klog("Console mirrored to COM1 at %d baud", SERIAL_BAUD);
+        }
+        // Fall back to scanning the BIOS areas if GRUB passed no RSDP
+        if (acpi_init(boot_info()->rsdp_length ? (uint64_t)(uintptr_t)boot_info()->rsdp : 0) < 0) {
+            klog("ACPI: no RSDP, running on one CPU");
+        }
+        klog("%u CPUs online", smp_start_aps());
         display_welcome_animation();
         first_run = 0;
     }
@@ -225,14 +265,14 @@ void kernel_main() {
     print_enable_cursor(14, 15);
     print_update_cursor();
 
-    int update_counter = 0;
-
     while (1) {
-        // Update datetime less frequently
-        if (update_counter == 0) {
+        if (clock_due) {
+            clock_due = 0;
             update_datetime();
         }
-        update_counter = (update_counter + 1) % 5000; // Reduced frequency
+
+        // Sleep until a key arrives or the header clock is due
+        wait_event(keyboard_has_char() || clock_due);
 
         unsigned char c = keyboard_get_char();
         if (c != 0) {
@@ -337,9 +377,6 @@ void kernel_main() {
                     print_update_cursor();
                 }
             }
-        } else {
-            // Small delay when no input to reduce CPU usage
-            for (volatile int i = 0; i < 1000; i++) {}
         }
     }
 }
\ No newline at end of file
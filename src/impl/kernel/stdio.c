@@ -0,0 +1,360 @@
+#include "stdio.h"
+#include "string.h"
+#include "print.h"
+#include "ktime.h"
+#include <stdint.h>
+
+#define KPRINTF_LINE 160 // Two screen lines; longer output is written in pieces
+
+#define FLAG_LEFT 0x01
+#define FLAG_PLUS 0x02
+#define FLAG_SPACE 0x04
+#define FLAG_ALT 0x08
+#define FLAG_ZERO 0x10
+#define FLAG_UPPER 0x20
+
+// Where formatted output goes. A string sink drops what does not fit; a
+// console sink hands a full buffer to `flush` and starts over.
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t used;
+    size_t total; // Everything produced, fitting or not
+    void (*flush)(const char *s, size_t n);
+} sink_t;
+
+// "00" to "99", so integers convert two digits per division
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void emit(sink_t *sink, const char *s, size_t n) {
+    sink->total += n;
+    while (n) {
+        size_t room = sink->size - sink->used;
+        if (!room) {
+            if (!sink->flush) {
+                return;
+            }
+            sink->flush(sink->buffer, sink->used);
+            sink->used = 0;
+            room = sink->size;
+        }
+        size_t chunk = n < room ? n : room;
+        memcpy(sink->buffer + sink->used, s, chunk);
+        sink->used += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+}
+
+static void emit_repeat(sink_t *sink, char c, size_t n) {
+    char pad[16];
+    memset(pad, c, sizeof(pad));
+    while (n) {
+        size_t chunk = n < sizeof(pad) ? n : sizeof(pad);
+        emit(sink, pad, chunk);
+        n -= chunk;
+    }
+}
+
+// Digits of `value` written backwards from `end`; returns how many
+static int convert(char *end, uint64_t value, int base, int upper) {
+    char *p = end;
+    if (base == 10) {
+        while (value >= 100) {
+            const char *pair = &digit_pairs[(value % 100) * 2];
+            value /= 100;
+            *--p = pair[1];
+            *--p = pair[0];
+        }
+        if (value >= 10) {
+            *--p = digit_pairs[value * 2 + 1];
+            *--p = digit_pairs[value * 2];
+        } else {
+            *--p = '0' + value;
+        }
+    } else {
+        const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        int shift = base == 16 ? 4 : 3;
+        do {
+            *--p = digits[value & (base - 1)];
+            value >>= shift;
+        } while (value);
+    }
+    return end - p;
+}
+
+static void format_number(sink_t *sink, uint64_t value, int negative, int base, int flags, int width, int precision) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    int count = 0;
+    // An explicit zero precision prints nothing for zero
+    if (value || precision != 0) {
+        count = convert(end, value, base, flags & FLAG_UPPER);
+    }
+
+    char prefix[3];
+    int prefix_len = 0;
+    if (negative) {
+        prefix[prefix_len++] = '-';
+    } else if (flags & FLAG_PLUS) {
+        prefix[prefix_len++] = '+';
+    } else if (flags & FLAG_SPACE) {
+        prefix[prefix_len++] = ' ';
+    }
+    if ((flags & FLAG_ALT) && base == 16 && value) {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = flags & FLAG_UPPER ? 'X' : 'x';
+    } else if ((flags & FLAG_ALT) && base == 8 && (!count || end[-count] != '0')) {
+        precision = count + 1; // Octal's prefix is a leading zero
+    }
+
+    int zeros = precision > count ? precision - count : 0;
+    if ((flags & FLAG_ZERO) && !(flags & FLAG_LEFT) && precision < 0 && width > prefix_len + count) {
+        zeros = width - prefix_len - count;
+    }
+    int pad = width - prefix_len - zeros - count;
+
+    if (pad > 0 && !(flags & FLAG_LEFT)) {
+        emit_repeat(sink, ' ', pad);
+    }
+    emit(sink, prefix, prefix_len);
+    emit_repeat(sink, '0', zeros);
+    emit(sink, end - count, count);
+    if (pad > 0 && (flags & FLAG_LEFT)) {
+        emit_repeat(sink, ' ', pad);
+    }
+}
+
+static void format_string(sink_t *sink, const char *s, int flags, int width, int precision) {
+    if (!s) {
+        s = "(null)";
+    }
+    size_t len = 0;
+    while ((precision < 0 || len < (size_t)precision) && s[len]) {
+        len++;
+    }
+    int pad = width > (int)len ? width - (int)len : 0;
+    if (!(flags & FLAG_LEFT)) {
+        emit_repeat(sink, ' ', pad);
+    }
+    emit(sink, s, len);
+    if (flags & FLAG_LEFT) {
+        emit_repeat(sink, ' ', pad);
+    }
+}
+
+static void format_output(sink_t *sink, const char *format, va_list args) {
+    const char *p = format;
+    while (*p) {
+        // Literal text goes out in one piece
+        const char *run = p;
+        while (*p && *p != '%') {
+            p++;
+        }
+        if (p != run) {
+            emit(sink, run, p - run);
+        }
+        if (!*p) {
+            break;
+        }
+        const char *spec = p++;
+
+        int flags = 0;
+        for (;; p++) {
+            if (*p == '-') {
+                flags |= FLAG_LEFT;
+            } else if (*p == '+') {
+                flags |= FLAG_PLUS;
+            } else if (*p == ' ') {
+                flags |= FLAG_SPACE;
+            } else if (*p == '#') {
+                flags |= FLAG_ALT;
+            } else if (*p == '0') {
+                flags |= FLAG_ZERO;
+            } else {
+                break;
+            }
+        }
+
+        int width = 0;
+        if (*p == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                flags |= FLAG_LEFT;
+                width = -width;
+            }
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                width = width * 10 + (*p++ - '0');
+            }
+        }
+
+        int precision = -1;
+        if (*p == '.') {
+            p++;
+            precision = 0;
+            if (*p == '*') {
+                precision = va_arg(args, int);
+                p++;
+            } else {
+                while (*p >= '0' && *p <= '9') {
+                    precision = precision * 10 + (*p++ - '0');
+                }
+            }
+        }
+
+        // Length in bytes of the argument; 0 is plain int
+        int length = 0;
+        if (*p == 'h') {
+            length = 2;
+            if (*++p == 'h') {
+                length = 1;
+                p++;
+            }
+        } else if (*p == 'l') {
+            length = 8;
+            if (*++p == 'l') {
+                p++;
+            }
+        } else if (*p == 'z' || *p == 't' || *p == 'j') {
+            length = 8;
+            p++;
+        }
+
+        switch (*p) {
+        case 'd':
+        case 'i': {
+            int64_t value = length == 8 ? va_arg(args, int64_t) : va_arg(args, int);
+            if (length == 1) {
+                value = (signed char)value;
+            } else if (length == 2) {
+                value = (short)value;
+            }
+            uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+            format_number(sink, magnitude, value < 0, 10, flags, width, precision);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o': {
+            uint64_t value = length == 8 ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+            if (length == 1) {
+                value = (unsigned char)value;
+            } else if (length == 2) {
+                value = (unsigned short)value;
+            }
+            int base = *p == 'u' ? 10 : *p == 'o' ? 8 : 16;
+            if (*p == 'X') {
+                flags |= FLAG_UPPER;
+            }
+            format_number(sink, value, 0, base, flags & ~(FLAG_PLUS | FLAG_SPACE), width, precision);
+            break;
+        }
+        case 'p':
+            format_number(sink, (uintptr_t)va_arg(args, void *), 0, 16, (flags | FLAG_ALT) & ~(FLAG_PLUS | FLAG_SPACE), width, precision);
+            break;
+        case 'c': {
+            char c = (char)va_arg(args, int);
+            int pad = width > 1 ? width - 1 : 0;
+            if (!(flags & FLAG_LEFT)) {
+                emit_repeat(sink, ' ', pad);
+            }
+            emit(sink, &c, 1);
+            if (flags & FLAG_LEFT) {
+                emit_repeat(sink, ' ', pad);
+            }
+            break;
+        }
+        case 's':
+            format_string(sink, va_arg(args, const char *), flags, width, precision);
+            break;
+        case '%':
+            emit(sink, "%", 1);
+            break;
+        default:
+            // Not a conversion we know: print it as written
+            if (!*p) {
+                emit(sink, spec, p - spec);
+                return;
+            }
+            emit(sink, spec, p + 1 - spec);
+            break;
+        }
+        p++;
+    }
+}
+
+int vsnprintf(char *buffer, size_t size, const char *format, va_list args) {
+    sink_t sink = {buffer, size ? size - 1 : 0, 0, 0, 0};
+    format_output(&sink, format, args);
+    if (size) {
+        buffer[sink.used] = '\0';
+    }
+    return (int)sink.total;
+}
+
+int snprintf(char *buffer, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int result = vsnprintf(buffer, size, format, args);
+    va_end(args);
+    return result;
+}
+
+int sprintf(char *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int result = vsnprintf(buffer, SIZE_MAX, format, args);
+    va_end(args);
+    return result;
+}
+
+int vkprintf(const char *format, va_list args) {
+    char line[KPRINTF_LINE];
+    sink_t sink = {line, sizeof(line), 0, 0, print_write};
+    format_output(&sink, format, args);
+    if (sink.used) {
+        print_write(line, sink.used);
+    }
+    return (int)sink.total;
+}
+
+int kprintf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int result = vkprintf(format, args);
+    va_end(args);
+    return result;
+}
+
+int klog(const char *format, ...) {
+    char line[KPRINTF_LINE];
+    uint64_t ms = ktime_now() / NSEC_PER_MSEC;
+    size_t used = snprintf(line, sizeof(line), "[%5llu.%03llu] ",
+                           (unsigned long long)(ms / 1000), (unsigned long long)(ms % 1000));
+
+    // Leave room for the newline
+    va_list args;
+    va_start(args, format);
+    int result = vsnprintf(line + used, sizeof(line) - used - 1, format, args);
+    va_end(args);
+    size_t room = sizeof(line) - used - 2;
+    used += (size_t)result < room ? (size_t)result : room;
+    line[used++] = '\n';
+
+    // One write, so the console lock keeps the line whole
+    print_console_write(PRINT_LOG_CONSOLE, line, used);
+    return result;
+}
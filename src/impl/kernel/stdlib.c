@@ -0,0 +1,18 @@
+#include "stdlib.h"
+#include "../memory/memory.h"
+
+void *malloc(size_t size) {
+    return kmalloc_track_caller(size, __builtin_return_address(0));
+}
+
+void free(void *ptr) {
+    kfree(ptr);
+}
+
+void *realloc(void *ptr, size_t size) {
+    return krealloc_track_caller(ptr, size, __builtin_return_address(0));
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    return kcalloc_track_caller(nmemb, size, __builtin_return_address(0));
+}
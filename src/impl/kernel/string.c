@@ -1,40 +1,44 @@
 #include "string.h"
+#include "memops.h"
+#include <stdint.h>
 
-void *memcpy(void *dest, const void *src, size_t n) {
+typedef uint64_t __attribute__((may_alias, aligned(1))) word_t;
+
+memops_t memops = {
+    "generic", memcpy_generic, memset_generic, memcmp_generic, memchr_generic, strlen_generic
+};
+
+// The portable versions move a word at a time; x86 does not mind the
+// unaligned accesses
+
+void *memcpy_generic(void *dest, const void *src, size_t n) {
     char *d = dest;
     const char *s = src;
+    for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+        *(word_t *)d = *(const word_t *)s;
+        d += sizeof(word_t);
+        s += sizeof(word_t);
+    }
     while (n--) {
         *d++ = *s++;
     }
     return dest;
 }
 
-void *memmove(void *dest, const void *src, size_t n) {
-    char *d = dest;
-    const char *s = src;
-    if (d < s) {
-        while (n--) {
-            *d++ = *s++;
-        }
-    } else {
-        d += n;
-        s += n;
-        while (n--) {
-            *(--d) = *(--s);
-        }
-    }
-    return dest;
-}
-
-void *memset(void *s, int c, size_t n) {
+void *memset_generic(void *s, int c, size_t n) {
     unsigned char *p = s;
+    word_t pattern = (unsigned char)c * 0x0101010101010101ULL;
+    for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+        *(word_t *)p = pattern;
+        p += sizeof(word_t);
+    }
     while (n--) {
         *p++ = (unsigned char)c;
     }
     return s;
 }
 
-void *memchr(const void *s, int c, size_t n) {
+void *memchr_generic(const void *s, int c, size_t n) {
     const unsigned char *p = s;
     while (n--) {
         if (*p == (unsigned char)c) {
@@ -45,9 +49,14 @@ void *memchr(const void *s, int c, size_t n) {
     return NULL;
 }
 
-int memcmp(const void *s1, const void *s2, size_t n) {
+int memcmp_generic(const void *s1, const void *s2, size_t n) {
     const unsigned char *p1 = s1;
     const unsigned char *p2 = s2;
+    // Skip the equal words; the byte loop finds the difference in the last one
+    for (; n >= sizeof(word_t) && *(const word_t *)p1 == *(const word_t *)p2; n -= sizeof(word_t)) {
+        p1 += sizeof(word_t);
+        p2 += sizeof(word_t);
+    }
     while (n--) {
         if (*p1 != *p2) {
             return *p1 - *p2;
@@ -58,6 +67,62 @@ int memcmp(const void *s1, const void *s2, size_t n) {
     return 0;
 }
 
+size_t strlen_generic(const char *s) {
+    const char *p = s;
+    while (*p) {
+        p++;
+    }
+    return p - s;
+}
+
+void *memcpy(void *dest, const void *src, size_t n) {
+    return memops.memcpy(dest, src, n);
+}
+
+// Overlapping moves go a word at a time in the safe direction; a word is
+// read before any of it is written
+void *memmove(void *dest, const void *src, size_t n) {
+    char *d = dest;
+    const char *s = src;
+    if (d + n <= s || s + n <= d) {
+        return memops.memcpy(dest, src, n);
+    }
+    if (d < s) {
+        for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+            *(word_t *)d = *(const word_t *)s;
+            d += sizeof(word_t);
+            s += sizeof(word_t);
+        }
+        while (n--) {
+            *d++ = *s++;
+        }
+    } else {
+        d += n;
+        s += n;
+        for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+            d -= sizeof(word_t);
+            s -= sizeof(word_t);
+            *(word_t *)d = *(const word_t *)s;
+        }
+        while (n--) {
+            *(--d) = *(--s);
+        }
+    }
+    return dest;
+}
+
+void *memset(void *s, int c, size_t n) {
+    return memops.memset(s, c, n);
+}
+
+void *memchr(const void *s, int c, size_t n) {
+    return memops.memchr(s, c, n);
+}
+
+int memcmp(const void *s1, const void *s2, size_t n) {
+    return memops.memcmp(s1, s2, n);
+}
+
 char *strcpy(char *dest, const char *src) {
     char *d = dest;
     while ((*d++ = *src++)) {
@@ -137,11 +202,7 @@ char *strrchr(const char *s, int c) {
 }
 
 size_t strlen(const char *s) {
-    const char *p = s;
-    while (*p) {
-        p++;
-    }
-    return p - s;
+    return memops.strlen(s);
 }
 
 size_t strcspn(const char *s, const char *reject) {
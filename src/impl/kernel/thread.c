@@ -0,0 +1,406 @@
+#include "thread.h"
+#include "idle.h"
+#include "ktime.h"
+#include "string.h"
+#include "smp.h"
+#include "fpu.h"
+#include "../memory/memory.h"
+#include "../memory/vmm.h"
+
+#define KERNEL_CODE_SELECTOR 0x08
+#define RFLAGS_RESERVED (1 << 1)
+#define RFLAGS_IF (1 << 9)
+
+// The running thread is per-CPU; only the boot CPU runs the scheduler for now
+#define current (this_cpu()->thread)
+
+static thread_t boot_thread;
+static thread_t* idle_thread = 0;
+static thread_t* all_threads = 0;
+static thread_t* zombies = 0; // Finished detached threads, freed by the next create
+static thread_t* irq_waiters = 0;
+
+// One FIFO per priority; run_bitmap has a bit set for each non-empty one
+static thread_t* run_head[THREAD_PRIORITIES];
+static thread_t* run_tail[THREAD_PRIORITIES];
+static uint32_t run_bitmap = 0;
+
+static int need_resched = 0;
+static ktimer_t slice_timer;
+static uint32_t next_id = 1;
+static thread_stats_t stats;
+static kmem_cache_t* thread_cache = 0;
+
+static void runqueue_push(thread_t* thread) {
+    int priority = thread->priority;
+    thread->state = THREAD_READY;
+    thread->ready_since = tsc_read();
+    thread->next = 0;
+    if (run_tail[priority]) {
+        run_tail[priority]->next = thread;
+    } else {
+        run_head[priority] = thread;
+    }
+    run_tail[priority] = thread;
+    run_bitmap |= 1u << priority;
+}
+
+static int runqueue_top(void) {
+    return run_bitmap ? 31 - __builtin_clz(run_bitmap) : -1;
+}
+
+static thread_t* runqueue_pop(void) {
+    int priority = runqueue_top();
+    if (priority < 0) {
+        return 0;
+    }
+    thread_t* thread = run_head[priority];
+    run_head[priority] = thread->next;
+    if (!run_head[priority]) {
+        run_tail[priority] = 0;
+        run_bitmap &= ~(1u << priority);
+    }
+    thread->next = 0;
+    return thread;
+}
+
+// Make a thread runnable; it preempts the current thread if it outranks it
+static void thread_wake(thread_t* thread) {
+    runqueue_push(thread);
+    if (current == idle_thread || thread->priority > current->priority) {
+        need_resched = 1;
+    }
+}
+
+static void slice_expired(void* data) {
+    (void)data;
+    need_resched = 1;
+}
+
+static void yield_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    need_resched = 1;
+}
+
+interrupt_frame_t* thread_interrupt_exit(interrupt_frame_t* frame) {
+    if (!current) {
+        return frame;
+    }
+
+    // Any hardware interrupt may have satisfied a wait_event() condition
+    if (frame->vector != THREAD_YIELD_VECTOR) {
+        while (irq_waiters) {
+            thread_t* thread = irq_waiters;
+            irq_waiters = thread->next;
+            thread_wake(thread);
+        }
+    }
+
+    if (!need_resched) {
+        return frame;
+    }
+    need_resched = 0;
+
+    uint64_t start = tsc_read();
+    thread_t* prev = current;
+    prev->frame = frame;
+    if (prev->state == THREAD_RUNNING && prev != idle_thread) {
+        runqueue_push(prev);
+    }
+
+    thread_t* next = runqueue_pop();
+    if (!next) {
+        next = idle_thread;
+    }
+    next->state = THREAD_RUNNING;
+    current = next;
+
+    if (next != prev) {
+        fpu_switch(prev, next);
+        prev->run_cycles += start - prev->run_start;
+        next->run_start = start;
+        stats.switches++;
+        next->switches_in++;
+        if (prev->state == THREAD_READY && frame->vector != THREAD_YIELD_VECTOR) {
+            stats.preemptions++;
+        }
+        if (next != idle_thread) {
+            uint64_t latency = ktime_cycles_to_ns(start - next->ready_since);
+            stats.wakeups++;
+            stats.wakeup_ns_total += latency;
+            if (latency > stats.wakeup_ns_max) {
+                stats.wakeup_ns_max = latency;
+            }
+            if (latency > next->max_wakeup_ns) {
+                next->max_wakeup_ns = latency;
+            }
+        }
+    }
+
+    // Only time-slice when another thread of the same priority is waiting
+    if (next != idle_thread && runqueue_top() >= next->priority) {
+        timer_start(&slice_timer, THREAD_SLICE_MS, slice_expired, 0);
+    } else if (timer_pending(&slice_timer)) {
+        timer_cancel(&slice_timer);
+    }
+
+    stats.switch_cycles += tsc_read() - start;
+    return next->frame;
+}
+
+static void thread_start(void) {
+    current->entry(current->arg);
+    thread_exit();
+}
+
+static void idle_loop(void* arg) {
+    (void)arg;
+    while (1) {
+        interrupts_disable();
+        cpu_idle();
+    }
+}
+
+static void thread_free(thread_t* thread) {
+    thread_t** link = &all_threads;
+    while (*link && *link != thread) {
+        link = &(*link)->all_next;
+    }
+    if (*link) {
+        *link = thread->all_next;
+    }
+    vmm_release(thread->stack);
+    fpu_thread_free(thread);
+    kmem_cache_free(thread_cache, thread);
+}
+
+static void reap_zombies(void) {
+    uint64_t flags = irq_save();
+    while (zombies) {
+        thread_t* thread = zombies;
+        zombies = thread->next;
+        thread_free(thread);
+    }
+    irq_restore(flags);
+}
+
+// Control blocks come from their own object cache, stacks are guarded
+// regions; the first context is a frame that "returns" into thread_start
+static thread_t* thread_alloc(const char* name, thread_entry_t entry, void* arg, int priority) {
+    thread_t* thread = kmem_cache_alloc(thread_cache);
+    if (!thread) {
+        return 0;
+    }
+    uint8_t* stack = vmm_stack_alloc(name, THREAD_STACK_SIZE);
+    if (!stack) {
+        kmem_cache_free(thread_cache, thread);
+        return 0;
+    }
+
+    memset(thread, 0, sizeof(thread_t));
+    if (fpu_thread_init(thread) < 0) {
+        vmm_release(stack);
+        kmem_cache_free(thread_cache, thread);
+        return 0;
+    }
+    thread->stack = stack;
+    thread->name = name;
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->priority = priority;
+    thread->state = THREAD_READY;
+    thread->console = current ? current->console : 0;
+
+    uint64_t* rsp = (uint64_t*)(((uintptr_t)stack + THREAD_STACK_SIZE) & ~0xFULL);
+    *--rsp = 0; // Fake return address, so rsp is aligned as if thread_start was called
+
+    interrupt_frame_t* frame = (interrupt_frame_t*)rsp - 1;
+    memset(frame, 0, sizeof(interrupt_frame_t));
+    frame->rip = (uintptr_t)thread_start;
+    frame->cs = KERNEL_CODE_SELECTOR;
+    frame->rflags = RFLAGS_RESERVED | RFLAGS_IF;
+    frame->rsp = (uintptr_t)rsp;
+    frame->ss = 0;
+    thread->frame = frame;
+
+    uint64_t flags = irq_save();
+    thread->id = next_id++;
+    thread->all_next = all_threads;
+    all_threads = thread;
+    irq_restore(flags);
+    return thread;
+}
+
+void thread_init(void) {
+    if (current) {
+        return;
+    }
+
+    if (!thread_cache) {
+        thread_cache = kmem_cache_create("thread", sizeof(thread_t), 64, 0);
+    }
+    if (!thread_cache) {
+        return;
+    }
+    idle_thread = thread_alloc("idle", idle_loop, 0, THREAD_PRIORITY_IDLE);
+    if (!idle_thread) {
+        return;
+    }
+
+    if (fpu_thread_adopt(&boot_thread) < 0) {
+        return;
+    }
+    boot_thread.name = "main";
+    boot_thread.id = 0;
+    boot_thread.priority = THREAD_PRIORITY_NORMAL;
+    boot_thread.state = THREAD_RUNNING;
+    boot_thread.run_start = tsc_read();
+    boot_thread.all_next = all_threads;
+    all_threads = &boot_thread;
+
+    interrupt_register_handler(THREAD_YIELD_VECTOR, yield_interrupt);
+    current = &boot_thread;
+}
+
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, int priority) {
+    if (!current) {
+        return 0;
+    }
+    if (priority <= THREAD_PRIORITY_IDLE) {
+        priority = THREAD_PRIORITY_IDLE + 1;
+    } else if (priority >= THREAD_PRIORITIES) {
+        priority = THREAD_PRIORITIES - 1;
+    }
+
+    reap_zombies();
+    thread_t* thread = thread_alloc(name, entry, arg, priority);
+    if (!thread) {
+        return 0;
+    }
+
+    uint64_t flags = irq_save();
+    thread_wake(thread);
+    if (need_resched) {
+        thread_yield();
+    }
+    irq_restore(flags);
+    return thread;
+}
+
+void thread_yield(void) {
+    __asm__ volatile("int %0" : : "i"(THREAD_YIELD_VECTOR) : "memory");
+}
+
+void thread_exit(void) {
+    interrupts_disable();
+    current->state = THREAD_DEAD;
+    if (current->joiner) {
+        thread_wake(current->joiner);
+    } else if (current->detached) {
+        current->next = zombies;
+        zombies = current;
+    }
+    thread_yield();
+    while (1) {
+        // A dead thread is never scheduled again
+    }
+}
+
+void thread_join(thread_t* thread) {
+    uint64_t flags = irq_save();
+    if (thread->state != THREAD_DEAD) {
+        thread->joiner = current;
+        current->state = THREAD_BLOCKED;
+        thread_yield();
+    }
+    thread_free(thread);
+    irq_restore(flags);
+}
+
+void thread_detach(thread_t* thread) {
+    uint64_t flags = irq_save();
+    if (thread->state == THREAD_DEAD) {
+        thread_free(thread);
+    } else {
+        thread->detached = 1;
+    }
+    irq_restore(flags);
+}
+
+thread_t* thread_current(void) {
+    return current;
+}
+
+int thread_wait_interrupt(void) {
+    if (!current || current == idle_thread) {
+        return -1;
+    }
+    current->state = THREAD_BLOCKED;
+    current->next = irq_waiters;
+    irq_waiters = current;
+    thread_yield();
+    return 0;
+}
+
+void thread_get_stats(thread_stats_t* out) {
+    uint64_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
+
+uint64_t thread_cpu_time_ns(const thread_t* thread) {
+    uint64_t flags = irq_save();
+    uint64_t cycles = thread->run_cycles;
+    if (thread == current) {
+        cycles += tsc_read() - thread->run_start;
+    }
+    irq_restore(flags);
+    return ktime_cycles_to_ns(cycles);
+}
+
+uint64_t thread_idle_time_ns(void) {
+    return idle_thread ? thread_cpu_time_ns(idle_thread) : 0;
+}
+
+thread_t* thread_first(void) {
+    return all_threads;
+}
+
+void mutex_lock(mutex_t* mutex) {
+    uint64_t flags = irq_save();
+    if (!current) {
+        irq_restore(flags);
+        return;
+    }
+    if (!mutex->owner) {
+        mutex->owner = current;
+    } else {
+        current->next = 0;
+        if (mutex->waiters_tail) {
+            mutex->waiters_tail->next = current;
+        } else {
+            mutex->waiters = current;
+        }
+        mutex->waiters_tail = current;
+        current->state = THREAD_BLOCKED;
+        thread_yield(); // Back here once mutex_unlock made us the owner
+    }
+    irq_restore(flags);
+}
+
+void mutex_unlock(mutex_t* mutex) {
+    uint64_t flags = irq_save();
+    thread_t* next = mutex->waiters;
+    mutex->owner = next;
+    if (next) {
+        mutex->waiters = next->next;
+        if (!mutex->waiters) {
+            mutex->waiters_tail = 0;
+        }
+        thread_wake(next);
+        if (need_resched) {
+            thread_yield();
+        }
+    }
+    irq_restore(flags);
+}
@@ -0,0 +1,271 @@
+#include "timer.h"
+#include "lapic.h"
+#include "ktime.h"
+#include "interrupts.h"
+
+// Hierarchical wheel: level L has 64 slots of 64^L ticks each, so the four
+// levels reach 64^4 ms (about 4.6 hours) ahead. A timer sits in the lowest
+// level that can hold it and is pulled down a level when its slot comes up.
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+
+// Deadlines go through the TSC scale and can land a little early
+#define TIMER_SLACK_NS (50 * NSEC_PER_USEC)
+
+#define TIMER_IDLE 0
+#define TIMER_QUEUED 1
+#define TIMER_EXPIRED 2
+
+static ktimer_t* wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t occupied[WHEEL_LEVELS];
+static ktimer_t* expired_list = 0;
+static uint64_t wheel_clock = 0; // Last tick the wheel was advanced to
+static uint64_t armed_tick = 0; // Tick the hardware is armed for, 0 if idle
+static uint64_t interrupt_count = 0;
+static int timer_available = 0;
+
+static void list_push(ktimer_t** head, ktimer_t* timer) {
+    timer->prev = 0;
+    timer->next = *head;
+    if (*head) {
+        (*head)->prev = timer;
+    }
+    *head = timer;
+}
+
+static void list_remove(ktimer_t** head, ktimer_t* timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *head = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->next = 0;
+    timer->prev = 0;
+}
+
+static uint64_t current_tick(void) {
+    return (ktime_now() + TIMER_SLACK_NS) / TIMER_TICK_NS;
+}
+
+static int wheel_empty(void) {
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        if (occupied[level]) {
+            return 0;
+        }
+    }
+    return expired_list == 0;
+}
+
+static void wheel_insert(ktimer_t* timer) {
+    if (timer->expires <= wheel_clock) {
+        timer->expires = wheel_clock + 1;
+    }
+
+    int level = 0;
+    uint64_t bucket = timer->expires;
+    while (bucket - (wheel_clock >> (level * WHEEL_SLOT_BITS)) >= WHEEL_SLOTS) {
+        if (level == WHEEL_LEVELS - 1) {
+            // Beyond the wheel: park in the farthest slot and re-sort later
+            bucket = (wheel_clock >> (level * WHEEL_SLOT_BITS)) + WHEEL_SLOTS - 1;
+            break;
+        }
+        level++;
+        bucket = timer->expires >> (level * WHEEL_SLOT_BITS);
+    }
+
+    timer->state = TIMER_QUEUED;
+    timer->level = level;
+    timer->slot = bucket & WHEEL_SLOT_MASK;
+    list_push(&wheel[level][timer->slot], timer);
+    occupied[level] |= 1ULL << timer->slot;
+}
+
+static void timer_dequeue(ktimer_t* timer) {
+    if (timer->state == TIMER_QUEUED) {
+        list_remove(&wheel[timer->level][timer->slot], timer);
+        if (!wheel[timer->level][timer->slot]) {
+            occupied[timer->level] &= ~(1ULL << timer->slot);
+        }
+    } else if (timer->state == TIMER_EXPIRED) {
+        list_remove(&expired_list, timer);
+    }
+    timer->state = TIMER_IDLE;
+}
+
+// Move every timer whose slot has come due by `now` onto the expired list,
+// and re-file the rest of those slots at a finer level
+static void wheel_advance(uint64_t now) {
+    ktimer_t* cascade = 0;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = level * WHEEL_SLOT_BITS;
+        uint64_t from = (wheel_clock >> shift) + 1;
+        uint64_t to = now >> shift;
+        if (to < from) {
+            break; // Coarser levels cannot have crossed a slot either
+        }
+        if (to - from >= WHEEL_SLOTS) {
+            to = from + WHEEL_SLOTS - 1;
+        }
+
+        for (uint64_t bucket = from; bucket <= to; bucket++) {
+            int slot = bucket & WHEEL_SLOT_MASK;
+            if (!(occupied[level] & (1ULL << slot))) {
+                continue;
+            }
+            while (wheel[level][slot]) {
+                ktimer_t* timer = wheel[level][slot];
+                list_remove(&wheel[level][slot], timer);
+                if (timer->expires <= now) {
+                    timer->state = TIMER_EXPIRED;
+                    list_push(&expired_list, timer);
+                } else {
+                    timer->next = cascade;
+                    cascade = timer;
+                }
+            }
+            occupied[level] &= ~(1ULL << slot);
+        }
+    }
+
+    wheel_clock = now;
+    while (cascade) {
+        ktimer_t* timer = cascade;
+        cascade = timer->next;
+        wheel_insert(timer);
+    }
+}
+
+// Earliest expiry in the wheel, or 0 if it is empty. Within a level the
+// first occupied slot always holds that level's earliest timers.
+static uint64_t wheel_next_expiry(void) {
+    uint64_t next = 0;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        if (!occupied[level]) {
+            continue;
+        }
+        int start = ((wheel_clock >> (level * WHEEL_SLOT_BITS)) + 1) & WHEEL_SLOT_MASK;
+        uint64_t rotated = (occupied[level] >> start) | (occupied[level] << ((WHEEL_SLOTS - start) & WHEEL_SLOT_MASK));
+        int slot = (start + __builtin_ctzll(rotated)) & WHEEL_SLOT_MASK;
+
+        for (ktimer_t* timer = wheel[level][slot]; timer; timer = timer->next) {
+            if (next == 0 || timer->expires < next) {
+                next = timer->expires;
+            }
+        }
+    }
+    return next;
+}
+
+// Arm the hardware for the earliest timer, or switch it off
+static void timer_reprogram(void) {
+    uint64_t next = wheel_next_expiry();
+    if (next == armed_tick) {
+        return;
+    }
+    armed_tick = next;
+    if (next == 0) {
+        lapic_timer_cancel();
+    } else {
+        lapic_timer_arm(next * TIMER_TICK_NS);
+    }
+}
+
+static void timer_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    lapic_eoi();
+    interrupt_count++;
+    armed_tick = 0;
+
+    wheel_advance(current_tick());
+
+    // Callbacks may start or cancel any timer, including ones still on
+    // the expired list, so take them off one at a time
+    while (expired_list) {
+        ktimer_t* timer = expired_list;
+        list_remove(&expired_list, timer);
+        timer->state = TIMER_IDLE;
+        if (timer->period) {
+            timer->expires += timer->period;
+            if (timer->expires <= wheel_clock) {
+                timer->expires = wheel_clock + timer->period; // Skip missed runs
+            }
+            wheel_insert(timer);
+        }
+        timer->callback(timer->data);
+    }
+
+    timer_reprogram();
+}
+
+int timer_init(void) {
+    if (timer_available) {
+        return 0;
+    }
+    if (lapic_init() < 0) {
+        return -1;
+    }
+    interrupt_register_handler(LAPIC_TIMER_VECTOR, timer_interrupt);
+    wheel_clock = current_tick();
+    timer_available = 1;
+    return 0;
+}
+
+static int timer_arm(ktimer_t* timer, uint32_t delay_ms, uint32_t period_ms, timer_callback_t callback, void* data) {
+    if (!timer_available) {
+        return -1;
+    }
+
+    uint64_t flags = irq_save();
+    timer_dequeue(timer);
+
+    uint64_t now = current_tick();
+    if (wheel_empty()) {
+        // Nothing can be skipped over, so catch the wheel up for free
+        wheel_clock = now;
+    }
+
+    timer->callback = callback;
+    timer->data = data;
+    timer->period = period_ms * (NSEC_PER_MSEC / TIMER_TICK_NS);
+    timer->expires = now + delay_ms * (NSEC_PER_MSEC / TIMER_TICK_NS);
+    wheel_insert(timer);
+    timer_reprogram();
+
+    irq_restore(flags);
+    return 0;
+}
+
+int timer_start(ktimer_t* timer, uint32_t delay_ms, timer_callback_t callback, void* data) {
+    return timer_arm(timer, delay_ms, 0, callback, data);
+}
+
+int timer_start_periodic(ktimer_t* timer, uint32_t period_ms, timer_callback_t callback, void* data) {
+    if (period_ms == 0) {
+        period_ms = 1;
+    }
+    return timer_arm(timer, period_ms, period_ms, callback, data);
+}
+
+void timer_cancel(ktimer_t* timer) {
+    uint64_t flags = irq_save();
+    timer_dequeue(timer);
+    if (timer_available) {
+        timer_reprogram();
+    }
+    irq_restore(flags);
+}
+
+int timer_pending(const ktimer_t* timer) {
+    return timer->state != TIMER_IDLE;
+}
+
+uint64_t timer_interrupt_count(void) {
+    return interrupt_count;
+}
@@ -1,18 +1,41 @@
 #include "unistd.h"
+#include "ktime.h"
+#include "idle.h"
+#include "timer.h"
+#include "thread.h"
 
-void delay_loop(unsigned int iterations) {
-    volatile int count;
-    for (unsigned int i = 0; i < iterations; i++) {
-        count++; 
+static void wake_sleeper(void* data) {
+    *(volatile int*)data = 1;
 }
 
-void sleep(unsigned int seconds) {
-    for (unsigned int i = 0; i < seconds; i++) {
-        usleep(1000000);  
+static void delay_until(uint64_t deadline) {
+    // Halt until the last whole timer tick, spin only for the remainder
+    uint64_t now = ktime_now();
+    if (deadline > now + TIMER_TICK_NS) {
+        volatile int woken = 0;
+        ktimer_t timer = {0};
+        uint32_t delay_ms = (uint32_t)((deadline - now) / NSEC_PER_MSEC);
+        if (timer_start(&timer, delay_ms, wake_sleeper, (void*)&woken) == 0) {
+            wait_event(woken);
+        }
+    }
+    while (ktime_now() < deadline) {
+        __asm__ volatile("pause");
     }
 }
 
+void sleep(unsigned int seconds) {
+    delay_until(ktime_now() + seconds * NSEC_PER_SEC);
+}
+
+void msleep(unsigned int milliseconds) {
+    delay_until(ktime_now() + milliseconds * NSEC_PER_MSEC);
+}
+
 void usleep(unsigned int microseconds) {
-    delay_loop(microseconds * 10);
+    delay_until(ktime_now() + microseconds * NSEC_PER_USEC);
 }
+
+void yield(void) {
+    thread_yield();
 }
@@ -0,0 +1,175 @@
+#include "workpool.h"
+#include "smp.h"
+
+// Chase-Lev work-stealing deques, one per CPU. The owner pushes and pops
+// at the bottom; thieves take from the top. A job is split by halving:
+// a worker keeps the lower half and pushes the upper half, so thieves
+// always take the largest pieces left.
+
+typedef struct {
+    size_t begin;
+    size_t end;
+} task_t;
+
+typedef struct {
+    volatile int64_t top;
+    volatile int64_t bottom;
+    task_t tasks[WORKPOOL_DEQUE_SIZE];
+} __attribute__((aligned(64))) deque_t;
+
+typedef struct {
+    parallel_fn_t fn;
+    void* arg;
+    size_t grain;
+    volatile size_t remaining; // Iterations not yet run
+    volatile uint32_t active; // APs that have not left the job yet
+    uint32_t workers;
+} job_t;
+
+static deque_t deques[SMP_MAX_CPUS];
+static workpool_stats_t stats[SMP_MAX_CPUS];
+static volatile int pool_busy = 0;
+
+static int deque_push(deque_t* deque, task_t task) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= WORKPOOL_DEQUE_SIZE) {
+        return -1;
+    }
+    deque->tasks[bottom & (WORKPOOL_DEQUE_SIZE - 1)] = task;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static int deque_pop(deque_t* deque, task_t* task) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    *task = deque->tasks[bottom & (WORKPOOL_DEQUE_SIZE - 1)];
+    if (top == bottom) {
+        // Last task: race any thief for it through top
+        int won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return won;
+    }
+    return 1;
+}
+
+static int deque_steal(deque_t* deque, task_t* task) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+        return 0;
+    }
+
+    *task = deque->tasks[top & (WORKPOOL_DEQUE_SIZE - 1)];
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static void run_task(job_t* job, uint32_t self, task_t task) {
+    while (task.end - task.begin > job->grain) {
+        size_t mid = task.begin + (task.end - task.begin) / 2;
+        task_t upper = { mid, task.end };
+        if (deque_push(&deques[self], upper) < 0) {
+            break; // Deque full: run the rest here
+        }
+        task.end = mid;
+    }
+
+    job->fn(task.begin, task.end, job->arg);
+    stats[self].executed++;
+    stats[self].iterations += task.end - task.begin;
+    __atomic_sub_fetch(&job->remaining, task.end - task.begin, __ATOMIC_RELEASE);
+}
+
+static void worker_loop(job_t* job, uint32_t self) {
+    uint32_t seed = self * 2654435761u + 1;
+    task_t task;
+
+    while (__atomic_load_n(&job->remaining, __ATOMIC_ACQUIRE)) {
+        if (deque_pop(&deques[self], &task)) {
+            run_task(job, self, task);
+            continue;
+        }
+
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        uint32_t victim = seed % job->workers;
+        if (victim == self) {
+            continue;
+        }
+        if (deque_steal(&deques[victim], &task)) {
+            stats[self].steals++;
+            run_task(job, self, task);
+        } else {
+            stats[self].failed_steals++;
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+static void ap_worker(void* arg) {
+    job_t* job = arg;
+    worker_loop(job, this_cpu()->index);
+    __atomic_sub_fetch(&job->active, 1, __ATOMIC_RELEASE);
+}
+
+void parallel_for(size_t begin, size_t end, size_t grain, parallel_fn_t fn, void* arg) {
+    if (end <= begin) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    // Workers are handed out by the boot CPU, one job at a time
+    int idle = 0;
+    uint32_t workers = smp_cpu_count();
+    if (workers == 1 || end - begin <= grain || this_cpu()->index != 0 ||
+        !__atomic_compare_exchange_n(&pool_busy, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        fn(begin, end, arg);
+        return;
+    }
+
+    job_t job = {
+        .fn = fn,
+        .arg = arg,
+        .grain = grain,
+        .remaining = end - begin,
+        .active = 0,
+        .workers = workers
+    };
+
+    for (uint32_t i = 1; i < workers; i++) {
+        __atomic_add_fetch(&job.active, 1, __ATOMIC_RELAXED);
+        if (smp_run_on(i, ap_worker, &job) < 0) {
+            __atomic_sub_fetch(&job.active, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    task_t whole = { begin, end };
+    run_task(&job, 0, whole);
+    worker_loop(&job, 0);
+
+    // The job lives on this stack, so wait until every AP has let go of it
+    while (__atomic_load_n(&job.active, __ATOMIC_ACQUIRE)) {
+        __asm__ volatile("pause");
+    }
+    __atomic_store_n(&pool_busy, 0, __ATOMIC_RELEASE);
+}
+
+void workpool_get_stats(uint32_t worker, workpool_stats_t* out) {
+    if (worker < SMP_MAX_CPUS) {
+        *out = stats[worker];
+    }
+}
@@ -0,0 +1,150 @@
+#include "acpi.h"
+#include "string.h"
+
+#define EBDA_SEGMENT_POINTER 0x40E
+#define BIOS_AREA_START 0xE0000
+#define BIOS_AREA_END 0x100000
+
+#define MADT_LOCAL_APIC 0
+#define MADT_IO_APIC 1
+#define MADT_LAPIC_ADDRESS_OVERRIDE 5
+
+#define MADT_CPU_ENABLED (1 << 0)
+#define MADT_CPU_ONLINE_CAPABLE (1 << 1)
+
+typedef struct __attribute__((packed)) {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} acpi_rsdp_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} acpi_madt_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t length;
+} madt_entry_t;
+
+static const acpi_sdt_header_t* root_table = 0;
+static int root_is_xsdt = 0;
+static acpi_madt_info_t madt_info;
+static int madt_found = 0;
+
+static uint8_t checksum(const void* data, uint32_t length) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+// The RSDP sits on a 16-byte boundary in the first KB of the EBDA or
+// in the BIOS ROM area below 1 MB
+static const acpi_rsdp_t* rsdp_scan(uintptr_t start, uintptr_t end) {
+    for (uintptr_t address = start; address + 20 <= end; address += 16) {
+        const acpi_rsdp_t* rsdp = (const acpi_rsdp_t*)address;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksum(rsdp, 20) == 0) {
+            return rsdp;
+        }
+    }
+    return 0;
+}
+
+static const acpi_rsdp_t* rsdp_find(void) {
+    uintptr_t ebda = (uintptr_t)(*(volatile uint16_t*)EBDA_SEGMENT_POINTER) << 4;
+    const acpi_rsdp_t* rsdp = 0;
+    if (ebda) {
+        rsdp = rsdp_scan(ebda, ebda + 1024);
+    }
+    if (!rsdp) {
+        rsdp = rsdp_scan(BIOS_AREA_START, BIOS_AREA_END);
+    }
+    return rsdp;
+}
+
+static void madt_parse(const acpi_madt_t* madt) {
+    memset(&madt_info, 0, sizeof(madt_info));
+    madt_info.lapic_address = madt->lapic_address;
+
+    const uint8_t* entry = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (entry + sizeof(madt_entry_t) <= end) {
+        const madt_entry_t* header = (const madt_entry_t*)entry;
+        if (header->length < sizeof(madt_entry_t)) {
+            break;
+        }
+
+        if (header->type == MADT_LOCAL_APIC) {
+            // acpi_processor_id, apic_id, flags
+            uint8_t apic_id = entry[3];
+            uint32_t flags = *(const uint32_t*)(entry + 4);
+            if ((flags & MADT_CPU_ENABLED) && madt_info.cpu_count < ACPI_MAX_CPUS) {
+                madt_info.apic_ids[madt_info.cpu_count++] = apic_id;
+            } else if (flags & MADT_CPU_ONLINE_CAPABLE) {
+                madt_info.hotplug_count++; // Absent until hot-added, so INIT/SIPI would time out
+            }
+        } else if (header->type == MADT_IO_APIC && !madt_info.ioapic_address) {
+            madt_info.ioapic_address = *(const uint32_t*)(entry + 4);
+        } else if (header->type == MADT_LAPIC_ADDRESS_OVERRIDE) {
+            madt_info.lapic_address = *(const uint64_t*)(entry + 4);
+        }
+        entry += header->length;
+    }
+    madt_found = 1;
+}
+
+int acpi_init(uint64_t rsdp_address) {
+    const acpi_rsdp_t* rsdp = rsdp_address ? (const acpi_rsdp_t*)(uintptr_t)rsdp_address : rsdp_find();
+    if (!rsdp || checksum(rsdp, 20) != 0) {
+        return -1;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address && checksum(rsdp, rsdp->length) == 0) {
+        root_table = (const acpi_sdt_header_t*)(uintptr_t)rsdp->xsdt_address;
+        root_is_xsdt = 1;
+    } else {
+        root_table = (const acpi_sdt_header_t*)(uintptr_t)rsdp->rsdt_address;
+        root_is_xsdt = 0;
+    }
+
+    const acpi_madt_t* madt = (const acpi_madt_t*)acpi_find_table("APIC");
+    if (madt) {
+        madt_parse(madt);
+    }
+    return 0;
+}
+
+const acpi_sdt_header_t* acpi_find_table(const char* signature) {
+    if (!root_table) {
+        return 0;
+    }
+
+    uint32_t entry_size = root_is_xsdt ? 8 : 4;
+    uint32_t count = (root_table->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    const uint8_t* entries = (const uint8_t*)(root_table + 1);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t address = root_is_xsdt ? *(const uint64_t*)(entries + i * 8) : *(const uint32_t*)(entries + i * 4);
+        const acpi_sdt_header_t* table = (const acpi_sdt_header_t*)(uintptr_t)address;
+        if (table && memcmp(table->signature, signature, 4) == 0 && checksum(table, table->length) == 0) {
+            return table;
+        }
+    }
+    return 0;
+}
+
+const acpi_madt_info_t* acpi_madt(void) {
+    return madt_found ? &madt_info : 0;
+}
@@ -1,10 +1,26 @@
 global start
+global gdt64_pointer
+global boot_stack_guard
+global stack_top
 extern long_mode_start
+extern _kernel_end
 
-section .text
+; The kernel is linked at KERNEL_VMA + its load address (see linker.ld) but
+; GRUB enters here with paging off, so everything in this file runs from
+; .boot.text at its physical address and reaches the rest of the image
+; through PHYS()
+KERNEL_VMA equ 0xFFFFFFFF80000000
+%define PHYS(label) (label - KERNEL_VMA)
+
+section .boot.text progbits alloc exec nowrite align=16
 bits 32
 start:
-	mov esp, stack_top
+	mov esp, PHYS(stack_top)
+
+	; keep the Multiboot2 magic and info pointer for boot_info_parse;
+	; nothing below touches esi or edi
+	mov edi, eax
+	mov esi, ebx
 
 	call check_multiboot
 	call check_cpuid
@@ -13,8 +29,8 @@ start:
 	call setup_page_tables
 	call enable_paging
 
-	lgdt [gdt64.pointer]
-	jmp gdt64.code_segment:long_mode_start
+	lgdt [PHYS(gdt64_boot_pointer)]
+	jmp gdt64.code_segment:long_mode_low
 
 	hlt
 
@@ -61,13 +77,21 @@ check_long_mode:
 	jmp error
 
 setup_page_tables:
-	mov eax, page_table_l3
+	mov eax, PHYS(page_table_l3)
 	or eax, 0b11 ; present, writable
-	mov [page_table_l4], eax
+	mov [PHYS(page_table_l4)], eax
 	
-	mov eax, page_table_l2
+	; four l2 tables identity map the first 4GiB, which takes in the
+	; local APIC and the linear framebuffer as well as RAM
+	mov eax, PHYS(page_table_l2)
 	or eax, 0b11 ; present, writable
-	mov [page_table_l3], eax
+	mov ecx, 0
+.l3_loop:
+	mov [PHYS(page_table_l3) + ecx * 8], eax
+	add eax, 4096
+	inc ecx
+	cmp ecx, 4
+	jne .l3_loop
 
 	mov ecx, 0 ; counter
 .loop:
@@ -75,17 +99,43 @@ setup_page_tables:
 	mov eax, 0x200000 ; 2MiB
 	mul ecx
 	or eax, 0b10000011 ; present, writable, huge page
-	mov [page_table_l2 + ecx * 8], eax
+	cmp ecx, 512 * 3
+	jb .cached
+	or eax, 0b11000 ; cache disable, write-through: the top GiB is device memory
+.cached:
+	mov [PHYS(page_table_l2) + ecx * 8], eax
 
 	inc ecx ; increment counter
-	cmp ecx, 512 ; checks if the whole table is mapped
+	cmp ecx, 512 * 4 ; checks if all four tables are mapped
 	jne .loop ; if not, continue
 
+	; the kernel image again at KERNEL_VMA: PML4 entry 511, PDPT entry
+	; 510, then 2MiB pages from physical 0 up to the end of the image.
+	; The higher-half tables are separate so vmm_init can tighten the
+	; image's permissions without touching the identity map
+	mov eax, PHYS(page_table_l3_high)
+	or eax, 0b11 ; present, writable
+	mov [PHYS(page_table_l4) + 511 * 8], eax
+	mov eax, PHYS(page_table_l2_high)
+	or eax, 0b11 ; present, writable
+	mov [PHYS(page_table_l3_high) + 510 * 8], eax
+
+	mov edx, 0 ; physical address
+	mov ecx, 0
+.high_loop:
+	mov eax, edx
+	or eax, 0b10000011 ; present, writable, huge page
+	mov [PHYS(page_table_l2_high) + ecx * 8], eax
+	add edx, 0x200000
+	inc ecx
+	cmp edx, _kernel_end ; a physical address, unlike the other symbols
+	jb .high_loop
+
 	ret
 
 enable_paging:
 	; pass page table location to cpu
-	mov eax, page_table_l4
+	mov eax, PHYS(page_table_l4)
 	mov cr3, eax
 
 	; enable PAE
@@ -114,13 +164,26 @@ error:
 	mov byte  [0xb800a], al
 	hlt
 
-section .bss
-align 4096
+bits 64
+long_mode_low:
+	; still on the identity map; jump to the higher-half link address
+	mov rax, long_mode_start
+	jmp rax
+
+; Outside the .bss range that long_mode_start clears, since the page tables
+; and the stack are already in use by then
+section .boot.bss nobits alloc write align=4096
 page_table_l4:
 	resb 4096
 page_table_l3:
 	resb 4096
 page_table_l2:
+	resb 4096 * 4
+page_table_l3_high:
+	resb 4096
+page_table_l2_high:
+	resb 4096
+boot_stack_guard: ; unmapped by vmm_init once the kernel runs
 	resb 4096
 stack_bottom:
 	resb 4096 * 4
@@ -131,6 +194,9 @@ gdt64:
 	dq 0 ; zero entry
 .code_segment: equ $ - gdt64
 	dq (1 << 43) | (1 << 44) | (1 << 47) | (1 << 53) ; code segment
-.pointer:
+gdt64_pointer: ; also loaded by application processors
 	dw $ - gdt64 - 1 ; length
 	dq gdt64 ; address
+gdt64_boot_pointer: ; the same GDT, for lgdt in 32-bit mode before paging
+	dw gdt64_pointer - gdt64 - 1
+	dd PHYS(gdt64)
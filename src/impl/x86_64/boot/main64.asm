@@ -1,9 +1,20 @@
 global long_mode_start
 extern kernel_main
+extern boot_info_parse
+extern fpu_init
+extern gdt64_pointer
+extern stack_top
+extern _bss_start
+extern _bss_end
 
 section .text
 bits 64
 long_mode_start:
+	; move the stack and the GDT to their higher-half addresses
+	mov rsp, stack_top
+	mov rax, gdt64_pointer
+	lgdt [rax]
+
     ; load null into all data segment registers
     mov ax, 0
     mov ss, ax
@@ -12,5 +23,25 @@ long_mode_start:
     mov fs, ax
     mov gs, ax
 
+	; upper halves are undefined after the mode switch
+	mov r12d, edi ; magic
+	mov r13d, esi ; Multiboot2 info address
+
+	; the loader need not have zeroed .bss; the linker script keeps both
+	; ends 8-byte aligned
+	mov rdi, _bss_start
+	mov rcx, _bss_end
+	sub rcx, rdi
+	shr rcx, 3
+	xor eax, eax
+	rep stosq
+
+	; SSE must be on before C code that may use vector registers
+	call fpu_init
+
+	mov edi, r12d
+	mov esi, r13d
+	call boot_info_parse
+
 	call kernel_main
     hlt
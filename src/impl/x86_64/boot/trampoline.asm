@@ -0,0 +1,104 @@
+global trampoline_start
+global trampoline_end
+global trampoline_cr3
+global trampoline_efer
+global trampoline_stack
+global trampoline_entry
+global trampoline_cpu
+extern gdt64_pointer
+
+; Application processor entry. smp.c copies this blob to TRAMPOLINE_BASE
+; below 1MB, fills in the data block at the end and points a startup IPI
+; at it. The AP arrives in real mode and climbs to long mode on the same
+; page tables as the BSP before jumping into the kernel proper.
+TRAMPOLINE_BASE equ 0x8000
+%define TRAMP(label) (label - trampoline_start + TRAMPOLINE_BASE)
+
+section .text
+bits 16
+trampoline_start:
+	cli
+	cld
+	xor ax, ax
+	mov ds, ax
+	lgdt [TRAMP(trampoline_gdt.pointer)]
+
+	mov eax, cr0
+	or eax, 1 ; protected mode
+	mov cr0, eax
+	jmp dword trampoline_gdt.code32:TRAMP(trampoline_protected)
+
+bits 32
+trampoline_protected:
+	mov ax, trampoline_gdt.data
+	mov ds, ax
+	mov es, ax
+	mov ss, ax
+
+	; enable PAE
+	mov eax, cr4
+	or eax, 1 << 5
+	mov cr4, eax
+
+	mov eax, [TRAMP(trampoline_cr3)]
+	mov cr3, eax
+
+	; same EFER as the BSP, which includes long mode enable
+	mov ecx, 0xC0000080
+	mov eax, [TRAMP(trampoline_efer)]
+	xor edx, edx
+	wrmsr
+
+	; enable paging
+	mov eax, cr0
+	or eax, 1 << 31
+	mov cr0, eax
+
+	jmp trampoline_gdt.code64:TRAMP(trampoline_long)
+
+bits 64
+trampoline_long:
+	mov rsp, [TRAMP(trampoline_stack)]
+	mov rdi, [TRAMP(trampoline_cpu)]
+
+	; switch to the kernel GDT and reload every segment from it; the
+	; pointer is in the higher half, out of reach of a 32-bit displacement
+	mov rax, gdt64_pointer
+	lgdt [rax]
+	xor eax, eax
+	mov ss, ax
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+
+	push 0 ; return address slot, so the entry sees a normal call frame
+	push 0x08 ; kernel code segment
+	push qword [TRAMP(trampoline_entry)]
+	o64 retf
+
+align 8
+trampoline_gdt:
+	dq 0
+.code32: equ $ - trampoline_gdt
+	dq 0x00CF9A000000FFFF ; 32-bit code, flat 4GiB
+.data: equ $ - trampoline_gdt
+	dq 0x00CF92000000FFFF ; data, flat 4GiB
+.code64: equ $ - trampoline_gdt
+	dq (1 << 43) | (1 << 44) | (1 << 47) | (1 << 53) ; 64-bit code
+.pointer:
+	dw $ - trampoline_gdt - 1
+	dd TRAMP(trampoline_gdt)
+
+align 8
+trampoline_cr3:
+	dq 0
+trampoline_efer:
+	dq 0
+trampoline_stack:
+	dq 0
+trampoline_entry:
+	dq 0
+trampoline_cpu:
+	dq 0
+trampoline_end:
@@ -0,0 +1,179 @@
+#include "boot_info.h"
+#include "string.h"
+
+#define TAG_END 0
+#define TAG_CMDLINE 1
+#define TAG_MODULE 3
+#define TAG_BASIC_MEMINFO 4
+#define TAG_MMAP 6
+#define TAG_FRAMEBUFFER 8
+#define TAG_ACPI_OLD 14
+#define TAG_ACPI_NEW 15
+
+#define RSDP_V1_LENGTH 20
+
+typedef struct __attribute__((packed)) {
+    uint32_t total_size;
+    uint32_t reserved;
+} mb2_info_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t type;
+    uint32_t size;
+} mb2_tag_t;
+
+typedef struct __attribute__((packed)) {
+    mb2_tag_t tag;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char string[];
+} mb2_module_t;
+
+typedef struct __attribute__((packed)) {
+    mb2_tag_t tag;
+    uint32_t mem_lower; // KiB below 1 MiB
+    uint32_t mem_upper; // KiB above 1 MiB
+} mb2_basic_meminfo_t;
+
+typedef struct __attribute__((packed)) {
+    mb2_tag_t tag;
+    uint32_t entry_size;
+    uint32_t entry_version;
+} mb2_mmap_t;
+
+typedef struct __attribute__((packed)) {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+} mb2_mmap_entry_t;
+
+typedef struct __attribute__((packed)) {
+    mb2_tag_t tag;
+    uint64_t address;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t type;
+    uint16_t reserved;
+} mb2_framebuffer_t;
+
+static boot_info_t info;
+
+static void copy_string(char* dest, const char* src, uint32_t max, uint32_t size) {
+    uint32_t i = 0;
+    while (i + 1 < max && i < size && src[i]) {
+        dest[i] = src[i];
+        i++;
+    }
+    dest[i] = '\0';
+}
+
+static void add_mmap_entry(uint64_t base, uint64_t length, uint32_t type) {
+    if (info.mmap_count >= BOOT_INFO_MAX_MMAP || length == 0) {
+        return;
+    }
+    info.mmap[info.mmap_count].base = base;
+    info.mmap[info.mmap_count].length = length;
+    info.mmap[info.mmap_count].type = type;
+    info.mmap_count++;
+    if (type == BOOT_MMAP_AVAILABLE) {
+        info.usable_memory += length;
+    }
+}
+
+static void parse_mmap(const mb2_mmap_t* tag) {
+    const uint8_t* entry = (const uint8_t*)(tag + 1);
+    const uint8_t* end = (const uint8_t*)tag + tag->tag.size;
+
+    for (; entry + sizeof(mb2_mmap_entry_t) <= end; entry += tag->entry_size) {
+        const mb2_mmap_entry_t* e = (const mb2_mmap_entry_t*)entry;
+        add_mmap_entry(e->base, e->length, e->type);
+    }
+}
+
+static void parse_rsdp(const mb2_tag_t* tag, uint32_t max) {
+    uint32_t length = tag->size - sizeof(mb2_tag_t);
+    if (length > max) {
+        length = max;
+    }
+    if (length < RSDP_V1_LENGTH) {
+        return;
+    }
+    memcpy(info.rsdp, tag + 1, length);
+    info.rsdp_length = length;
+}
+
+int boot_info_parse(uint32_t magic, uint64_t address) {
+    memset(&info, 0, sizeof(info));
+    if (magic != MULTIBOOT2_BOOTLOADER_MAGIC || address == 0 || (address & 7)) {
+        return -1;
+    }
+
+    const mb2_info_t* header = (const mb2_info_t*)(uintptr_t)address;
+    info.info_start = address;
+    info.info_end = address + header->total_size;
+
+    const mb2_basic_meminfo_t* meminfo = 0;
+    const uint8_t* end = (const uint8_t*)header + header->total_size;
+    const mb2_tag_t* tag = (const mb2_tag_t*)(header + 1);
+
+    while ((const uint8_t*)tag + sizeof(mb2_tag_t) <= end && tag->type != TAG_END && tag->size >= sizeof(mb2_tag_t)) {
+        switch (tag->type) {
+            case TAG_CMDLINE:
+                copy_string(info.cmdline, (const char*)(tag + 1), BOOT_INFO_CMDLINE_LENGTH,
+                            tag->size - sizeof(mb2_tag_t));
+                break;
+            case TAG_MODULE:
+                if (info.module_count < BOOT_INFO_MAX_MODULES) {
+                    const mb2_module_t* module = (const mb2_module_t*)tag;
+                    boot_module_t* out = &info.modules[info.module_count++];
+                    out->start = module->mod_start;
+                    out->end = module->mod_end;
+                    copy_string(out->name, module->string, BOOT_INFO_MODULE_NAME_LENGTH,
+                                tag->size - sizeof(mb2_module_t));
+                }
+                break;
+            case TAG_BASIC_MEMINFO:
+                meminfo = (const mb2_basic_meminfo_t*)tag;
+                break;
+            case TAG_MMAP:
+                parse_mmap((const mb2_mmap_t*)tag);
+                break;
+            case TAG_FRAMEBUFFER: {
+                const mb2_framebuffer_t* fb = (const mb2_framebuffer_t*)tag;
+                info.framebuffer.address = fb->address;
+                info.framebuffer.pitch = fb->pitch;
+                info.framebuffer.width = fb->width;
+                info.framebuffer.height = fb->height;
+                info.framebuffer.bpp = fb->bpp;
+                info.framebuffer.type = fb->type;
+                info.has_framebuffer = 1;
+                break;
+            }
+            case TAG_ACPI_OLD:
+                // Keep a v2 RSDP if the loader passed both
+                if (info.rsdp_length == 0) {
+                    parse_rsdp(tag, RSDP_V1_LENGTH);
+                }
+                break;
+            case TAG_ACPI_NEW:
+                parse_rsdp(tag, sizeof(info.rsdp));
+                break;
+        }
+        // Tags are padded to 8 bytes
+        tag = (const mb2_tag_t*)((const uint8_t*)tag + ((tag->size + 7) & ~7u));
+    }
+
+    // Old loaders may only give the lower/upper split
+    if (info.mmap_count == 0 && meminfo) {
+        add_mmap_entry(0, (uint64_t)meminfo->mem_lower * 1024, BOOT_MMAP_AVAILABLE);
+        add_mmap_entry(0x100000, (uint64_t)meminfo->mem_upper * 1024, BOOT_MMAP_AVAILABLE);
+    }
+    return 0;
+}
+
+const boot_info_t* boot_info(void) {
+    return &info;
+}
@@ -0,0 +1,299 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "smp.h"
+#include "thread.h"
+#include "interrupts.h"
+#include "string.h"
+#include "../memory/memory.h"
+
+// Lazy FPU switching. CR0.TS makes the next FPU or vector instruction
+// raise #NM, and that is where a thread's registers get loaded. The
+// outgoing thread's registers are saved only if it used them since it
+// was switched in (TS still clear). They stay in the registers afterwards,
+// so a thread that gets the CPU back before anyone else touched the FPU
+// just has TS cleared again.
+//
+// Interrupt handlers run with TS set. One that uses the FPU parks the
+// interrupted code's registers in a per-CPU area and gets a clean state.
+// Nested handlers share that state.
+
+#define CR0_MP (1ULL << 1)
+#define CR0_EM (1ULL << 2)
+#define CR0_TS (1ULL << 3)
+#define CR0_NE (1ULL << 5)
+#define CR4_OSFXSR (1ULL << 9)
+#define CR4_OSXMMEXCPT (1ULL << 10)
+#define CR4_OSXSAVE (1ULL << 18)
+
+#define CPUID_1_ECX_XSAVE (1 << 26)
+#define CPUID_1_ECX_AVX (1 << 28)
+#define CPUID_7_EBX_AVX2 (1 << 5)
+#define CPUID_D_1_EAX_XSAVEOPT (1 << 0)
+
+#define XCR0_X87 0x1
+#define XCR0_SSE 0x2
+#define XCR0_AVX 0x4
+
+#define MXCSR_DEFAULT 0x1F80 // All exceptions masked, round to nearest
+#define FXSAVE_SIZE 512
+// Legacy area, XSAVE header and the upper halves of the YMM registers
+#define FPU_STATE_MAX 1024
+
+typedef struct {
+    thread_t* owner; // Thread whose state the registers hold
+    uint32_t depth; // Interrupt nesting
+    uint8_t ts; // CR0.TS as last written
+    uint8_t live_on_entry; // The interrupted code was using the FPU
+    uint8_t parked; // ... and its registers are in scratch
+    uint8_t scratch[FPU_STATE_MAX] __attribute__((aligned(64)));
+} fpu_cpu_t;
+
+static fpu_cpu_t cpu_fpu[SMP_MAX_CPUS];
+static uint8_t initial_state[FPU_STATE_MAX] __attribute__((aligned(64)));
+static int detected = 0;
+static uint32_t features = 0;
+static uint32_t state_size = FXSAVE_SIZE;
+static uint64_t xcr0 = 0;
+static kmem_cache_t* state_cache = 0;
+static fpu_stats_t stats;
+
+static inline void set_ts(void) {
+    uint64_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+}
+
+static inline void clear_ts(void) {
+    __asm__ volatile("clts" ::: "memory");
+}
+
+static inline void xsetbv(uint32_t index, uint64_t value) {
+    __asm__ volatile("xsetbv" : : "c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// XSAVEOPT skips components that are unchanged since they were restored
+// from the same area, which is the common case on a switch
+static void state_save(void* area) {
+    if (features & FPU_XSAVEOPT) {
+        __asm__ volatile("xsaveopt64 (%0)" : : "r"(area), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else if (features & FPU_XSAVE) {
+        __asm__ volatile("xsave64 (%0)" : : "r"(area), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        __asm__ volatile("fxsave64 (%0)" : : "r"(area) : "memory");
+    }
+}
+
+static void state_restore(const void* area) {
+    if (features & FPU_XSAVE) {
+        __asm__ volatile("xrstor64 (%0)" : : "r"(area), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        __asm__ volatile("fxrstor64 (%0)" : : "r"(area) : "memory");
+    }
+}
+
+static fpu_cpu_t* this_fpu(void) {
+    return &cpu_fpu[this_cpu()->index];
+}
+
+static void device_not_available(interrupt_frame_t* frame) {
+    (void)frame;
+    fpu_cpu_t* cpu = this_fpu();
+    clear_ts();
+    cpu->ts = 0;
+
+    if (cpu->depth) {
+        if (cpu->live_on_entry && !cpu->parked) {
+            state_save(cpu->scratch);
+            cpu->parked = 1;
+            stats.interrupt_saves++;
+        } else if (!cpu->live_on_entry) {
+            cpu->owner = 0; // Its saved copy is current, the registers are about to change
+        }
+        state_restore(initial_state);
+        return;
+    }
+
+    thread_t* thread = this_cpu()->thread;
+    if (thread && cpu->owner != thread) {
+        state_restore(thread->fpu_state);
+        cpu->owner = thread;
+        stats.restores++;
+    }
+}
+
+// Sizes come from CPUID leaf 0xD for the features enabled in XCR0
+static void detect(void) {
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    features = FPU_SSE; // Part of x86-64
+    if (c & CPUID_1_ECX_XSAVE) {
+        features |= FPU_XSAVE;
+        xcr0 = XCR0_X87 | XCR0_SSE;
+        if (c & CPUID_1_ECX_AVX) {
+            features |= FPU_AVX;
+            xcr0 |= XCR0_AVX;
+            cpuid(0, &a, &b, &c, &d);
+            if (a >= 7) {
+                cpuid_count(7, 0, &a, &b, &c, &d);
+                if (b & CPUID_7_EBX_AVX2) {
+                    features |= FPU_AVX2;
+                }
+            }
+        }
+    }
+}
+
+void fpu_init(void) {
+    if (!detected) {
+        detect();
+    }
+
+    uint64_t cr0, cr4;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 | CR0_MP | CR0_NE) & ~(CR0_EM | CR0_TS);
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (features & FPU_XSAVE) {
+        cr4 |= CR4_OSXSAVE;
+    }
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+    if (features & FPU_XSAVE) {
+        xsetbv(0, xcr0);
+    }
+
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ volatile("fninit; ldmxcsr %0" : : "m"(mxcsr));
+
+    if (detected) {
+        return;
+    }
+    if (features & FPU_XSAVE) {
+        uint32_t a, b, c, d;
+        cpuid_count(0xD, 0, &a, &b, &c, &d);
+        state_size = b;
+        cpuid_count(0xD, 1, &a, &b, &c, &d);
+        if (a & CPUID_D_1_EAX_XSAVEOPT) {
+            features |= FPU_XSAVEOPT;
+        }
+    }
+
+    // Every thread starts from this; XRSTOR needs the header zeroed
+    memset(initial_state, 0, sizeof(initial_state));
+    if (features & FPU_XSAVE) {
+        __asm__ volatile("xsave64 (%0)" : : "r"(initial_state), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        __asm__ volatile("fxsave64 (%0)" : : "r"(initial_state) : "memory");
+    }
+
+    stats.features = features;
+    stats.state_size = state_size;
+    stats.xcr0 = xcr0;
+    interrupt_register_handler(FPU_NM_VECTOR, device_not_available);
+    detected = 1;
+}
+
+uint32_t fpu_features(void) {
+    return features;
+}
+
+int fpu_thread_init(thread_t* thread) {
+    if (!state_cache) {
+        state_cache = kmem_cache_create("fpu", state_size, 64, 0);
+        if (!state_cache) {
+            return -1;
+        }
+    }
+    thread->fpu_state = kmem_cache_alloc(state_cache);
+    if (!thread->fpu_state) {
+        return -1;
+    }
+    memcpy(thread->fpu_state, initial_state, state_size);
+    return 0;
+}
+
+int fpu_thread_adopt(thread_t* thread) {
+    if (fpu_thread_init(thread) < 0) {
+        return -1;
+    }
+    this_fpu()->owner = thread;
+    return 0;
+}
+
+void fpu_thread_free(thread_t* thread) {
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        if (cpu_fpu[i].owner == thread) {
+            cpu_fpu[i].owner = 0;
+        }
+    }
+    if (thread->fpu_state) {
+        kmem_cache_free(state_cache, thread->fpu_state);
+        thread->fpu_state = 0;
+    }
+}
+
+// Interrupts are off; the FPU registers belong to prev if TS is clear
+void fpu_switch(thread_t* prev, thread_t* next) {
+    fpu_cpu_t* cpu = this_fpu();
+    if (!cpu->ts) {
+        if (prev->state == THREAD_DEAD) {
+            cpu->owner = 0;
+        } else {
+            state_save(prev->fpu_state);
+            stats.saves++;
+        }
+    }
+
+    if (cpu->owner == next) {
+        if (cpu->ts) {
+            clear_ts();
+            cpu->ts = 0;
+        }
+    } else if (!cpu->ts) {
+        set_ts();
+        cpu->ts = 1;
+    }
+}
+
+void fpu_interrupt_enter(void) {
+    fpu_cpu_t* cpu = this_fpu();
+    if (cpu->depth++) {
+        return;
+    }
+    cpu->live_on_entry = !cpu->ts;
+    if (!cpu->ts) {
+        set_ts();
+        cpu->ts = 1;
+    }
+}
+
+void fpu_interrupt_exit(void) {
+    fpu_cpu_t* cpu = this_fpu();
+    if (--cpu->depth) {
+        return;
+    }
+    if (cpu->live_on_entry) {
+        if (cpu->ts) {
+            clear_ts();
+            cpu->ts = 0;
+        }
+        if (cpu->parked) {
+            state_restore(cpu->scratch);
+            cpu->parked = 0;
+        }
+    } else if (!cpu->ts) {
+        // A handler used the FPU; what is left in it belongs to nobody
+        set_ts();
+        cpu->ts = 1;
+    }
+}
+
+int fpu_in_interrupt(void) {
+    return this_fpu()->depth != 0;
+}
+
+void fpu_get_stats(fpu_stats_t* out) {
+    uint64_t flags = irq_save();
+    *out = stats;
+    irq_restore(flags);
+}
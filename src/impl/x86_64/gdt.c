@@ -0,0 +1,62 @@
+#include "gdt.h"
+#include "smp.h"
+#include "interrupts.h"
+#include "string.h"
+#include "../memory/memory.h"
+
+#define GDT_CODE_64 ((1ULL << 43) | (1ULL << 44) | (1ULL << 47) | (1ULL << 53))
+#define GDT_TSS_BASE 0x10 // One 16-byte TSS descriptor per CPU from here
+#define TSS_TYPE_AVAILABLE 0x89 // present, 64-bit TSS
+
+typedef struct __attribute__((packed)) {
+    uint32_t reserved0;
+    uint64_t rsp[3]; // Unused until there is a ring 3
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} tss_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit;
+    uint64_t base;
+} gdt_pointer_t;
+
+static uint64_t gdt[2 + 2 * SMP_MAX_CPUS] __attribute__((aligned(16))) = { 0, GDT_CODE_64 };
+static tss_t tss[SMP_MAX_CPUS];
+
+static void tss_descriptor(uint32_t cpu_index) {
+    uint64_t base = (uintptr_t)&tss[cpu_index];
+    uint64_t limit = sizeof(tss_t) - 1;
+    uint64_t* entry = &gdt[GDT_TSS_BASE / 8 + 2 * cpu_index];
+    entry[0] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) | ((uint64_t)TSS_TYPE_AVAILABLE << 40) |
+               (((limit >> 16) & 0xF) << 48) | (((base >> 24) & 0xFF) << 56);
+    entry[1] = base >> 32;
+}
+
+int gdt_init(uint32_t cpu_index) {
+    if (cpu_index >= SMP_MAX_CPUS) {
+        return -1;
+    }
+    uint8_t* stack = kmalloc(GDT_IST_STACK_SIZE);
+    if (!stack) {
+        return -1;
+    }
+
+    memset(&tss[cpu_index], 0, sizeof(tss_t));
+    tss[cpu_index].ist[GDT_IST_DOUBLE_FAULT - 1] = ((uintptr_t)stack + GDT_IST_STACK_SIZE) & ~0xFULL;
+    tss[cpu_index].iomap_base = sizeof(tss_t);
+    tss_descriptor(cpu_index);
+
+    gdt_pointer_t pointer = {
+        .limit = sizeof(gdt) - 1,
+        .base = (uintptr_t)gdt
+    };
+    uint16_t selector = GDT_TSS_BASE + 16 * cpu_index;
+    __asm__ volatile("lgdt %0; ltr %1" : : "m"(pointer), "r"(selector) : "memory");
+
+    // The IDT is shared, so this only has to happen once a TSS is loaded
+    interrupt_set_ist(8, GDT_IST_DOUBLE_FAULT);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "interrupts.h"
+#include "pic.h"
+#include "print.h"
+#include "serial.h"
+#include "thread.h"
+#include "fpu.h"
+
+#define KERNEL_CODE_SELECTOR 0x08
+#define IDT_INTERRUPT_GATE 0x8E // present, ring 0, 64-bit interrupt gate
+
+typedef struct __attribute__((packed)) {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t reserved;
+} idt_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit;
+    uint64_t base;
+} idt_pointer_t;
+
+extern uint64_t isr_stub_table[IDT_ENTRIES];
+
+static idt_entry_t idt[IDT_ENTRIES] __attribute__((aligned(16)));
+static interrupt_handler_t handlers[IDT_ENTRIES];
+static int interrupts_initialized = 0;
+
+static const char* exception_names[32] = {
+    "Divide Error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound Range",
+    "Invalid Opcode", "Device Not Available", "Double Fault", "Coprocessor Overrun",
+    "Invalid TSS", "Segment Not Present", "Stack Fault", "General Protection",
+    "Page Fault", "Reserved", "x87 FPU Error", "Alignment Check", "Machine Check",
+    "SIMD Exception", "Virtualization", "Control Protection", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Hypervisor Injection",
+    "VMM Communication", "Security", "Reserved"
+};
+
+static void idt_set_gate(uint8_t vector, uint64_t handler) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SELECTOR;
+    idt[vector].ist = 0;
+    idt[vector].type_attr = IDT_INTERRUPT_GATE;
+    idt[vector].offset_mid = (handler >> 16) & 0xFFFF;
+    idt[vector].offset_high = (handler >> 32) & 0xFFFFFFFF;
+    idt[vector].reserved = 0;
+}
+
+static void print_hex64(uint64_t value) {
+    const char* digits = "0123456789ABCDEF";
+    char buffer[19];
+    buffer[0] = '0';
+    buffer[1] = 'x';
+    for (int i = 0; i < 16; i++) {
+        buffer[2 + i] = digits[(value >> ((15 - i) * 4)) & 0xF];
+    }
+    buffer[18] = '\0';
+    print_str(buffer);
+}
+
+void interrupt_panic(interrupt_frame_t* frame, const char* message) {
+    print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_RED);
+    print_set_cursor(0, 24);
+    print_str("KERNEL PANIC: ");
+    print_str(message ? message : exception_names[frame->vector & 31]);
+    print_str(" err=");
+    print_hex64(frame->error_code);
+    print_str(" rip=");
+    print_hex64(frame->rip);
+    if (frame->vector == 8 || frame->vector == 14) {
+        uint64_t cr2;
+        __asm__ volatile("mov %%cr2, %0" : "=r"(cr2));
+        print_str(" cr2=");
+        print_hex64(cr2);
+    }
+    // Make room first so the panic line reaches the serial terminal too
+    serial_drain();
+    print_flush();
+    serial_drain();
+
+    while (1) {
+        __asm__ volatile("cli; hlt");
+    }
+}
+
+// Returns the frame to resume, which belongs to another thread after a switch
+interrupt_frame_t* interrupt_dispatch(interrupt_frame_t* frame) {
+    uint8_t vector = (uint8_t)frame->vector;
+
+    // #NM is how handlers get the FPU, so it is the one left unbracketed
+    if (vector == FPU_NM_VECTOR && handlers[vector]) {
+        handlers[vector](frame);
+        return thread_interrupt_exit(frame);
+    }
+
+    fpu_interrupt_enter();
+    if (vector >= IRQ_BASE_VECTOR && vector < IRQ_BASE_VECTOR + 16) {
+        uint8_t irq = vector - IRQ_BASE_VECTOR;
+        if (pic_is_spurious(irq)) {
+            fpu_interrupt_exit();
+            return frame;
+        }
+        if (handlers[vector]) {
+            handlers[vector](frame);
+        }
+        pic_send_eoi(irq);
+    } else if (handlers[vector]) {
+        handlers[vector](frame);
+    } else if (vector < 32) {
+        interrupt_panic(frame, 0);
+    }
+    fpu_interrupt_exit();
+    return thread_interrupt_exit(frame);
+}
+
+void interrupt_register_handler(uint8_t vector, interrupt_handler_t handler) {
+    handlers[vector] = handler;
+}
+
+void interrupt_set_ist(uint8_t vector, uint8_t ist) {
+    idt[vector].ist = ist;
+}
+
+void irq_register_handler(uint8_t irq, interrupt_handler_t handler) {
+    handlers[IRQ_BASE_VECTOR + irq] = handler;
+    pic_unmask_irq(irq);
+}
+
+static void idt_load(void) {
+    idt_pointer_t idtr = {
+        .limit = sizeof(idt) - 1,
+        .base = (uint64_t)(uintptr_t)idt
+    };
+    __asm__ volatile("lidt %0" : : "m"(idtr));
+}
+
+void interrupts_init(void) {
+    if (interrupts_initialized) {
+        return;
+    }
+
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        idt_set_gate(i, isr_stub_table[i]);
+    }
+
+    pic_remap(IRQ_BASE_VECTOR, IRQ_BASE_VECTOR + 8);
+    idt_load();
+
+    interrupts_initialized = 1;
+    interrupts_enable();
+}
+
+void interrupts_init_ap(void) {
+    idt_load();
+}
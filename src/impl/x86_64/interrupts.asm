@@ -0,0 +1,69 @@
+global isr_stub_table
+extern interrupt_dispatch
+
+section .text
+bits 64
+
+; One stub per vector. Vectors where the CPU does not push an error code
+; get a dummy one so every frame has the same layout (interrupt_frame_t).
+%assign i 0
+%rep 256
+isr_stub_%+i:
+%if i == 8 || i == 10 || i == 11 || i == 12 || i == 13 || i == 14 || i == 17 || i == 21 || i == 29 || i == 30
+	push qword i
+%else
+	push qword 0
+	push qword i
+%endif
+	jmp isr_common
+%assign i i+1
+%endrep
+
+isr_common:
+	push rax
+	push rbx
+	push rcx
+	push rdx
+	push rsi
+	push rdi
+	push rbp
+	push r8
+	push r9
+	push r10
+	push r11
+	push r12
+	push r13
+	push r14
+	push r15
+
+	mov rdi, rsp
+	cld
+	call interrupt_dispatch
+	mov rsp, rax ; resume whichever thread's frame the scheduler picked
+
+	pop r15
+	pop r14
+	pop r13
+	pop r12
+	pop r11
+	pop r10
+	pop r9
+	pop r8
+	pop rbp
+	pop rdi
+	pop rsi
+	pop rdx
+	pop rcx
+	pop rbx
+	pop rax
+
+	add rsp, 16 ; vector and error code
+	iretq
+
+section .rodata
+isr_stub_table:
+%assign i 0
+%rep 256
+	dq isr_stub_%+i
+%assign i i+1
+%endrep
@@ -0,0 +1,162 @@
+#include "lapic.h"
+#include "cpu.h"
+#include "ktime.h"
+#include "interrupts.h"
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define IA32_APIC_BASE_ENABLE (1 << 11)
+#define IA32_TSC_DEADLINE_MSR 0x6E0
+
+#define CPUID_1_EDX_APIC (1 << 9)
+#define CPUID_1_ECX_TSC_DEADLINE (1 << 24)
+
+#define LAPIC_REG_ID 0x020
+#define LAPIC_REG_TPR 0x080
+#define LAPIC_REG_EOI 0x0B0
+#define LAPIC_REG_SVR 0x0F0
+#define LAPIC_REG_ICR_LOW 0x300
+#define LAPIC_REG_ICR_HIGH 0x310
+#define LAPIC_REG_LVT_TIMER 0x320
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE 0x3E0
+
+#define LAPIC_SVR_ENABLE (1 << 8)
+#define LAPIC_ICR_INIT (5 << 8)
+#define LAPIC_ICR_STARTUP (6 << 8)
+#define LAPIC_ICR_ASSERT (1 << 14)
+#define LAPIC_ICR_PENDING (1 << 12)
+#define LAPIC_LVT_MASKED (1 << 16)
+#define LAPIC_TIMER_ONESHOT (0 << 17)
+#define LAPIC_TIMER_TSC_DEADLINE (2 << 17)
+#define LAPIC_TIMER_DIVIDE_16 0x3
+
+#define CALIBRATION_NS (10 * NSEC_PER_MSEC)
+// Longer one-shot requests are cut short; the timer code simply re-arms
+#define ONESHOT_MAX_NS NSEC_PER_SEC
+
+static volatile uint32_t* lapic_base = 0;
+static int use_tsc_deadline = 0;
+static uint64_t lapic_timer_hz = 0;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+// Count LAPIC timer ticks (divide by 16) over a TSC-timed interval
+static void lapic_calibrate(void) {
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+
+    uint64_t end = ktime_now() + CALIBRATION_NS;
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+    while (ktime_now() < end) {
+        __asm__ volatile("pause");
+    }
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CURRENT);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+
+    lapic_timer_hz = (uint64_t)elapsed * (NSEC_PER_SEC / CALIBRATION_NS);
+}
+
+int lapic_init(void) {
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    if (!(d & CPUID_1_EDX_APIC)) {
+        return -1;
+    }
+    use_tsc_deadline = (c & CPUID_1_ECX_TSC_DEADLINE) != 0;
+
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base | IA32_APIC_BASE_ENABLE);
+    lapic_base = (volatile uint32_t*)(uintptr_t)(base & ~0xFFFULL);
+
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    if (use_tsc_deadline) {
+        lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | LAPIC_TIMER_VECTOR);
+        // The LVT write must be visible before the first deadline MSR write
+        __asm__ volatile("mfence" ::: "memory");
+        wrmsr(IA32_TSC_DEADLINE_MSR, 0);
+    } else {
+        lapic_calibrate();
+        lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+    }
+    return 0;
+}
+
+void lapic_init_ap(void) {
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base | IA32_APIC_BASE_ENABLE);
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+static void lapic_write_icr(uint32_t apic_id, uint32_t command) {
+    // An interrupt between the two writes could send its own IPI
+    uint64_t flags = irq_save();
+    lapic_write(LAPIC_REG_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, command);
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+    irq_restore(flags);
+}
+
+void lapic_send_init(uint32_t apic_id) {
+    lapic_write_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+}
+
+// page is the 4 KB page number (< 256) the AP starts executing at in real mode
+void lapic_send_startup(uint32_t apic_id, uint32_t page) {
+    lapic_write_icr(apic_id, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | (page & 0xFF));
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    lapic_write_icr(apic_id, LAPIC_ICR_ASSERT | vector);
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+void lapic_timer_arm(uint64_t deadline_ns) {
+    if (use_tsc_deadline) {
+        wrmsr(IA32_TSC_DEADLINE_MSR, ktime_to_tsc(deadline_ns));
+        return;
+    }
+
+    uint64_t now = ktime_now();
+    uint64_t delta = deadline_ns > now ? deadline_ns - now : 0;
+    if (delta > ONESHOT_MAX_NS) {
+        delta = ONESHOT_MAX_NS;
+    }
+    uint64_t count = delta * lapic_timer_hz / NSEC_PER_SEC;
+    if (count == 0) {
+        count = 1;
+    } else if (count > 0xFFFFFFFF) {
+        count = 0xFFFFFFFF;
+    }
+    lapic_write(LAPIC_REG_TIMER_INITIAL, (uint32_t)count);
+}
+
+void lapic_timer_cancel(void) {
+    if (use_tsc_deadline) {
+        wrmsr(IA32_TSC_DEADLINE_MSR, 0);
+    } else {
+        lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+    }
+}
+
+int lapic_timer_has_deadline(void) {
+    return use_tsc_deadline;
+}
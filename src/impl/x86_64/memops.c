@@ -0,0 +1,572 @@
+#include "memops.h"
+#include "fpu.h"
+#include "cpu.h"
+
+// SSE2, AVX2 and rep-string versions of the memops routines.
+//
+// Copies and clears store to an aligned destination after one unaligned
+// head store, and finish with one unaligned store that ends exactly at
+// dest + n, so no byte loop is needed past the small-size cutoff. Scans
+// (memcmp, memchr) use unaligned loads and finish in the portable
+// version; strlen reads aligned blocks, which cannot cross into an
+// unmapped page.
+//
+// Vector registers in an interrupt handler cost a state save and restore
+// (see fpu.c), so in interrupt context copies and clears use rep movsb
+// and rep stosb, and scans use the portable versions.
+
+#define CPUID_7_EBX_ERMS (1 << 9)
+
+#define ERMS_MIN 2048 // Below this, startup cost makes rep movsb lose to vector loops
+#define NT_DEFAULT (4 * 1024 * 1024) // When CPUID does not describe the caches
+
+static int erms = 0;
+static size_t nt_threshold = NT_DEFAULT;
+
+static int in_interrupt(void) {
+    return fpu_in_interrupt();
+}
+
+static void* copy_rep(void* dest, const void* src, size_t n) {
+    void* d = dest;
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dest;
+}
+
+static void* set_rep(void* s, int c, size_t n) {
+    void* p = s;
+    __asm__ volatile("rep stosb" : "+D"(p), "+c"(n) : "a"(c) : "memory");
+    return s;
+}
+
+// 64 bytes per iteration; d is 16-byte aligned
+static void copy_blocks_sse2(uint8_t* d, const uint8_t* s, size_t blocks, int nt) {
+    if (nt) {
+        __asm__ volatile(
+            "1:\n\t"
+            "movdqu (%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movntdq %%xmm0, (%0)\n\t"
+            "movntdq %%xmm1, 16(%0)\n\t"
+            "movntdq %%xmm2, 32(%0)\n\t"
+            "movntdq %%xmm3, 48(%0)\n\t"
+            "add $64, %1\n\t"
+            "add $64, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b\n\t"
+            "sfence"
+            : "+r"(d), "+r"(s), "+r"(blocks) : : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    } else {
+        __asm__ volatile(
+            "1:\n\t"
+            "movdqu (%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movdqa %%xmm0, (%0)\n\t"
+            "movdqa %%xmm1, 16(%0)\n\t"
+            "movdqa %%xmm2, 32(%0)\n\t"
+            "movdqa %%xmm3, 48(%0)\n\t"
+            "add $64, %1\n\t"
+            "add $64, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(s), "+r"(blocks) : : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    }
+}
+
+// 128 bytes per iteration; d is 32-byte aligned
+static void copy_blocks_avx2(uint8_t* d, const uint8_t* s, size_t blocks, int nt) {
+    if (nt) {
+        __asm__ volatile(
+            "1:\n\t"
+            "vmovdqu (%1), %%ymm0\n\t"
+            "vmovdqu 32(%1), %%ymm1\n\t"
+            "vmovdqu 64(%1), %%ymm2\n\t"
+            "vmovdqu 96(%1), %%ymm3\n\t"
+            "vmovntdq %%ymm0, (%0)\n\t"
+            "vmovntdq %%ymm1, 32(%0)\n\t"
+            "vmovntdq %%ymm2, 64(%0)\n\t"
+            "vmovntdq %%ymm3, 96(%0)\n\t"
+            "add $128, %1\n\t"
+            "add $128, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b\n\t"
+            "sfence"
+            : "+r"(d), "+r"(s), "+r"(blocks) : : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    } else {
+        __asm__ volatile(
+            "1:\n\t"
+            "vmovdqu (%1), %%ymm0\n\t"
+            "vmovdqu 32(%1), %%ymm1\n\t"
+            "vmovdqu 64(%1), %%ymm2\n\t"
+            "vmovdqu 96(%1), %%ymm3\n\t"
+            "vmovdqa %%ymm0, (%0)\n\t"
+            "vmovdqa %%ymm1, 32(%0)\n\t"
+            "vmovdqa %%ymm2, 64(%0)\n\t"
+            "vmovdqa %%ymm3, 96(%0)\n\t"
+            "add $128, %1\n\t"
+            "add $128, %0\n\t"
+            "dec %2\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(s), "+r"(blocks) : : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+    }
+}
+
+// Vectors of `width` bytes (16 or 32), n >= width
+static void* copy_vector(void* dest, const void* src, size_t n, int width) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+    uint8_t* end = d + n;
+    const uint8_t* src_end = s + n;
+    int nt = n >= nt_threshold;
+
+    if (width == 32) {
+        __asm__ volatile("vmovdqu (%1), %%ymm0\n\tvmovdqu %%ymm0, (%0)" : : "r"(d), "r"(s) : "xmm0", "memory");
+    } else {
+        __asm__ volatile("movdqu (%1), %%xmm0\n\tmovdqu %%xmm0, (%0)" : : "r"(d), "r"(s) : "xmm0", "memory");
+    }
+    size_t head = width - ((uintptr_t)d & (width - 1));
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t block = width * 4;
+    if (n >= block) {
+        if (width == 32) {
+            copy_blocks_avx2(d, s, n / block, nt);
+        } else {
+            copy_blocks_sse2(d, s, n / block, nt);
+        }
+        d += n & ~(block - 1);
+        s += n & ~(block - 1);
+        n &= block - 1;
+    }
+
+    // Whole vectors left, then one ending at the last byte
+    while (n > 0) {
+        size_t step = n >= (size_t)width ? (size_t)width : n;
+        uint8_t* to = n >= (size_t)width ? d : end - width;
+        const uint8_t* from = n >= (size_t)width ? s : src_end - width;
+        if (width == 32) {
+            __asm__ volatile("vmovdqu (%1), %%ymm0\n\tvmovdqu %%ymm0, (%0)" : : "r"(to), "r"(from) : "xmm0", "memory");
+        } else {
+            __asm__ volatile("movdqu (%1), %%xmm0\n\tmovdqu %%xmm0, (%0)" : : "r"(to), "r"(from) : "xmm0", "memory");
+        }
+        d += step;
+        s += step;
+        n -= step;
+    }
+    if (width == 32) {
+        __asm__ volatile("vzeroupper");
+    }
+    return dest;
+}
+
+// Broadcast the byte pattern into xmm0/ymm0; each asm statement that
+// stores it does this first, since nothing keeps vector registers alive
+// between statements
+#define BROADCAST_SSE2 "movq %[pattern], %%xmm0\n\tpunpcklqdq %%xmm0, %%xmm0\n\t"
+#define BROADCAST_AVX2 "vmovq %[pattern], %%xmm0\n\tvpbroadcastq %%xmm0, %%ymm0\n\t"
+
+static void set_blocks(uint8_t* d, uint64_t pattern, size_t blocks, int width, int nt) {
+    if (width == 32 && nt) {
+        __asm__ volatile(
+            BROADCAST_AVX2
+            "1:\n\t"
+            "vmovntdq %%ymm0, (%0)\n\t"
+            "vmovntdq %%ymm0, 32(%0)\n\t"
+            "vmovntdq %%ymm0, 64(%0)\n\t"
+            "vmovntdq %%ymm0, 96(%0)\n\t"
+            "add $128, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b\n\t"
+            "sfence"
+            : "+r"(d), "+r"(blocks) : [pattern] "r"(pattern) : "xmm0", "memory", "cc");
+    } else if (width == 32) {
+        __asm__ volatile(
+            BROADCAST_AVX2
+            "1:\n\t"
+            "vmovdqa %%ymm0, (%0)\n\t"
+            "vmovdqa %%ymm0, 32(%0)\n\t"
+            "vmovdqa %%ymm0, 64(%0)\n\t"
+            "vmovdqa %%ymm0, 96(%0)\n\t"
+            "add $128, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(blocks) : [pattern] "r"(pattern) : "xmm0", "memory", "cc");
+    } else if (nt) {
+        __asm__ volatile(
+            BROADCAST_SSE2
+            "1:\n\t"
+            "movntdq %%xmm0, (%0)\n\t"
+            "movntdq %%xmm0, 16(%0)\n\t"
+            "movntdq %%xmm0, 32(%0)\n\t"
+            "movntdq %%xmm0, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b\n\t"
+            "sfence"
+            : "+r"(d), "+r"(blocks) : [pattern] "r"(pattern) : "xmm0", "memory", "cc");
+    } else {
+        __asm__ volatile(
+            BROADCAST_SSE2
+            "1:\n\t"
+            "movdqa %%xmm0, (%0)\n\t"
+            "movdqa %%xmm0, 16(%0)\n\t"
+            "movdqa %%xmm0, 32(%0)\n\t"
+            "movdqa %%xmm0, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b"
+            : "+r"(d), "+r"(blocks) : [pattern] "r"(pattern) : "xmm0", "memory", "cc");
+    }
+}
+
+// One unaligned store of the pattern at d
+static void set_one(uint8_t* d, uint64_t pattern, int width) {
+    if (width == 32) {
+        __asm__ volatile(BROADCAST_AVX2 "vmovdqu %%ymm0, (%0)" : : "r"(d), [pattern] "r"(pattern) : "xmm0", "memory");
+    } else {
+        __asm__ volatile(BROADCAST_SSE2 "movdqu %%xmm0, (%0)" : : "r"(d), [pattern] "r"(pattern) : "xmm0", "memory");
+    }
+}
+
+static void* set_vector(void* s, int c, size_t n, int width) {
+    uint8_t* d = s;
+    uint8_t* end = d + n;
+    uint64_t pattern = (uint8_t)c * 0x0101010101010101ULL;
+    int nt = n >= nt_threshold;
+
+    set_one(d, pattern, width);
+    size_t head = width - ((uintptr_t)d & (width - 1));
+    d += head;
+    n -= head;
+
+    size_t block = width * 4;
+    if (n >= block) {
+        set_blocks(d, pattern, n / block, width, nt);
+        d += n & ~(block - 1);
+        n &= block - 1;
+    }
+
+    while (n > 0) {
+        size_t step = n >= (size_t)width ? (size_t)width : n;
+        set_one(n >= (size_t)width ? d : end - width, pattern, width);
+        d += step;
+        n -= step;
+    }
+    if (width == 32) {
+        __asm__ volatile("vzeroupper");
+    }
+    return s;
+}
+
+static void* memcpy_erms(void* dest, const void* src, size_t n) {
+    return n < 16 ? memcpy_generic(dest, src, n) : copy_rep(dest, src, n);
+}
+
+static void* memset_erms(void* s, int c, size_t n) {
+    return n < 16 ? memset_generic(s, c, n) : set_rep(s, c, n);
+}
+
+static void* memcpy_sse2(void* dest, const void* src, size_t n) {
+    if (n < 16) {
+        return memcpy_generic(dest, src, n);
+    }
+    return in_interrupt() ? copy_rep(dest, src, n) : copy_vector(dest, src, n, 16);
+}
+
+static void* memset_sse2(void* s, int c, size_t n) {
+    if (n < 16) {
+        return memset_generic(s, c, n);
+    }
+    return in_interrupt() ? set_rep(s, c, n) : set_vector(s, c, n, 16);
+}
+
+static void* memcpy_avx2(void* dest, const void* src, size_t n) {
+    if (n < 32) {
+        return memcpy_sse2(dest, src, n);
+    }
+    return in_interrupt() ? copy_rep(dest, src, n) : copy_vector(dest, src, n, 32);
+}
+
+static void* memset_avx2(void* s, int c, size_t n) {
+    if (n < 32) {
+        return memset_sse2(s, c, n);
+    }
+    return in_interrupt() ? set_rep(s, c, n) : set_vector(s, c, n, 32);
+}
+
+// Index of the first differing 16- or 32-byte block's mask, or n rounded down
+static size_t compare_blocks(const uint8_t* a, const uint8_t* b, size_t end, int width, uint32_t* mask) {
+    size_t i = 0;
+    uint32_t m;
+    if (width == 32) {
+        __asm__ volatile(
+            "1:\n\t"
+            "vmovdqu (%2,%0), %%ymm0\n\t"
+            "vpcmpeqb (%3,%0), %%ymm0, %%ymm0\n\t"
+            "vpmovmskb %%ymm0, %1\n\t"
+            "cmp $-1, %1\n\t"
+            "jne 2f\n\t"
+            "add $32, %0\n\t"
+            "cmp %4, %0\n\t"
+            "jb 1b\n"
+            "2:\n\t"
+            "vzeroupper"
+            : "+r"(i), "=&r"(m) : "r"(a), "r"(b), "r"(end) : "xmm0", "cc");
+        *mask = ~m;
+    } else {
+        __asm__ volatile(
+            "1:\n\t"
+            "movdqu (%2,%0), %%xmm0\n\t"
+            "movdqu (%3,%0), %%xmm1\n\t"
+            "pcmpeqb %%xmm1, %%xmm0\n\t"
+            "pmovmskb %%xmm0, %1\n\t"
+            "cmp $0xFFFF, %1\n\t"
+            "jne 2f\n\t"
+            "add $16, %0\n\t"
+            "cmp %4, %0\n\t"
+            "jb 1b\n"
+            "2:"
+            : "+r"(i), "=&r"(m) : "r"(a), "r"(b), "r"(end) : "xmm0", "xmm1", "cc");
+        *mask = ~m & 0xFFFF;
+    }
+    return i;
+}
+
+static int memcmp_vector(const void* s1, const void* s2, size_t n, int width) {
+    if (n < (size_t)width || in_interrupt()) {
+        return memcmp_generic(s1, s2, n);
+    }
+    const uint8_t* a = s1;
+    const uint8_t* b = s2;
+    uint32_t mask;
+    size_t i = compare_blocks(a, b, n & ~(size_t)(width - 1), width, &mask);
+    if (mask) {
+        i += __builtin_ctz(mask);
+        return a[i] - b[i];
+    }
+    return memcmp_generic(a + i, b + i, n - i);
+}
+
+static int memcmp_sse2(const void* s1, const void* s2, size_t n) {
+    return memcmp_vector(s1, s2, n, 16);
+}
+
+static int memcmp_avx2(const void* s1, const void* s2, size_t n) {
+    return memcmp_vector(s1, s2, n, 32);
+}
+
+static void* memchr_vector(const void* s, int c, size_t n, int width) {
+    if (n < (size_t)width || in_interrupt()) {
+        return memchr_generic(s, c, n);
+    }
+    const uint8_t* p = s;
+    size_t end = n & ~(size_t)(width - 1);
+    size_t i = 0;
+    uint32_t m;
+    uint64_t pattern = (uint8_t)c * 0x0101010101010101ULL;
+    if (width == 32) {
+        __asm__ volatile(
+            "vmovq %4, %%xmm1\n\t"
+            "vpbroadcastq %%xmm1, %%ymm1\n"
+            "1:\n\t"
+            "vpcmpeqb (%2,%0), %%ymm1, %%ymm0\n\t"
+            "vpmovmskb %%ymm0, %1\n\t"
+            "test %1, %1\n\t"
+            "jnz 2f\n\t"
+            "add $32, %0\n\t"
+            "cmp %3, %0\n\t"
+            "jb 1b\n"
+            "2:\n\t"
+            "vzeroupper"
+            : "+r"(i), "=&r"(m) : "r"(p), "r"(end), "r"(pattern) : "xmm0", "xmm1", "cc");
+    } else {
+        __asm__ volatile(
+            "movq %4, %%xmm1\n\t"
+            "punpcklqdq %%xmm1, %%xmm1\n"
+            "1:\n\t"
+            "movdqu (%2,%0), %%xmm0\n\t"
+            "pcmpeqb %%xmm1, %%xmm0\n\t"
+            "pmovmskb %%xmm0, %1\n\t"
+            "test %1, %1\n\t"
+            "jnz 2f\n\t"
+            "add $16, %0\n\t"
+            "cmp %3, %0\n\t"
+            "jb 1b\n"
+            "2:"
+            : "+r"(i), "=&r"(m) : "r"(p), "r"(end), "r"(pattern) : "xmm0", "xmm1", "cc");
+    }
+    if (m) {
+        return (void*)(p + i + __builtin_ctz(m));
+    }
+    return memchr_generic(p + i, c, n - i);
+}
+
+static void* memchr_sse2(const void* s, int c, size_t n) {
+    return memchr_vector(s, c, n, 16);
+}
+
+static void* memchr_avx2(const void* s, int c, size_t n) {
+    return memchr_vector(s, c, n, 32);
+}
+
+// Aligned blocks from the one holding s, with the bytes before s shifted
+// out of the first mask
+static size_t strlen_vector(const char* s, int width) {
+    if (in_interrupt()) {
+        return strlen_generic(s);
+    }
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)(width - 1));
+    uint32_t skip = (uint32_t)(s - p);
+    uint32_t m;
+    if (width == 32) {
+        __asm__ volatile(
+            "vpxor %%xmm1, %%xmm1, %%xmm1\n\t"
+            "vpcmpeqb (%0), %%ymm1, %%ymm0\n\t"
+            "vpmovmskb %%ymm0, %1\n\t"
+            "shr %%cl, %1\n\t"
+            "test %1, %1\n\t"
+            "jnz 2f\n\t"
+            "xor %%ecx, %%ecx\n"
+            "1:\n\t"
+            "add $32, %0\n\t"
+            "vpcmpeqb (%0), %%ymm1, %%ymm0\n\t"
+            "vpmovmskb %%ymm0, %1\n\t"
+            "test %1, %1\n\t"
+            "jz 1b\n"
+            "2:\n\t"
+            "vzeroupper"
+            : "+r"(p), "=&r"(m), "+c"(skip) : : "xmm0", "xmm1", "cc");
+    } else {
+        __asm__ volatile(
+            "pxor %%xmm1, %%xmm1\n\t"
+            "movdqa (%0), %%xmm0\n\t"
+            "pcmpeqb %%xmm1, %%xmm0\n\t"
+            "pmovmskb %%xmm0, %1\n\t"
+            "shr %%cl, %1\n\t"
+            "test %1, %1\n\t"
+            "jnz 2f\n\t"
+            "xor %%ecx, %%ecx\n"
+            "1:\n\t"
+            "add $16, %0\n\t"
+            "movdqa (%0), %%xmm0\n\t"
+            "pcmpeqb %%xmm1, %%xmm0\n\t"
+            "pmovmskb %%xmm0, %1\n\t"
+            "test %1, %1\n\t"
+            "jz 1b\n"
+            "2:"
+            : "+r"(p), "=&r"(m), "+c"(skip) : : "xmm0", "xmm1", "cc");
+    }
+    return p + skip + __builtin_ctz(m) - s;
+}
+
+static size_t strlen_sse2(const char* s) {
+    return strlen_vector(s, 16);
+}
+
+static size_t strlen_avx2(const char* s) {
+    return strlen_vector(s, 32);
+}
+
+// What memops_init installs: vector loops for small and mid sizes, rep
+// movsb where the CPU makes it fast, non-temporal vectors past the LLC
+static void* memcpy_best(void* dest, const void* src, size_t n) {
+    if (erms && n >= ERMS_MIN && n < nt_threshold) {
+        return copy_rep(dest, src, n);
+    }
+    return (fpu_features() & FPU_AVX2) ? memcpy_avx2(dest, src, n) : memcpy_sse2(dest, src, n);
+}
+
+static void* memset_best(void* s, int c, size_t n) {
+    if (erms && n >= ERMS_MIN && n < nt_threshold) {
+        return set_rep(s, c, n);
+    }
+    return (fpu_features() & FPU_AVX2) ? memset_avx2(s, c, n) : memset_sse2(s, c, n);
+}
+
+enum { VARIANT_GENERIC, VARIANT_ERMS, VARIANT_SSE2, VARIANT_AVX2, VARIANT_BEST, VARIANT_COUNT };
+
+static const memops_t variants[VARIANT_COUNT] = {
+    { "generic", memcpy_generic, memset_generic, memcmp_generic, memchr_generic, strlen_generic },
+    { "rep", memcpy_erms, memset_erms, memcmp_generic, memchr_generic, strlen_generic },
+    { "sse2", memcpy_sse2, memset_sse2, memcmp_sse2, memchr_sse2, strlen_sse2 },
+    { "avx2", memcpy_avx2, memset_avx2, memcmp_avx2, memchr_avx2, strlen_avx2 },
+    { "best", memcpy_best, memset_best, 0, 0, 0 }, // Scans filled in by memops_init
+};
+
+static memops_t best;
+
+// Largest data or unified cache from the deterministic cache leaves:
+// 4 on Intel, 0x8000001D on AMD
+static size_t llc_size(void) {
+    uint32_t a, b, c, d;
+    uint32_t leaves[2] = { 4, 0x8000001D };
+    size_t largest = 0;
+    for (int l = 0; l < 2 && !largest; l++) {
+        cpuid(leaves[l] & 0x80000000, &a, &b, &c, &d);
+        if (a < leaves[l]) {
+            continue;
+        }
+        for (uint32_t sub = 0; sub < 16; sub++) {
+            cpuid_count(leaves[l], sub, &a, &b, &c, &d);
+            uint32_t type = a & 0x1F;
+            if (type == 0) {
+                break;
+            }
+            if (type == 2) {
+                continue; // Instruction cache
+            }
+            size_t size = (size_t)((b >> 22) + 1) * (((b >> 12) & 0x3FF) + 1) * ((b & 0xFFF) + 1) * (c + 1);
+            if (size > largest) {
+                largest = size;
+            }
+        }
+    }
+    return largest;
+}
+
+void memops_init(void) {
+    uint32_t a, b, c, d;
+    cpuid(0, &a, &b, &c, &d);
+    if (a >= 7) {
+        cpuid_count(7, 0, &a, &b, &c, &d);
+        erms = (b & CPUID_7_EBX_ERMS) != 0;
+    }
+    size_t llc = llc_size();
+    if (llc) {
+        nt_threshold = llc;
+    }
+
+    int vector = (fpu_features() & FPU_AVX2) ? VARIANT_AVX2 : VARIANT_SSE2;
+    best = variants[VARIANT_BEST];
+    best.memcmp = variants[vector].memcmp;
+    best.memchr = variants[vector].memchr;
+    best.strlen = variants[vector].strlen;
+    memops = best;
+}
+
+int memops_variant(int index, const memops_t** ops) {
+    if (index < 0 || index >= VARIANT_COUNT) {
+        return -1;
+    }
+    *ops = index == VARIANT_BEST ? &best : &variants[index];
+    if (index == VARIANT_AVX2 && !(fpu_features() & FPU_AVX2)) {
+        return 0;
+    }
+    if (index == VARIANT_ERMS && !erms) {
+        return 0; // Works, but is not what the CPU is fast at
+    }
+    if (index == VARIANT_BEST && !best.memcmp) {
+        return 0;
+    }
+    return 1;
+}
+
+size_t memops_nt_threshold(void) {
+    return nt_threshold;
+}
@@ -1,4 +1,11 @@
 #include "../intf/print.h"
+#include "string.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "serial.h"
+#include "stdio.h"
+#include "../memory/vmm.h"
+#include <stdint.h>
 
 // VGA constants
 #define VGA_BUFFER 0xB8000
@@ -23,67 +30,527 @@
 #define PRINT_COLOR_LIGHT_YELLOW 14
 #define PRINT_COLOR_WHITE 15
 
-static int current_color = PRINT_COLOR_WHITE | (PRINT_COLOR_BLACK << 4);
-static int cursor_x = 0;
-static int cursor_y = 0;
+#define VGA_CELLS 16384 // 32 KB of text memory at 0xB8000
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW 0x0F
+
+// Lines kept after they scroll off; the Makefile's SCROLLBACK_LINES sets it
+#ifndef SCROLLBACK_LINES
+#define SCROLLBACK_LINES 2048
+#endif
+#if SCROLLBACK_LINES < 1
+#error "SCROLLBACK_LINES must be at least 1"
+#endif
+
+#define CELL(c, color) ((uint16_t)(unsigned char)(c) | (uint16_t)(color) << 8)
+#define ALL_LINES ((1u << VGA_HEIGHT) - 1)
+#define LINES_ABOVE(y) ((1u << (y)) - 1)
+
+// Everything is drawn into a copy of the screen. print_flush copies the
+// lines marked dirty to VGA memory and moves the hardware cursor, so a
+// line of output costs one pass over VRAM and one cursor update rather
+// than four port writes per character.
+//
+// Scrolling moves no text. Screen line y lives in shadow row rows[y], and
+// a scroll rotates that map; on the VGA side the CRTC start address
+// advances one line through text memory, so only the new bottom line and
+// the pinned lines above the scroll region are written. When the window
+// reaches the end of text memory it goes back to the start with one copy
+// of the whole screen.
+//
+// There is one such copy per virtual console, with its own cursor, color
+// and scrollback. A thread's output goes to the console it was started
+// on. Only the console on screen is ever flushed; the others just take
+// output in RAM, and switching to one redraws it once.
+//
+// Scrollback: a ring of lines in the same packed char/attribute cells as
+// VGA memory. Scrolling appends the line that leaves the region; nothing
+// else on the output path touches it. Each console's ring is a lazy
+// region reserved when its first line scrolls off, so consoles that never
+// scroll cost nothing; if the reservation fails that console goes without. While the view is pulled back,
+// print_flush draws history and the live screen below it instead of
+// following the dirty bits.
+typedef struct {
+    uint16_t cells[VGA_HEIGHT * VGA_WIDTH];
+    uint8_t rows[VGA_HEIGHT];
+    uint32_t dirty_lines;
+    int color;
+    int cursor_x;
+    int cursor_y; // VGA_HEIGHT after the last cell was written, until the next character scrolls
+    int scroll_top; // Lines above this one do not move when output scrolls
+    uint16_t (*history)[VGA_WIDTH];
+    int history_failed; // No room for the ring; this console has no scrollback
+    uint32_t history_lines; // Appended since boot; the ring keeps the last SCROLLBACK_LINES
+    int view_offset; // Lines the view is pulled back, 0 for live
+    int view_top; // Lines above this one stay live while viewing
+    int view_changed;
+} console_t;
+
+static console_t consoles[PRINT_CONSOLES] = {
+    [0 ... PRINT_CONSOLES - 1] = {
+        .rows = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24},
+        .color = PRINT_COLOR_WHITE | (PRINT_COLOR_BLACK << 4),
+    },
+};
+// Held while a console's cells, cursor or scrollback, the window or the
+// CRTC change. Interrupts stay off meanwhile, so klog from a handler can
+// never land in the middle of a thread's write.
+static spinlock_t lock = SPINLOCK_INIT;
+static int visible = 0; // Console print_show_console asked for
+static int shown = 0; // Console VGA memory holds
+static int origin = 0; // Text memory cell shown at the top left
+static int pending_lines = 0; // Scrolls of the shown console the CRTC has not caught up with
+static int hw_origin = -1; // Start address last written to the CRTC
+static int hw_cursor = -1; // Position last written to the CRTC
+
+// The shown console is mirrored to the serial port as a 25-line terminal
+// screen: changed lines are redrawn with cursor addressing, and scrolls
+// become line feeds at the bottom, the way the CRTC start address does
+// them. A line goes out whole or not at all, so while the UART is behind,
+// lines stay marked here and only their latest contents are sent.
+// Built with SERIAL_ONLY, VGA memory and the CRTC are left alone, for
+// machines without a display
+#ifdef SERIAL_ONLY
+static const int vga_output = 0;
+#else
+static const int vga_output = 1;
+#endif
+
+static uint32_t serial_lines = ALL_LINES; // Lines the terminal is missing
+static int serial_cursor = -1; // Terminal cursor, -1 after drawing
+static int serial_ready = 0; // Terminal set up
+static char serial_buffer[VGA_WIDTH * 16]; // One line with a color change per cell
 
 static void outb(unsigned short port, unsigned char val);
 static unsigned char inb(unsigned short port);
 
+int print_console() {
+    thread_t* thread = thread_current();
+    return thread ? thread->console : 0;
+}
+
+void print_set_console(int console) {
+    thread_t* thread = thread_current();
+    if (thread && console >= 0 && console < PRINT_CONSOLES) {
+        thread->console = console;
+    }
+}
+
+int print_visible_console() {
+    return __atomic_load_n(&visible, __ATOMIC_RELAXED);
+}
+
+void print_show_console(int console) {
+    if (console >= 0 && console < PRINT_CONSOLES) {
+        __atomic_store_n(&visible, console, __ATOMIC_RELAXED);
+    }
+}
+
+// The console the calling thread draws on
+static inline console_t* output(void) {
+    return &consoles[print_console()];
+}
+
+static inline void mark_dirty(console_t* con, uint32_t lines) {
+    __atomic_fetch_or(&con->dirty_lines, lines, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t line_bit(int y) {
+    return 1u << y;
+}
+
+static inline uint16_t* line(console_t* con, int y) {
+    return &con->cells[con->rows[y] * VGA_WIDTH];
+}
+
+// History line `index` back from the newest, 0 being the newest
+static inline const uint16_t* history_line(console_t* con, uint32_t index) {
+    return con->history[(con->history_lines - 1 - index) % SCROLLBACK_LINES];
+}
+
+static inline uint32_t history_count(console_t* con) {
+    return con->history_lines < SCROLLBACK_LINES ? con->history_lines : SCROLLBACK_LINES;
+}
+
+// What screen line y shows: while the view is pulled back, the live
+// lines above view_top, then history running into the live screen,
+// shifted down by view_offset
+static const uint16_t* screen_line(console_t* con, int y) {
+    int back = con->view_offset - (y - con->view_top);
+    if (y < con->view_top || back <= 0) {
+        return line(con, y < con->view_top ? y : y - con->view_offset);
+    }
+    return history_line(con, back - 1);
+}
+
+static void draw_view(console_t* con, volatile uint16_t* video_memory) {
+    for (int y = 0; y < VGA_HEIGHT; y++) {
+        const uint16_t* src = screen_line(con, y);
+        for (int x = 0; x < VGA_WIDTH; x++) {
+            video_memory[y * VGA_WIDTH + x] = src[x];
+        }
+    }
+}
+
+// VGA orders the color bits blue, green, red; ANSI red, green, blue
+static int ansi_color(int vga) {
+    return ((vga & 1) << 2) | (vga & 2) | ((vga >> 2) & 1);
+}
+
+static int sgr(char* out, int attribute) {
+    int fg = attribute & 0xF;
+    int bg = (attribute >> 4) & 0xF;
+    return sprintf(out, "\x1b[0;%d;%dm", (fg & 8 ? 90 : 30) + ansi_color(fg), (bg & 8 ? 100 : 40) + ansi_color(bg));
+}
+
+// Screen line y as terminal output; trailing blanks become an erase
+static size_t serial_line(const uint16_t* src, int y) {
+    char* out = serial_buffer;
+    out += sprintf(out, "\x1b[%d;1H", y + 1);
+    int end = VGA_WIDTH;
+    while (end > 0 && src[end - 1] == src[VGA_WIDTH - 1] && (src[end - 1] & 0xFF) == ' ') {
+        end--;
+    }
+    int attribute = -1;
+    for (int x = 0; x < end; x++) {
+        if (src[x] >> 8 != attribute) {
+            attribute = src[x] >> 8;
+            out += sgr(out, attribute);
+        }
+        unsigned char c = src[x] & 0xFF;
+        *out++ = c < 0x20 ? ' ' : c < 0x7F ? c : '#'; // Code page 437 has no ASCII
+    }
+    if (end < VGA_WIDTH) {
+        out += sgr(out, src[VGA_WIDTH - 1] >> 8);
+        out += sprintf(out, "\x1b[K");
+    }
+    return out - serial_buffer;
+}
+
+// Bring the terminal up to date with what VGA memory now shows. `lines`
+// changed since the last flush, after `scrolls` whole-screen scrolls.
+static void mirror_serial(console_t* con, uint32_t lines, int scrolls, int cursor) {
+    if (!serial_present()) {
+        return;
+    }
+    if (!serial_ready) {
+        // Scrolls must happen at line 25 whatever the terminal's height
+        static const char setup[] = "\x1b[0m\x1b[2J\x1b[1;25r";
+        if (serial_write(setup, sizeof(setup) - 1) < 0) {
+            return;
+        }
+        serial_ready = 1;
+        serial_lines = ALL_LINES;
+        serial_cursor = -1;
+        scrolls = 0;
+    }
+
+    if (scrolls) {
+        // Lines still owed would land in the wrong place after a scroll
+        char feeds[VGA_HEIGHT + 8];
+        int n = sprintf(feeds, "\x1b[%d;1H", VGA_HEIGHT);
+        if (serial_lines || scrolls >= VGA_HEIGHT) {
+            serial_lines = ALL_LINES;
+        } else {
+            memset(feeds + n, '\n', scrolls);
+            if (serial_write(feeds, n + scrolls) < 0) {
+                serial_lines = ALL_LINES;
+            }
+        }
+        serial_cursor = -1;
+    }
+    serial_lines |= lines;
+
+    while (serial_lines) {
+        int y = __builtin_ctz(serial_lines);
+        if (serial_write(serial_buffer, serial_line(screen_line(con, y), y)) < 0) {
+            return; // Try again at the next flush
+        }
+        serial_lines &= serial_lines - 1;
+        serial_cursor = -1;
+    }
+
+    if (cursor != serial_cursor) {
+        char move[16];
+        int n = sprintf(move, "\x1b[%d;%dH", cursor / VGA_WIDTH + 1, cursor % VGA_WIDTH + 1);
+        if (serial_write(move, n) == 0) {
+            serial_cursor = cursor;
+        }
+    }
+}
+
+static void crtc_write16(unsigned char high_index, int value) {
+    outb(0x3D4, high_index + 1);
+    outb(0x3D5, (unsigned char) (value & 0xFF));
+    outb(0x3D4, high_index);
+    outb(0x3D5, (unsigned char) ((value >> 8) & 0xFF));
+}
+
+void print_flush() {
+    // One CPU at a time talks to the CRTC; whoever is flushing picks up
+    // what the others wrote
+    uint64_t flags;
+    if (!spin_trylock_irqsave(&lock, &flags)) {
+        return;
+    }
+
+    console_t* con = &consoles[visible];
+    if (visible != shown) {
+        // The CRTC's scrolls were the old console's; draw the new one in place
+        shown = visible;
+        pending_lines = 0;
+        mark_dirty(con, ALL_LINES);
+        con->view_changed = 1;
+    }
+
+    int scrolls = pending_lines;
+    uint32_t moved = 0; // Lines only VGA memory is missing
+    if (pending_lines) {
+        origin += pending_lines * VGA_WIDTH;
+        pending_lines = 0;
+        if (origin + VGA_WIDTH * VGA_HEIGHT > VGA_CELLS) {
+            origin = 0;
+            moved = ALL_LINES;
+        }
+    }
+    if (vga_output && origin != hw_origin) {
+        hw_origin = origin;
+        crtc_write16(CRTC_START_HIGH, origin);
+    }
+
+    uint32_t changed = __atomic_exchange_n(&con->dirty_lines, 0, __ATOMIC_ACQUIRE);
+    uint32_t lines = changed | moved;
+    volatile uint16_t* video_memory = (volatile uint16_t*)VGA_BUFFER + origin;
+    if (con->view_offset) {
+        if (lines || con->view_changed) {
+            changed = ALL_LINES;
+            if (vga_output) {
+                draw_view(con, video_memory);
+            }
+        }
+        con->view_changed = 0;
+        lines = 0;
+    }
+    while (vga_output && lines) {
+        int y = __builtin_ctz(lines);
+        lines &= lines - 1;
+        const uint16_t* src = line(con, y);
+        for (int x = 0; x < VGA_WIDTH; x++) {
+            video_memory[y * VGA_WIDTH + x] = src[x];
+        }
+    }
+
+    int y = con->cursor_y < VGA_HEIGHT ? con->cursor_y : VGA_HEIGHT - 1;
+    int pos = origin + y * VGA_WIDTH + con->cursor_x;
+    if (con->view_offset) {
+        pos = VGA_CELLS; // Off the screen, which hides it
+    }
+    if (vga_output && pos != hw_cursor) {
+        hw_cursor = pos;
+        crtc_write16(CRTC_CURSOR_HIGH, pos);
+    }
+
+    mirror_serial(con, changed, scrolls, con->view_offset ? -1 : y * VGA_WIDTH + con->cursor_x);
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+// Lines from `top` down move up one and the bottom line is blanked. On
+// the console being shown, the CRTC will show text memory one line
+// further on, where everything but the lines above `top` and the new
+// bottom line already is. Callers hold the lock.
+static void scroll_up(console_t* con, int top, int color) {
+    // Lines that scroll off before the VMM is up are not kept
+    if (!con->history && !con->history_failed && vmm_ready()) {
+        con->history = vmm_reserve("scrollback", sizeof(con->history[0]) * SCROLLBACK_LINES, VMM_WRITE);
+        con->history_failed = !con->history;
+    }
+    if (con->history) {
+        memcpy(con->history[con->history_lines % SCROLLBACK_LINES], line(con, top), sizeof(con->history[0]));
+        con->history_lines++;
+    }
+    if (con->view_offset && (uint32_t)con->view_offset < history_count(con)) {
+        con->view_offset++; // Keep showing the same lines
+    }
+
+    uint8_t first = con->rows[top];
+    memmove(&con->rows[top], &con->rows[top + 1], VGA_HEIGHT - 1 - top);
+    con->rows[VGA_HEIGHT - 1] = first;
+
+    uint32_t dirty = __atomic_load_n(&con->dirty_lines, __ATOMIC_ACQUIRE);
+    dirty = ((dirty >> 1) & ~LINES_ABOVE(top)) | LINES_ABOVE(top) | line_bit(VGA_HEIGHT - 1);
+    __atomic_store_n(&con->dirty_lines, dirty, __ATOMIC_RELEASE);
+    if (con == &consoles[shown]) {
+        pending_lines++;
+    }
+
+    uint16_t blank = CELL(' ', color);
+    uint16_t* bottom = line(con, VGA_HEIGHT - 1);
+    for (int x = 0; x < VGA_WIDTH; x++) {
+        bottom[x] = blank;
+    }
+}
+
+// The cursor sits past the last line once it has been filled; the next
+// character scrolls first, so filling the screen does not scroll it
+static inline void wrap_pending(console_t* con) {
+    if (con->cursor_y >= VGA_HEIGHT) {
+        scroll_up(con, con->scroll_top, con->color);
+        con->cursor_y = VGA_HEIGHT - 1;
+    }
+}
+
 void print_clear() {
-    unsigned char* video_memory = (unsigned char*)VGA_BUFFER;
+    console_t* con = output();
+    uint64_t flags = spin_lock_irqsave(&lock);
+    uint16_t blank = CELL(' ', con->color);
     for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
-        *video_memory++ = ' ';
-        *video_memory++ = current_color;
+        con->cells[i] = blank; // Every row, whatever order they are in
     }
-    cursor_x = 0;
-    cursor_y = 0;
-    print_update_cursor();
+    mark_dirty(con, ALL_LINES);
+    con->cursor_x = 0;
+    con->cursor_y = 0;
+    spin_unlock_irqrestore(&lock, flags);
 }
 
 void print_char(char character) {
-    unsigned char* video_memory = (unsigned char*)VGA_BUFFER;
-    int offset = (cursor_y * VGA_WIDTH + cursor_x) * 2;
-    video_memory[offset] = character;
-    video_memory[offset + 1] = current_color;
-    cursor_x++;
-    if (cursor_x >= VGA_WIDTH) {
-        cursor_x = 0;
-        cursor_y++;
-        if (cursor_y >= VGA_HEIGHT) {
-            // Implement scrolling here if needed
-            cursor_y = VGA_HEIGHT - 1;
+    console_t* con = output();
+    uint64_t flags = spin_lock_irqsave(&lock);
+    wrap_pending(con);
+    line(con, con->cursor_y)[con->cursor_x] = CELL(character, con->color);
+    mark_dirty(con, line_bit(con->cursor_y));
+    con->cursor_x++;
+    if (con->cursor_x >= VGA_WIDTH) {
+        con->cursor_x = 0;
+        con->cursor_y++;
+    }
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+// Same as print_char on each byte, with the dirty bits set once per line.
+// Only print_console_write treats '\n' as a line break.
+static void write_console(console_t* con, const char* s, size_t n, int newlines) {
+    uint64_t flags = spin_lock_irqsave(&lock);
+    uint32_t lines = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (con->cursor_y >= VGA_HEIGHT) {
+            mark_dirty(con, lines);
+            wrap_pending(con);
+            lines = 0;
+        }
+        if (newlines && s[i] == '\n') {
+            con->cursor_x = 0;
+            con->cursor_y++;
+            continue;
+        }
+        line(con, con->cursor_y)[con->cursor_x] = CELL(s[i], con->color);
+        lines |= line_bit(con->cursor_y);
+        if (++con->cursor_x >= VGA_WIDTH) {
+            con->cursor_x = 0;
+            con->cursor_y++;
         }
     }
-    print_update_cursor();
+    mark_dirty(con, lines);
+    spin_unlock_irqrestore(&lock, flags);
 }
 
-void print_str(const char* string) {
-    while (*string) {
-        print_char(*string++);
+void print_write(const char* s, size_t n) {
+    write_console(output(), s, n, 0);
+}
+
+void print_console_write(int console, const char* s, size_t n) {
+    if (console >= 0 && console < PRINT_CONSOLES) {
+        write_console(&consoles[console], s, n, 1);
     }
 }
 
+void print_str(const char* string) {
+    print_write(string, strlen(string));
+}
+
 void print_set_color(int foreground, int background) {
-    current_color = foreground | (background << 4);
+    output()->color = foreground | (background << 4);
 }
 
 void print_set_cursor(int x, int y) {
-    cursor_x = x;
-    cursor_y = y;
-    print_update_cursor();
+    console_t* con = output();
+    uint64_t flags = spin_lock_irqsave(&lock);
+    con->cursor_x = x;
+    con->cursor_y = y;
+    spin_unlock_irqrestore(&lock, flags);
 }
 
 char print_char_at(int x, int y, char c) {
-    unsigned char* video_memory = (unsigned char*)VGA_BUFFER;
-    int offset = (y * VGA_WIDTH + x) * 2;
-    char old_char = video_memory[offset];
-    video_memory[offset] = c;
-    video_memory[offset + 1] = current_color;
+    console_t* con = output();
+    uint64_t flags = spin_lock_irqsave(&lock);
+    char old_char = (char)line(con, y)[x];
+    line(con, y)[x] = CELL(c, con->color);
+    mark_dirty(con, line_bit(y));
+    spin_unlock_irqrestore(&lock, flags);
     return old_char;
 }
 
+void print_fill(int x, int y, int count, int foreground, int background) {
+    console_t* con = output();
+    uint64_t flags = spin_lock_irqsave(&lock);
+    uint16_t blank = CELL(' ', foreground | (background << 4));
+    uint32_t lines = 0;
+    while (count > 0 && y < VGA_HEIGHT) {
+        uint16_t* row = line(con, y);
+        for (; x < VGA_WIDTH && count > 0; x++, count--) {
+            row[x] = blank;
+        }
+        lines |= line_bit(y);
+        x = 0;
+        y++;
+    }
+    mark_dirty(con, lines);
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+void print_scroll(int top, int foreground, int background) {
+    uint64_t flags = spin_lock_irqsave(&lock);
+    scroll_up(output(), top, foreground | (background << 4));
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+void print_set_scroll_top(int top) {
+    output()->scroll_top = top;
+}
+
+int print_scrollback(int lines) {
+    uint64_t flags = spin_lock_irqsave(&lock);
+    console_t* con = &consoles[visible];
+    int offset = con->view_offset + lines;
+    if (offset > (int)history_count(con)) {
+        offset = history_count(con);
+    }
+    if (offset < 0) {
+        offset = 0;
+    }
+    if (offset != con->view_offset) {
+        if (!con->view_offset) {
+            con->view_top = con->scroll_top;
+        }
+        con->view_offset = offset;
+        con->view_changed = 1;
+        if (!offset) {
+            mark_dirty(con, ALL_LINES); // VGA memory holds the view, not the screen
+        }
+    }
+    spin_unlock_irqrestore(&lock, flags);
+    return offset;
+}
+
+void print_scrollback_end() {
+    print_scrollback(-consoles[print_visible_console()].view_offset);
+}
+
 void print_enable_cursor(int cursor_start, int cursor_end) {
+    if (!vga_output) {
+        return;
+    }
     outb(0x3D4, 0x0A);
     outb(0x3D5, (inb(0x3D5) & 0xC0) | cursor_start);
     outb(0x3D4, 0x0B);
@@ -91,39 +558,25 @@ void print_enable_cursor(int cursor_start, int cursor_end) {
 }
 
 void print_disable_cursor() {
+    if (!vga_output) {
+        return;
+    }
     outb(0x3D4, 0x0A);
     outb(0x3D5, 0x20);
 }
 
+// The hardware cursor follows cursor_x/cursor_y at the next print_flush
 void print_update_cursor() {
-    unsigned short pos = cursor_y * VGA_WIDTH + cursor_x;
-    outb(0x3D4, 0x0F);
-    outb(0x3D5, (unsigned char) (pos & 0xFF));
-    outb(0x3D4, 0x0E);
-    outb(0x3D5, (unsigned char) ((pos >> 8) & 0xFF));
 }
 
 void print_clear_screen() {
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
-    unsigned char* video_memory = (unsigned char*)VGA_BUFFER;
-    for (int y = 0; y < VGA_HEIGHT; y++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            const int index = y * VGA_WIDTH + x;
-            video_memory[index * 2] = ' ';
-            video_memory[index * 2 + 1] = current_color;
-        }
-    }
-
-    // Reset cursor position and update cursor on screen
-    cursor_x = 0;
-    cursor_y = 0;
-    print_update_cursor();
+    print_clear();
 }
 
 char print_get_char(int x, int y) {
-    if (x >= VGA_WIDTH || y >= VGA_HEIGHT) return '\0'; 
-    unsigned char* video_memory = (unsigned char*)VGA_BUFFER;
-    return video_memory[(y * VGA_WIDTH + x) * 2]; 
+    if (x >= VGA_WIDTH || y >= VGA_HEIGHT) return '\0';
+    return (char)line(output(), y)[x];
 }
 
 static void outb(unsigned short port, unsigned char val) {
@@ -137,10 +590,11 @@ static unsigned char inb(unsigned short port) {
 }
 
 void print_get_cursor(int *x, int *y) {
+    console_t* con = output();
     if (x) {
-        *x = cursor_x;
+        *x = con->cursor_x;
     }
     if (y) {
-        *y = cursor_y;
+        *y = con->cursor_y < VGA_HEIGHT ? con->cursor_y : VGA_HEIGHT - 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,261 @@
+#include "serial.h"
+#include "interrupts.h"
+#include "spinlock.h"
+#include "io.h"
+#include "print.h"
+#include "../drivers/keyboard/keyboard.h"
+
+#define COM1 0x3F8
+#define UART_DATA 0 // RBR/THR, or divisor low with DLAB
+#define UART_IER 1 // Divisor high with DLAB
+#define UART_IIR 2 // FCR when written
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_MSR 6
+
+#define IER_RX 0x01
+#define IER_THRE 0x02
+#define IIR_NONE 0x01
+#define IIR_ID_MASK 0x0E
+#define IIR_MODEM 0x00
+#define IIR_THRE 0x02
+#define IIR_RX 0x04
+#define IIR_LINE 0x06
+#define IIR_RX_TIMEOUT 0x0C
+#define FCR_ENABLE 0x01
+#define FCR_CLEAR_RX 0x02
+#define FCR_CLEAR_TX 0x04
+#define FCR_RX_TRIGGER_14 0xC0
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+#define MCR_DTR 0x01
+#define MCR_RTS 0x02
+#define MCR_OUT2 0x08 // Gates the IRQ line on PCs
+#define MCR_LOOPBACK 0x10
+#define LSR_DATA_READY 0x01
+#define LSR_THR_EMPTY 0x20
+
+#define UART_CLOCK 115200
+#define UART_FIFO_SIZE 16
+#define TX_MASK (SERIAL_TX_BUFFER - 1)
+
+#define ESC 0x1B
+
+// Output is copied into a ring and the UART takes it 16 bytes at a time:
+// the first burst is written straight into the idle FIFO, each THR-empty
+// interrupt refills it from the ring. Nothing ever waits for the line,
+// so a writer facing a full ring is told so instead.
+//
+// Received bytes go through keyboard_feed like scancodes do. Incoming
+// bytes trigger an interrupt at 14 in the FIFO, or when the line goes
+// quiet, so a terminal's escape sequence arrives in one burst and is
+// decoded into the same key codes the PS/2 keyboard produces.
+static char tx_buffer[SERIAL_TX_BUFFER];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+static int tx_busy = 0; // The FIFO is sending; a THR-empty interrupt will follow
+static spinlock_t tx_lock = SPINLOCK_INIT;
+static int present = 0;
+static serial_stats_t stats;
+
+// Where the receiver is in an escape sequence
+enum {
+    RX_PLAIN,
+    RX_ESC, // Seen ESC
+    RX_CSI, // Seen ESC [
+    RX_SS3, // Seen ESC O
+    RX_TILDE // Seen ESC [ digit, waiting for ~
+};
+
+static int rx_state = RX_PLAIN;
+static char rx_param = 0;
+
+// Move up to a FIFO's worth from the ring to the UART. tx_lock is held.
+static void tx_fill(void) {
+    int count = 0;
+    while (count < UART_FIFO_SIZE && tx_tail != tx_head) {
+        outb(COM1 + UART_DATA, (unsigned char)tx_buffer[tx_tail & TX_MASK]);
+        tx_tail++;
+        count++;
+    }
+    tx_busy = count != 0;
+    stats.tx_bytes += count;
+}
+
+static void rx_key(unsigned char c) {
+    if (c) {
+        keyboard_feed(c);
+    }
+}
+
+// VT100/xterm keys: ESC [ A..D and H/F, ESC [ n ~, and ESC O P..S for
+// F1..F4, which switch consoles the way Alt+F1..F4 do
+static void rx_byte(unsigned char c) {
+    stats.rx_bytes++;
+    switch (rx_state) {
+    case RX_ESC:
+        if (c == '[') {
+            rx_state = RX_CSI;
+            return;
+        }
+        if (c == 'O') {
+            rx_state = RX_SS3;
+            return;
+        }
+        rx_state = RX_PLAIN;
+        rx_key(ESC);
+        break;
+    case RX_CSI:
+        rx_state = RX_PLAIN;
+        switch (c) {
+        case 'A': rx_key(NAV_UP_ARROW); return;
+        case 'B': rx_key(NAV_DOWN_ARROW); return;
+        case 'C': rx_key(NAV_RIGHT_ARROW); return;
+        case 'D': rx_key(NAV_LEFT_ARROW); return;
+        case 'H': rx_key(NAV_HOME_KEY); return;
+        case 'F': rx_key(NAV_END_KEY); return;
+        }
+        if (c >= '1' && c <= '6') {
+            rx_param = c;
+            rx_state = RX_TILDE;
+        }
+        return;
+    case RX_SS3:
+        rx_state = RX_PLAIN;
+        if (c >= 'P' && c < 'P' + PRINT_CONSOLES) {
+            print_show_console(c - 'P');
+        }
+        return;
+    case RX_TILDE:
+        rx_state = RX_PLAIN;
+        if (c == '~') {
+            switch (rx_param) {
+            case '1': rx_key(NAV_HOME_KEY); break;
+            case '4': rx_key(NAV_END_KEY); break;
+            case '5': rx_key(NAV_PAGE_UP); break;
+            case '6': rx_key(NAV_PAGE_DOWN); break;
+            }
+        }
+        return;
+    }
+
+    if (c == ESC) {
+        rx_state = RX_ESC;
+    } else if (c == '\r') {
+        rx_key('\n');
+    } else if (c == 0x7F) {
+        rx_key('\b');
+    } else if (c != '\n') { // Terminals that send CR LF would get two Enters
+        rx_key(c);
+    }
+}
+
+static void serial_irq_handler(interrupt_frame_t* frame) {
+    (void)frame;
+
+    uint8_t iir;
+    while (!((iir = inb(COM1 + UART_IIR)) & IIR_NONE)) {
+        switch (iir & IIR_ID_MASK) {
+        case IIR_RX:
+        case IIR_RX_TIMEOUT:
+            while (inb(COM1 + UART_LSR) & LSR_DATA_READY) {
+                rx_byte(inb(COM1 + UART_DATA));
+            }
+            // An ESC the burst ended on was typed on its own
+            if (rx_state == RX_ESC) {
+                rx_state = RX_PLAIN;
+                rx_key(ESC);
+            }
+            break;
+        case IIR_THRE: {
+            // Another CPU may be queueing output
+            uint64_t flags = spin_lock_irqsave(&tx_lock);
+            stats.tx_interrupts++;
+            tx_fill();
+            spin_unlock_irqrestore(&tx_lock, flags);
+            break;
+        }
+        case IIR_LINE:
+            inb(COM1 + UART_LSR);
+            break;
+        case IIR_MODEM:
+            inb(COM1 + UART_MSR);
+            break;
+        }
+    }
+}
+
+int serial_init(void) {
+    if (present) {
+        return 0;
+    }
+
+    outb(COM1 + UART_IER, 0);
+    outb(COM1 + UART_LCR, LCR_DLAB);
+    outb(COM1 + UART_DATA, (UART_CLOCK / SERIAL_BAUD) & 0xFF);
+    outb(COM1 + UART_IER, (UART_CLOCK / SERIAL_BAUD) >> 8);
+    outb(COM1 + UART_LCR, LCR_8N1);
+    outb(COM1 + UART_IIR, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX | FCR_RX_TRIGGER_14);
+
+    // A byte sent in loopback comes back only if a UART is there
+    outb(COM1 + UART_MCR, MCR_LOOPBACK | MCR_RTS | MCR_DTR);
+    outb(COM1 + UART_DATA, 0xAE);
+    for (int i = 0; i < 1000 && !(inb(COM1 + UART_LSR) & LSR_DATA_READY); i++) {
+    }
+    if (inb(COM1 + UART_DATA) != 0xAE) {
+        return -1;
+    }
+    outb(COM1 + UART_MCR, MCR_OUT2 | MCR_RTS | MCR_DTR);
+    while (inb(COM1 + UART_LSR) & LSR_DATA_READY) {
+        inb(COM1 + UART_DATA);
+    }
+
+    irq_register_handler(IRQ_COM1, serial_irq_handler);
+    outb(COM1 + UART_IER, IER_RX | IER_THRE);
+    present = 1;
+    return 0;
+}
+
+int serial_present(void) {
+    return present;
+}
+
+int serial_write(const char* s, size_t n) {
+    if (!present) {
+        return -1;
+    }
+    uint64_t flags = spin_lock_irqsave(&tx_lock);
+    if (n > SERIAL_TX_BUFFER - (tx_head - tx_tail)) {
+        stats.tx_rejected++;
+        spin_unlock_irqrestore(&tx_lock, flags);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        tx_buffer[(tx_head + i) & TX_MASK] = s[i];
+    }
+    tx_head += n;
+    if (!tx_busy) {
+        tx_fill();
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+    return 0;
+}
+
+void serial_drain(void) {
+    if (!present) {
+        return;
+    }
+    // The lock may belong to whatever just crashed
+    while (tx_tail != tx_head) {
+        while (!(inb(COM1 + UART_LSR) & LSR_THR_EMPTY)) {
+        }
+        tx_fill();
+    }
+}
+
+void serial_get_stats(serial_stats_t* out) {
+    uint64_t flags = spin_lock_irqsave(&tx_lock);
+    *out = stats;
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
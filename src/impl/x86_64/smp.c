@@ -0,0 +1,191 @@
+#include "smp.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "cpu.h"
+#include "ktime.h"
+#include "idle.h"
+#include "interrupts.h"
+#include "gdt.h"
+#include "fpu.h"
+#include "string.h"
+#include "../memory/memory.h"
+#include "../memory/vmm.h"
+
+#define TRAMPOLINE_BASE 0x8000 // Must match trampoline.asm
+#define IA32_GS_BASE_MSR 0xC0000101
+#define IA32_EFER_MSR 0xC0000080
+#define EFER_LMA (1 << 10) // Read-only status bit
+
+#define INIT_DELAY_NS (10 * NSEC_PER_MSEC)
+#define STARTUP_DELAY_NS (200 * NSEC_PER_USEC)
+#define AP_BOOT_TIMEOUT_NS (100 * NSEC_PER_MSEC)
+
+extern uint8_t trampoline_start[];
+extern uint8_t trampoline_end[];
+extern uint64_t trampoline_cr3;
+extern uint64_t trampoline_efer;
+extern uint64_t trampoline_stack;
+extern uint64_t trampoline_entry;
+extern uint64_t trampoline_cpu;
+
+static cpu_local_t cpus[SMP_MAX_CPUS];
+static uint32_t cpu_count = 1;
+static uint64_t bsp_cr4 = 0;
+
+// Address of a trampoline variable in the low-memory copy
+#define TRAMPOLINE_VAR(var) ((volatile uint64_t*)(TRAMPOLINE_BASE + ((uint8_t*)&(var) - trampoline_start)))
+
+static void spin_ns(uint64_t ns) {
+    uint64_t end = ktime_now() + ns;
+    while (ktime_now() < end) {
+        __asm__ volatile("pause");
+    }
+}
+
+static void set_gs_base(cpu_local_t* cpu) {
+    wrmsr(IA32_GS_BASE_MSR, (uintptr_t)cpu);
+}
+
+static void wake_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    lapic_eoi();
+}
+
+// Parked APs sleep in hlt until smp_run_on() hands them something to do
+static void ap_idle_loop(cpu_local_t* cpu) {
+    while (1) {
+        interrupts_disable();
+        smp_work_t work = __atomic_load_n(&cpu->work, __ATOMIC_ACQUIRE);
+        if (!work) {
+            cpu_idle();
+            continue;
+        }
+        interrupts_enable();
+        work(cpu->work_arg);
+        cpu->work_done++;
+        __atomic_store_n(&cpu->work, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static void ap_main(cpu_local_t* cpu) {
+    fpu_init();
+    set_gs_base(cpu);
+    __asm__ volatile("mov %0, %%cr4" : : "r"(bsp_cr4));
+    vmm_init_ap();
+    gdt_init(cpu->index);
+    interrupts_init_ap();
+    lapic_init_ap();
+    cpu->apic_id = lapic_id();
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+
+    ap_idle_loop(cpu);
+}
+
+void smp_init_bsp(void) {
+    cpu_local_t* bsp = &cpus[0];
+    bsp->self = bsp;
+    bsp->index = 0;
+    bsp->online = 1;
+    set_gs_base(bsp);
+}
+
+static int start_ap(cpu_local_t* cpu) {
+    cpu->stack = vmm_stack_alloc("ap stack", SMP_AP_STACK_SIZE);
+    if (!cpu->stack) {
+        return -1;
+    }
+
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    *TRAMPOLINE_VAR(trampoline_cr3) = cr3;
+    *TRAMPOLINE_VAR(trampoline_efer) = rdmsr(IA32_EFER_MSR) & ~(uint64_t)EFER_LMA;
+    *TRAMPOLINE_VAR(trampoline_stack) = ((uintptr_t)cpu->stack + SMP_AP_STACK_SIZE) & ~0xFULL;
+    *TRAMPOLINE_VAR(trampoline_entry) = (uintptr_t)ap_main;
+    *TRAMPOLINE_VAR(trampoline_cpu) = (uintptr_t)cpu;
+
+    // INIT, then up to two STARTUP IPIs as the MP spec asks
+    lapic_send_init(cpu->apic_id);
+    spin_ns(INIT_DELAY_NS);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        lapic_send_startup(cpu->apic_id, TRAMPOLINE_BASE >> 12);
+        spin_ns(STARTUP_DELAY_NS);
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+    }
+
+    uint64_t deadline = ktime_now() + AP_BOOT_TIMEOUT_NS;
+    while (ktime_now() < deadline) {
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        __asm__ volatile("pause");
+    }
+
+    // Never came up; put it back into wait-for-SIPI before dropping its stack
+    lapic_send_init(cpu->apic_id);
+    vmm_release(cpu->stack);
+    cpu->stack = 0;
+    return -1;
+}
+
+uint32_t smp_start_aps(void) {
+    const acpi_madt_info_t* madt = acpi_madt();
+    if (!madt || cpu_count > 1) {
+        return cpu_count;
+    }
+
+    interrupt_register_handler(SMP_WAKE_VECTOR, wake_interrupt);
+    __asm__ volatile("mov %%cr4, %0" : "=r"(bsp_cr4));
+    memcpy((void*)TRAMPOLINE_BASE, trampoline_start, trampoline_end - trampoline_start);
+
+    uint32_t bsp_apic_id = lapic_id();
+    cpus[0].apic_id = bsp_apic_id;
+
+    for (uint32_t i = 0; i < madt->cpu_count && cpu_count < SMP_MAX_CPUS; i++) {
+        if (madt->apic_ids[i] == bsp_apic_id) {
+            continue;
+        }
+        cpu_local_t* cpu = &cpus[cpu_count];
+        cpu->self = cpu;
+        cpu->index = cpu_count;
+        cpu->apic_id = madt->apic_ids[i];
+        if (start_ap(cpu) == 0) {
+            cpu_count++;
+        }
+    }
+    return cpu_count;
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+cpu_local_t* smp_cpu(uint32_t index) {
+    return index < cpu_count ? &cpus[index] : 0;
+}
+
+int smp_run_on(uint32_t index, smp_work_t fn, void* arg) {
+    if (index == 0 || index >= cpu_count) {
+        return -1;
+    }
+    cpu_local_t* cpu = &cpus[index];
+
+    // Only the boot CPU hands out work, so masking interrupts is enough
+    // to keep two threads from claiming the same AP
+    uint64_t flags = irq_save();
+    if (__atomic_load_n(&cpu->work, __ATOMIC_ACQUIRE)) {
+        irq_restore(flags);
+        return -1;
+    }
+    cpu->work_arg = arg;
+    __atomic_store_n(&cpu->work, fn, __ATOMIC_RELEASE);
+    irq_restore(flags);
+
+    lapic_send_ipi(cpu->apic_id, SMP_WAKE_VECTOR);
+    return 0;
+}
+
+int smp_cpu_busy(uint32_t index) {
+    return index < cpu_count && __atomic_load_n(&cpus[index].work, __ATOMIC_ACQUIRE) != 0;
+}
@@ -0,0 +1,83 @@
+#include "ktime.h"
+#include "io.h"
+#include "cpu.h"
+
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL2_DATA 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE_PORT 0x61 // bit 0: channel 2 gate, bit 1: speaker, bit 5: channel 2 output
+
+#define CALIBRATION_MS 10
+#define CALIBRATION_RUNS 3
+
+// Assume 1 GHz until calibrated so early sleeps still terminate
+static uint64_t tsc_hz = 1000000000ULL;
+static uint64_t tsc_base = 0;
+// ns = (cycles * ns_mult) >> 32, avoids a 64-bit divide on every read
+static uint64_t ns_mult = 1ULL << 32;
+static int tsc_invariant = 0;
+
+// Count TSC cycles across one PIT channel 2 one-shot of CALIBRATION_MS
+static uint64_t pit_measure_tsc(void) {
+    uint16_t count = (uint16_t)(PIT_FREQUENCY * CALIBRATION_MS / 1000);
+
+    // Gate high, speaker off
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count), binary
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2_DATA, count & 0xFF);
+    outb(PIT_CHANNEL2_DATA, count >> 8);
+
+    uint64_t start = tsc_read();
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+    }
+    return tsc_read() - start;
+}
+
+void ktime_init(void) {
+    uint32_t a, b, c, d;
+    cpuid(0x80000000, &a, &b, &c, &d);
+    if (a >= 0x80000007) {
+        cpuid(0x80000007, &a, &b, &c, &d);
+        tsc_invariant = (d >> 8) & 1;
+    }
+
+    // Take the shortest run: interference (SMIs, host preemption) only adds cycles
+    uint64_t best = ~0ULL;
+    for (int i = 0; i < CALIBRATION_RUNS; i++) {
+        uint64_t cycles = pit_measure_tsc();
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+
+    tsc_hz = best * (1000 / CALIBRATION_MS);
+    ns_mult = (NSEC_PER_SEC << 32) / tsc_hz;
+    tsc_base = tsc_read();
+}
+
+uint64_t ktime_cycles_to_ns(uint64_t cycles) {
+    return (uint64_t)(((unsigned __int128)cycles * ns_mult) >> 32);
+}
+
+uint64_t ktime_ns_to_cycles(uint64_t ns) {
+    // Split so the multiply cannot overflow and no 128-bit divide is needed
+    return (ns / NSEC_PER_SEC) * tsc_hz + ((ns % NSEC_PER_SEC) * tsc_hz) / NSEC_PER_SEC;
+}
+
+uint64_t ktime_to_tsc(uint64_t ns) {
+    return tsc_base + ktime_ns_to_cycles(ns);
+}
+
+uint64_t ktime_now(void) {
+    return ktime_cycles_to_ns(tsc_read() - tsc_base);
+}
+
+uint64_t tsc_frequency(void) {
+    return tsc_hz;
+}
+
+int tsc_is_invariant(void) {
+    return tsc_invariant;
+}
@@ -0,0 +1,39 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS 64
+
+typedef struct __attribute__((packed)) {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_sdt_header_t;
+
+// What the MADT tells us about interrupt hardware
+typedef struct {
+    uint64_t lapic_address;
+    uint32_t ioapic_address;
+    uint32_t cpu_count;
+    uint8_t apic_ids[ACPI_MAX_CPUS]; // Enabled processors, the ones running now
+    uint32_t hotplug_count; // Online-capable but not enabled; not started at boot
+} acpi_madt_info_t;
+
+// Locate the RSDT/XSDT. rsdp_address may be 0 to search the BIOS areas.
+// Returns -1 if no valid RSDP was found.
+int acpi_init(uint64_t rsdp_address);
+
+// Returns NULL if the table is absent or fails its checksum
+const acpi_sdt_header_t* acpi_find_table(const char* signature);
+
+// Returns NULL if there is no MADT
+const acpi_madt_info_t* acpi_madt(void);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef BOOT_INFO_H
+#define BOOT_INFO_H
+
+#include <stdint.h>
+
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36d76289
+
+#define BOOT_INFO_MAX_MMAP 64
+#define BOOT_INFO_MAX_MODULES 8
+#define BOOT_INFO_CMDLINE_LENGTH 256
+#define BOOT_INFO_MODULE_NAME_LENGTH 64
+
+// Multiboot2 memory map types
+#define BOOT_MMAP_AVAILABLE 1
+#define BOOT_MMAP_RESERVED 2
+#define BOOT_MMAP_ACPI_RECLAIMABLE 3
+#define BOOT_MMAP_NVS 4
+#define BOOT_MMAP_BAD 5
+
+// Multiboot2 framebuffer types
+#define BOOT_FRAMEBUFFER_INDEXED 0
+#define BOOT_FRAMEBUFFER_RGB 1
+#define BOOT_FRAMEBUFFER_TEXT 2
+
+typedef struct {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+} boot_mmap_entry_t;
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    char name[BOOT_INFO_MODULE_NAME_LENGTH];
+} boot_module_t;
+
+typedef struct {
+    uint64_t address;
+    uint32_t pitch; // Bytes per line
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t type;
+} boot_framebuffer_t;
+
+// Everything the kernel needs from the boot loader, copied out of GRUB's
+// structure so the memory it lives in can be reused later
+typedef struct {
+    uint64_t info_start; // Physical range of the Multiboot2 structure
+    uint64_t info_end;
+
+    boot_mmap_entry_t mmap[BOOT_INFO_MAX_MMAP];
+    uint32_t mmap_count;
+    uint64_t usable_memory; // Bytes of BOOT_MMAP_AVAILABLE RAM
+
+    int has_framebuffer;
+    boot_framebuffer_t framebuffer;
+
+    uint8_t rsdp[36]; // Copy of the RSDP (v1 is the first 20 bytes)
+    uint32_t rsdp_length; // 0 if the loader did not pass one
+
+    char cmdline[BOOT_INFO_CMDLINE_LENGTH];
+
+    boot_module_t modules[BOOT_INFO_MAX_MODULES];
+    uint32_t module_count;
+} boot_info_t;
+
+// Called from main64.asm with EAX/EBX as GRUB left them.
+// Returns -1 if the kernel was not loaded by a Multiboot2 loader.
+int boot_info_parse(uint32_t magic, uint64_t address);
+
+const boot_info_t* boot_info(void);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+#define FPU_NM_VECTOR 7 // Device not available: CR0.TS was set
+
+// fpu_features() bits; each means the CPU has it and it is switched on
+#define FPU_SSE 0x01
+#define FPU_XSAVE 0x02
+#define FPU_XSAVEOPT 0x04
+#define FPU_AVX 0x08
+#define FPU_AVX2 0x10
+
+struct thread;
+
+typedef struct {
+    uint32_t features;
+    uint32_t state_size; // Bytes of one thread's saved state
+    uint64_t xcr0;
+    uint64_t restores; // Thread states loaded on a #NM
+    uint64_t saves; // Thread states saved on a switch
+    uint64_t interrupt_saves; // Interrupted states parked for a handler
+} fpu_stats_t;
+
+// Turn on x87, SSE and, when the CPU has XSAVE, AVX on this CPU. Runs on
+// every CPU before any C code that may use vector registers, so it
+// touches no per-CPU data.
+void fpu_init(void);
+uint32_t fpu_features(void);
+
+// FPU state is switched lazily: a thread's registers are loaded on its
+// first FPU instruction after a switch (#NM), and saved on the way out
+// only if it used them. Returns -1 if no state could be allocated.
+int fpu_thread_init(struct thread* thread);
+// The boot thread already owns what is in the registers
+int fpu_thread_adopt(struct thread* thread);
+void fpu_thread_free(struct thread* thread);
+void fpu_switch(struct thread* prev, struct thread* next);
+
+// Bracket every interrupt handler except #NM. A handler that uses the
+// FPU gets clean registers; the interrupted code's are parked and put back.
+void fpu_interrupt_enter(void);
+void fpu_interrupt_exit(void);
+// Whether this CPU is inside an interrupt handler other than #NM
+int fpu_in_interrupt(void);
+
+void fpu_get_stats(fpu_stats_t* stats);
+
+#endif
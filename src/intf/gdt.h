@@ -0,0 +1,15 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+
+#define GDT_KERNEL_CODE 0x08 // Same selector as the boot GDT in main.asm
+#define GDT_IST_DOUBLE_FAULT 1
+#define GDT_IST_STACK_SIZE (8 * 1024)
+
+// Load the kernel GDT and this CPU's TSS. The TSS gives double faults a
+// stack of their own, so overrunning a stack guard page can be reported
+// instead of resetting the machine. Returns -1 if no stack was available.
+int gdt_init(uint32_t cpu_index);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+#include "interrupts.h"
+#include "smp.h"
+
+// Halt until the next interrupt. Must be entered with interrupts disabled;
+// they are re-enabled atomically with the halt so no wakeup is lost.
+void cpu_idle(void);
+
+// Halted time and halt count of the calling CPU
+uint64_t idle_time_ns(void);
+uint64_t idle_halt_count(void);
+uint64_t cpu_idle_time_ns(const cpu_local_t* cpu);
+
+// Sleep in hlt until condition holds. The condition is re-tested with
+// interrupts off before halting, so an interrupt that makes it true
+// between the test and the hlt still wakes us.
+#define wait_event(condition)          \
+    do {                               \
+        while (!(condition)) {         \
+            interrupts_disable();      \
+            if (condition) {           \
+                interrupts_enable();   \
+                break;                 \
+            }                          \
+            cpu_idle();                \
+        }                              \
+    } while (0)
+
+#endif
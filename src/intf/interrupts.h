@@ -0,0 +1,56 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+
+#define IDT_ENTRIES 256
+#define IRQ_BASE_VECTOR 0x20 // PIC IRQ0-15 are remapped to vectors 0x20-0x2F
+
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_CASCADE 2
+#define IRQ_COM1 4
+
+// Register state pushed by the stubs in interrupts.asm, lowest address first
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+} interrupt_frame_t;
+
+typedef void (*interrupt_handler_t)(interrupt_frame_t* frame);
+
+void interrupts_init(void);
+// Load the shared IDT on an application processor
+void interrupts_init_ap(void);
+void interrupt_register_handler(uint8_t vector, interrupt_handler_t handler);
+void irq_register_handler(uint8_t irq, interrupt_handler_t handler);
+// Run the handler for `vector` on TSS interrupt stack `ist` (1-7)
+void interrupt_set_ist(uint8_t vector, uint8_t ist);
+// Print the fault and halt this CPU; message NULL names the exception
+void interrupt_panic(interrupt_frame_t* frame, const char* message);
+
+static inline void interrupts_enable(void) {
+    __asm__ volatile("sti" ::: "memory");
+}
+
+static inline void interrupts_disable(void) {
+    __asm__ volatile("cli" ::: "memory");
+}
+
+// Disable interrupts and return the previous RFLAGS for irq_restore()
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & (1 << 9)) {
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef KTIME_H
+#define KTIME_H
+
+#include <stdint.h>
+
+#define NSEC_PER_USEC 1000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+
+static inline uint64_t tsc_read(void) {
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// Calibrate the TSC against the PIT; call once at boot
+void ktime_init(void);
+
+// Monotonic nanoseconds since ktime_init()
+uint64_t ktime_now(void);
+uint64_t ktime_cycles_to_ns(uint64_t cycles);
+uint64_t ktime_ns_to_cycles(uint64_t ns);
+// TSC value at which ktime_now() reaches ns
+uint64_t ktime_to_tsc(uint64_t ns);
+
+uint64_t tsc_frequency(void);
+int tsc_is_invariant(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include <stdint.h>
+
+#define LAPIC_TIMER_VECTOR 0x30 // First vector above the PIC range
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+// Enable the local APIC and set up its timer for one-shot use.
+// Returns -1 if the CPU has no usable APIC.
+int lapic_init(void);
+
+// Enable the local APIC of an application processor
+void lapic_init_ap(void);
+
+void lapic_eoi(void);
+uint32_t lapic_id(void);
+
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint32_t page);
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+// Fire LAPIC_TIMER_VECTOR once at ktime deadline_ns (TSC-deadline mode
+// when available, otherwise a one-shot count); replaces any earlier arm
+void lapic_timer_arm(uint64_t deadline_ns);
+void lapic_timer_cancel(void);
+int lapic_timer_has_deadline(void);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MEMOPS_H
+#define MEMOPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The string.h routines that sit under every copy and clear. string.c
+// calls through `memops`, which starts out at the portable versions and
+// is pointed at the best ones for this CPU by memops_init.
+typedef struct {
+    const char* name;
+    void* (*memcpy)(void* dest, const void* src, size_t n);
+    void* (*memset)(void* s, int c, size_t n);
+    int (*memcmp)(const void* s1, const void* s2, size_t n);
+    void* (*memchr)(const void* s, int c, size_t n);
+    size_t (*strlen)(const char* s);
+} memops_t;
+
+extern memops_t memops;
+
+// Pick versions from the CPUID bits fpu_init enabled. Call once
+// per-CPU data is set up, since vector versions check for interrupt context.
+void memops_init(void);
+
+// Variant `index` for benchmarks; returns -1 past the last one and 0 for
+// a variant this CPU cannot run
+int memops_variant(int index, const memops_t** ops);
+
+// Copies and clears at least this large use non-temporal stores
+size_t memops_nt_threshold(void);
+
+// Portable versions in string.c
+void* memcpy_generic(void* dest, const void* src, size_t n);
+void* memset_generic(void* s, int c, size_t n);
+int memcmp_generic(const void* s1, const void* s2, size_t n);
+void* memchr_generic(const void* s, int c, size_t n);
+size_t strlen_generic(const char* s);
+
+#endif
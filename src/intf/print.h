@@ -1,10 +1,16 @@
 #ifndef PRINT_H
 #define PRINT_H
 
+#include <stddef.h>
+
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
 #define VGA_BUFFER 0xB8000
 
+// Virtual consoles, switched with Alt+F1 .. Alt+F4. The last one shows klog.
+#define PRINT_CONSOLES 4
+#define PRINT_LOG_CONSOLE (PRINT_CONSOLES - 1)
+
 enum {
     PRINT_COLOR_BLACK = 0,
     PRINT_COLOR_BLUE = 1,
@@ -27,6 +33,7 @@ enum {
 void print_clear();
 void print_char(char character);
 void print_str(const char* string);
+void print_write(const char* s, size_t n);
 void print_set_color(int foreground, int background);
 void print_set_cursor(int x, int y);
 void print_enable_cursor(int cursor_start, int cursor_end);
@@ -37,5 +44,35 @@ char print_char_at(int x, int y, char c);
 char print_get_char(int x, int y);
 void print_get_cursor(int *x, int *y);
 
+// Output lands in a RAM copy of the screen; this copies the changed lines
+// to VGA memory and moves the hardware cursor. Called whenever a CPU goes
+// idle, so code that waits for input or sleeps never needs to call it.
+void print_flush();
+// Blank `count` cells from (x, y) on, or scroll the lines from `top` down
+// up by one and blank the last; neither moves the cursor. Scrolling is
+// done with the CRTC start address, so it costs one line, not a screen.
+void print_fill(int x, int y, int count, int foreground, int background);
+void print_scroll(int top, int foreground, int background);
+// Output that runs off the bottom scrolls the lines from `top` down
+void print_set_scroll_top(int top);
+// Pull the view back into the lines that scrolled off (negative goes
+// forward again, toward the live screen). Output keeps going to the screen
+// meanwhile. Returns how many lines back the view now is, 0 for live.
+int print_scrollback(int lines);
+void print_scrollback_end();
+
+// Everything above draws on the calling thread's console, which threads
+// inherit from whoever created them. Keys go to the visible console, and
+// scrollback moves the visible console's view.
+int print_console();
+void print_set_console(int console);
+int print_visible_console();
+// Safe from interrupt handlers; the screen changes at the next flush
+void print_show_console(int console);
+// Write to any console, '\n' starting a new line. Does not touch the
+// caller's cursor or color, and output to a hidden console never reaches
+// VGA memory until it is shown. Safe from interrupt handlers.
+void print_console_write(int console, const char* s, size_t n);
+
 
 #endif
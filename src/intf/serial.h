@@ -0,0 +1,32 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SERIAL_BAUD 115200
+#define SERIAL_TX_BUFFER 16384 // Bytes queued for COM1; must be a power of two
+
+typedef struct {
+    uint64_t tx_bytes;
+    uint64_t tx_interrupts; // THR-empty interrupts, each refilling the 16 byte FIFO
+    uint64_t tx_rejected; // Writes turned away because the ring was full
+    uint64_t rx_bytes;
+} serial_stats_t;
+
+// Set up COM1 for 115200 8N1 with its FIFOs and interrupts on. Returns
+// -1, and the console stays VGA only, if there is no 16550 there.
+int serial_init(void);
+int serial_present(void);
+
+// Queue all of s for transmission, or none of it if the ring is short of
+// room, in which case it returns -1. Never waits for the UART: the
+// THR-empty interrupt moves the ring into the FIFO.
+int serial_write(const char* s, size_t n);
+// Push out what is queued by polling, for a CPU that is about to halt
+// with interrupts off
+void serial_drain(void);
+
+void serial_get_stats(serial_stats_t* stats);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+#define SMP_MAX_CPUS 16
+#define SMP_WAKE_VECTOR 0x32 // IPI that kicks a parked CPU out of hlt
+#define SMP_AP_STACK_SIZE (16 * 1024)
+
+struct thread;
+
+typedef void (*smp_work_t)(void* arg);
+
+// Per-CPU data, reached through the GS base
+typedef struct cpu_local {
+    struct cpu_local* self; // At %gs:0 so this_cpu() is a single load
+    uint32_t index;
+    uint32_t apic_id;
+    struct thread* thread; // Running thread; NULL on CPUs outside the scheduler
+    volatile int online;
+    // Work handed to a parked AP; cleared by the AP when done
+    volatile smp_work_t work;
+    void* volatile work_arg;
+    uint64_t work_done;
+    uint64_t idle_cycles;
+    uint64_t halt_count;
+    void* stack;
+} cpu_local_t;
+
+static inline cpu_local_t* this_cpu(void) {
+    cpu_local_t* cpu;
+    __asm__ volatile("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Set up the boot CPU's per-CPU block; must run before interrupts are on
+void smp_init_bsp(void);
+
+// Start every other CPU listed in the MADT; returns how many CPUs are online
+uint32_t smp_start_aps(void);
+
+uint32_t smp_cpu_count(void);
+cpu_local_t* smp_cpu(uint32_t index);
+
+// Hand fn(arg) to a parked AP; call from the boot CPU. Returns -1 if the
+// CPU is offline or still busy with earlier work.
+int smp_run_on(uint32_t index, smp_work_t fn, void* arg);
+int smp_cpu_busy(uint32_t index);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include "interrupts.h"
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+// Interrupts stay off while the lock is held so an interrupt handler on
+// the same CPU can never spin on a lock its own thread holds
+static inline uint64_t spin_lock_irqsave(spinlock_t* lock) {
+    uint64_t flags = irq_save();
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+            __asm__ volatile("pause");
+        }
+    }
+    return flags;
+}
+
+// Returns 0 without waiting if someone else holds the lock
+static inline int spin_trylock_irqsave(spinlock_t* lock, uint64_t* flags) {
+    *flags = irq_save();
+    if (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        irq_restore(*flags);
+        return 0;
+    }
+    return 1;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) {
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+    irq_restore(flags);
+}
+
+#endif
@@ -1,9 +0,0 @@
-#ifndef SPRINTF_H
-#define SPRINTF_H
-
-#include <stddef.h>
-
-
-int sprintf(char* buffer, const char* format, ...);
-
-#endif 
@@ -0,0 +1,25 @@
+#ifndef STDIO_H
+#define STDIO_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+// The one formatter. Supports the flags - + space # 0, width and
+// precision (also as *), the length modifiers hh h l ll z t j and the
+// conversions d i u x X o c s p %. Returns the length the full output
+// would have, as C99 does, even when it was cut short.
+int vsnprintf(char *buffer, size_t size, const char *format, va_list args);
+int snprintf(char *buffer, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+int sprintf(char *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Format into a line buffer and hand it to the console in one write, at
+// the cursor and in the color print_* use
+int vkprintf(const char *format, va_list args);
+int kprintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// One timestamped line on the log console (Alt+F4), whatever console the
+// caller draws on; the newline is added. Safe from interrupt handlers.
+// Anything past two screen lines is cut.
+int klog(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
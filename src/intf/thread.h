@@ -0,0 +1,102 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include "interrupts.h"
+#include "timer.h"
+
+#define THREAD_YIELD_VECTOR 0x31 // Software interrupt used to enter the scheduler
+#define THREAD_STACK_SIZE (16 * 1024)
+#define THREAD_SLICE_MS 10 // Round-robin slice among equal-priority threads
+
+// Higher numbers run first; idle only runs when nothing else can
+#define THREAD_PRIORITIES 32
+#define THREAD_PRIORITY_IDLE 0
+#define THREAD_PRIORITY_LOW 8
+#define THREAD_PRIORITY_NORMAL 16
+#define THREAD_PRIORITY_HIGH 24
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+} thread_state_t;
+
+typedef void (*thread_entry_t)(void* arg);
+
+typedef struct thread {
+    interrupt_frame_t* frame; // Saved context while switched out
+    struct thread* next; // Run queue or wait list link
+    struct thread* all_next;
+    struct thread* joiner;
+    thread_entry_t entry;
+    void* arg;
+    uint8_t* stack; // THREAD_STACK_SIZE bytes above a guard page
+    void* fpu_state; // Saved FPU/SSE/AVX registers, see fpu.c
+    const char* name;
+    uint32_t id;
+    int priority;
+    thread_state_t state;
+    int detached;
+    int console; // Where its print_* output goes; inherited from the creator
+    uint64_t ready_since; // TSC when the thread last became ready
+    uint64_t run_start; // TSC when the thread was last switched in
+    uint64_t run_cycles;
+    uint64_t switches_in;
+    uint64_t max_wakeup_ns;
+} thread_t;
+
+// Sleeping lock for long sections such as disk I/O: waiters block
+// instead of spinning and are handed the lock in arrival order. Not for
+// interrupt handlers. Before thread_init() there is only one context, so
+// it never waits.
+typedef struct {
+    struct thread* owner;
+    struct thread* waiters;
+    struct thread* waiters_tail;
+} mutex_t;
+
+#define MUTEX_INIT { 0, 0, 0 }
+
+typedef struct {
+    uint64_t switches;
+    uint64_t preemptions; // Switches away from a thread that was still runnable
+    uint64_t switch_cycles; // Total time spent picking and installing the next thread
+    uint64_t wakeups;
+    uint64_t wakeup_ns_total; // Ready-to-running latency
+    uint64_t wakeup_ns_max;
+} thread_stats_t;
+
+// Turn the boot context into the first thread and start the idle thread
+void thread_init(void);
+
+// Returns NULL if no stack could be allocated
+thread_t* thread_create(const char* name, thread_entry_t entry, void* arg, int priority);
+void thread_yield(void);
+void thread_exit(void);
+// Wait for a thread to finish and free it
+void thread_join(thread_t* thread);
+// Free the thread by itself when it finishes; it must not be joined
+void thread_detach(thread_t* thread);
+thread_t* thread_current(void);
+
+// Block the current thread until the next hardware interrupt. Returns -1
+// without blocking when called before thread_init() or from the idle
+// thread; the caller should then halt itself. Interrupts must be disabled.
+int thread_wait_interrupt(void);
+
+// Called by the interrupt path on the way out; returns the frame to resume
+interrupt_frame_t* thread_interrupt_exit(interrupt_frame_t* frame);
+
+void thread_get_stats(thread_stats_t* stats);
+uint64_t thread_cpu_time_ns(const thread_t* thread);
+// CPU time of the idle thread, i.e. time spent halted since thread_init()
+uint64_t thread_idle_time_ns(void);
+// Walk all live threads, e.g. for a listing
+thread_t* thread_first(void);
+
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_TICK_NS 1000000ULL // Wheel resolution: 1 ms
+
+typedef void (*timer_callback_t)(void* data);
+
+// Caller-owned timer; zero-initialize before first use. Callbacks run in
+// interrupt context with interrupts disabled, so they should only set
+// flags or do short bookkeeping.
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer* prev;
+    uint64_t expires; // Absolute, in wheel ticks since boot
+    uint64_t period; // Ticks between runs, 0 for one-shot
+    timer_callback_t callback;
+    void* data;
+    uint8_t state;
+    uint8_t level;
+    uint8_t slot;
+} ktimer_t;
+
+// Bring up the LAPIC timer. Returns -1 if there is no timer hardware.
+int timer_init(void);
+
+// (Re)arm a timer, cancelling it first if it is pending. Return -1 if the
+// timer hardware is unavailable.
+int timer_start(ktimer_t* timer, uint32_t delay_ms, timer_callback_t callback, void* data);
+int timer_start_periodic(ktimer_t* timer, uint32_t period_ms, timer_callback_t callback, void* data);
+void timer_cancel(ktimer_t* timer);
+int timer_pending(const ktimer_t* timer);
+
+// Number of timer interrupts taken; stays flat while nothing is scheduled
+uint64_t timer_interrupt_count(void);
+
+#endif
@@ -4,7 +4,8 @@
 #include <stdint.h>
 
 void sleep(unsigned int seconds);
+void msleep(unsigned int milliseconds);
 void usleep(unsigned int microseconds);
 void yield(void);
 
-#endif 
+#endif
@@ -0,0 +1,25 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORKPOOL_DEQUE_SIZE 256 // Per-worker task slots, power of two
+
+typedef void (*parallel_fn_t)(size_t begin, size_t end, void* arg);
+
+typedef struct {
+    uint64_t executed; // Chunks run by this worker
+    uint64_t iterations;
+    uint64_t steals; // Chunks taken from another worker's deque
+    uint64_t failed_steals; // Victim was empty or another thief won
+} workpool_stats_t;
+
+// Run fn over [begin, end) in chunks of at most grain iterations, spread
+// over every online CPU. Returns once all chunks are done. Runs serially
+// when there is one CPU, the range is small, or a job is already running.
+void parallel_for(size_t begin, size_t end, size_t grain, parallel_fn_t fn, void* arg);
+
+void workpool_get_stats(uint32_t worker, workpool_stats_t* stats);
+
+#endif
@@ -1,74 +1,821 @@
 #include "memory.h"
+#include "page_alloc.h"
+#include "vmm.h"
+#include "spinlock.h"
+#include "string.h"
 #include <stddef.h>
 
-static uint8_t heap[HEAP_SIZE]; 
-static uint32_t free_blocks = HEAP_SIZE / BLOCK_SIZE; 
-static Block* free_list = (Block*)heap; 
+// Requests up to KMALLOC_MAX_SMALL bytes come from per-size-class slabs:
+// naturally aligned buddy blocks with a small header and a free list
+// threaded through the free objects, so alloc and free are O(1) and carry
+// no per-object header. Larger requests get whole buddy blocks. Every page
+// is tagged in the page allocator, so kfree finds the slab or block from
+// the address alone.
 
-void init_memory() {
-    free_blocks = HEAP_SIZE / BLOCK_SIZE;
+#define SLAB_HEADER_SIZE 64 // One cache line, keeps objects 64-byte aligned from 64 B up
+#define SLAB_MIN_OBJECTS 7
 
-    free_list->size = free_blocks; 
-    free_list->next = NULL; 
+typedef struct free_object {
+    struct free_object* next;
+} free_object_t;
+
+typedef struct slab {
+    struct slab* next; // Partial list of the class
+    struct slab* prev;
+    free_object_t* free;
+    uint16_t in_use;
+    uint16_t capacity;
+    uint8_t size_class;
+    uint8_t on_partial;
+} slab_t;
+
+typedef struct {
+    uint32_t object_size;
+    uint32_t slab_order;
+    uint32_t objects_offset; // Header, plus the profile's site indices
+    uint32_t capacity;
+    slab_t* partial; // Slabs with at least one free object
+    slab_t* empty; // One fully free slab kept back to absorb alloc/free churn
+    kmalloc_class_stats_t stats;
+} size_class_t;
+
+static size_class_t classes[KMALLOC_CLASS_COUNT];
+static uint64_t large_blocks = 0;
+static uint64_t large_pages = 0;
+static kmalloc_usage_t usage;
+static uint64_t usable_bytes = 0;
+static spinlock_t heap_lock = SPINLOCK_INIT;
+
+#ifdef KMALLOC_PROFILE
+// Heap profile. Callsites live in a fixed open-addressed hash table; each
+// slab keeps a 16-bit site index per object between its header and its
+// objects, and large blocks are found in a second hash table keyed by
+// page number, so kfree can charge the free to the site that made the
+// allocation without a scan.
+
+#define PROFILE_SITES 256 // Power of two
+#define PROFILE_LARGE_BLOCKS 512 // Power of two
+#define PROFILE_LARGE_MAX (PROFILE_LARGE_BLOCKS * 3 / 4) // Keeps probe runs short
+#define SITE_NONE 0xFFFF
+
+typedef struct {
+    uintptr_t address;
+    uint16_t site;
+} large_site_t;
+
+static kmalloc_site_t sites[PROFILE_SITES];
+static uint32_t site_count = 0;
+static large_site_t large_sites[PROFILE_LARGE_BLOCKS];
+static uint32_t large_site_count = 0;
+static uint64_t histogram[KMALLOC_HISTOGRAM_BUCKETS];
+static uint64_t requested_bytes = 0;
+static uint64_t granted_bytes = 0;
+static uint64_t untracked = 0;
+
+// Callers of the profile functions hold heap_lock
+static uint16_t site_index(uintptr_t caller) {
+    uint32_t slot = (uint32_t)((caller * 0x9E3779B97F4A7C15ULL) >> 56) & (PROFILE_SITES - 1);
+    for (int probe = 0; probe < PROFILE_SITES; probe++) {
+        kmalloc_site_t* site = &sites[slot];
+        if (site->caller == caller) {
+            return slot;
+        }
+        if (!site->caller) {
+            site->caller = caller;
+            site_count++;
+            return slot;
+        }
+        slot = (slot + 1) & (PROFILE_SITES - 1);
+    }
+    return SITE_NONE;
 }
 
-void* kmalloc(size_t size) {
-    Block* current = free_list;
-    Block* prev = NULL;
-    size_t required_blocks = (size + sizeof(Block) + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-    if (required_blocks > free_blocks) {
-        return NULL; 
-    }
-
-    while (current) {
-        if (current->size >= required_blocks) {
-            if (current->size > required_blocks) {
-                Block* new_block = (Block*)((uint8_t*)current + required_blocks * BLOCK_SIZE);
-                new_block->size = current->size - required_blocks;
-                new_block->next = current->next;
-                current->size = required_blocks;
-                current->next = new_block;
-            }
+static uint16_t* slab_object_site(slab_t* slab, const void* ptr) {
+    const size_class_t* class = &classes[slab->size_class];
+    uint32_t index = ((const uint8_t*)ptr - (const uint8_t*)slab - class->objects_offset) / class->object_size;
+    return (uint16_t*)((uint8_t*)slab + SLAB_HEADER_SIZE) + index;
+}
+
+static uint32_t large_slot(uintptr_t address) {
+    return (uint32_t)(((address >> PAGE_SHIFT) * 0x9E3779B97F4A7C15ULL) >> 55) & (PROFILE_LARGE_BLOCKS - 1);
+}
+
+// The entry for address, or the free slot it would go in. The table is
+// never full, so the probe always ends.
+static large_site_t* large_site(uintptr_t address) {
+    uint32_t slot = large_slot(address);
+    while (large_sites[slot].address && large_sites[slot].address != address) {
+        slot = (slot + 1) & (PROFILE_LARGE_BLOCKS - 1);
+    }
+    return &large_sites[slot];
+}
+
+// Linear probing without tombstones: later entries of the run move back
+// into the hole when their home slot allows it
+static void large_site_remove(large_site_t* entry) {
+    uint32_t hole = entry - large_sites;
+    uint32_t slot = hole;
+    for (;;) {
+        slot = (slot + 1) & (PROFILE_LARGE_BLOCKS - 1);
+        if (!large_sites[slot].address) {
+            break;
+        }
+        uint32_t home = large_slot(large_sites[slot].address);
+        if (((slot - home) & (PROFILE_LARGE_BLOCKS - 1)) >= ((slot - hole) & (PROFILE_LARGE_BLOCKS - 1))) {
+            large_sites[hole] = large_sites[slot];
+            hole = slot;
+        }
+    }
+    large_sites[hole].address = 0;
+    large_site_count--;
+}
+
+static void site_charge(uint16_t index, int64_t bytes) {
+    if (index == SITE_NONE) {
+        return;
+    }
+    kmalloc_site_t* site = &sites[index];
+    site->live_bytes += bytes;
+    if (site->live_bytes > site->peak_bytes) {
+        site->peak_bytes = site->live_bytes;
+    }
+}
+
+static void profile_alloc(void* ptr, size_t requested, size_t granted, const void* caller) {
+    int bucket = 0;
+    while (bucket < KMALLOC_HISTOGRAM_BUCKETS - 1 && requested > ((size_t)KMALLOC_MIN_SIZE << bucket)) {
+        bucket++;
+    }
+    histogram[bucket]++;
+    requested_bytes += requested;
+    granted_bytes += granted;
+
+    uint16_t index = site_index((uintptr_t)caller);
+    if (granted <= KMALLOC_MAX_SMALL) {
+        unsigned order;
+        page_owner((uintptr_t)ptr, &order);
+        slab_t* slab = (slab_t*)((uintptr_t)ptr & ~((uintptr_t)(PAGE_SIZE << order) - 1));
+        *slab_object_site(slab, ptr) = index;
+    } else {
+        if (large_site_count < PROFILE_LARGE_MAX) {
+            large_site_t* entry = large_site((uintptr_t)ptr);
+            entry->address = (uintptr_t)ptr;
+            entry->site = index;
+            large_site_count++;
+        } else {
+            index = SITE_NONE;
+        }
+    }
+
+    if (index == SITE_NONE) {
+        untracked++;
+        return;
+    }
+    sites[index].allocs++;
+    site_charge(index, granted);
+}
+
+static void profile_free(void* ptr, size_t granted, slab_t* slab) {
+    uint16_t index = SITE_NONE;
+    if (slab) {
+        index = *slab_object_site(slab, ptr);
+    } else {
+        large_site_t* entry = large_site((uintptr_t)ptr);
+        if (entry->address) {
+            index = entry->site;
+            large_site_remove(entry);
+        }
+    }
+    if (index != SITE_NONE) {
+        sites[index].frees++;
+        site_charge(index, -(int64_t)granted);
+    }
+}
+
+// A large block grew in place
+static void profile_grow(void* ptr, size_t bytes) {
+    large_site_t* entry = large_site((uintptr_t)ptr);
+    if (entry->address) {
+        site_charge(entry->site, bytes);
+    }
+}
+#else
+static inline void profile_alloc(void* ptr, size_t requested, size_t granted, const void* caller) {
+    (void)ptr;
+    (void)requested;
+    (void)granted;
+    (void)caller;
+}
+static inline void profile_free(void* ptr, size_t granted, slab_t* slab) {
+    (void)ptr;
+    (void)granted;
+    (void)slab;
+}
+static inline void profile_grow(void* ptr, size_t bytes) {
+    (void)ptr;
+    (void)bytes;
+}
+#endif
 
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                free_list = current->next;
+void init_memory(const boot_info_t* info) {
+    usable_bytes = info->usable_memory;
+    page_alloc_init(info);
+    vmm_init(info);
+
+    for (int i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+        size_class_t* class = &classes[i];
+        class->object_size = KMALLOC_MIN_SIZE << i;
+        class->slab_order = 0;
+        while (((PAGE_SIZE << class->slab_order) - SLAB_HEADER_SIZE) / class->object_size < SLAB_MIN_OBJECTS) {
+            class->slab_order++;
+        }
+        class->objects_offset = SLAB_HEADER_SIZE;
+#ifdef KMALLOC_PROFILE
+        uint32_t objects = ((PAGE_SIZE << class->slab_order) - SLAB_HEADER_SIZE) / class->object_size;
+        class->objects_offset += (objects * sizeof(uint16_t) + SLAB_HEADER_SIZE - 1) & ~(SLAB_HEADER_SIZE - 1);
+#endif
+        class->capacity = ((PAGE_SIZE << class->slab_order) - class->objects_offset) / class->object_size;
+        class->partial = NULL;
+        class->empty = NULL;
+        class->stats.object_size = class->object_size;
+    }
+}
+
+// Callers hold heap_lock
+static void account_alloc(uint64_t bytes) {
+    usage.allocs++;
+    usage.live_bytes += bytes;
+    if (usage.live_bytes > usage.peak_bytes) {
+        usage.peak_bytes = usage.live_bytes;
+    }
+}
+
+static void account_free(uint64_t bytes) {
+    usage.frees++;
+    usage.live_bytes -= bytes;
+}
+
+static int size_to_class(size_t size) {
+    int index = 0;
+    while ((size_t)(KMALLOC_MIN_SIZE << index) < size) {
+        index++;
+    }
+    return index;
+}
+
+static void partial_push(size_class_t* class, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = class->partial;
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    class->partial = slab;
+    slab->on_partial = 1;
+}
+
+static void partial_remove(size_class_t* class, slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        class->partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->on_partial = 0;
+}
+
+static slab_t* slab_create(size_class_t* class, int index) {
+    uint64_t address = page_alloc(class->slab_order);
+    if (!address) {
+        return NULL;
+    }
+    page_set_owner(address, class->slab_order, PAGE_OWNER_SLAB);
+
+    slab_t* slab = (slab_t*)(uintptr_t)address;
+    slab->size_class = index;
+    slab->in_use = 0;
+    slab->capacity = class->capacity;
+    slab->free = NULL;
+
+    // Thread the list back to front so objects are handed out in address order
+    uint8_t* objects = (uint8_t*)slab + class->objects_offset;
+    for (int i = slab->capacity - 1; i >= 0; i--) {
+        free_object_t* object = (free_object_t*)(objects + i * class->object_size);
+        object->next = slab->free;
+        slab->free = object;
+    }
+
+    class->stats.slabs++;
+    class->stats.free_objects += slab->capacity;
+    return slab;
+}
+
+static void* small_alloc(int index) {
+    size_class_t* class = &classes[index];
+    slab_t* slab = class->partial;
+
+    if (!slab) {
+        slab = class->empty;
+        class->empty = NULL;
+        if (!slab) {
+            slab = slab_create(class, index);
+            if (!slab) {
+                return NULL;
             }
+        }
+        partial_push(class, slab);
+    }
+
+    free_object_t* object = slab->free;
+    slab->free = object->next;
+    slab->in_use++;
+    if (!slab->free) {
+        partial_remove(class, slab);
+    }
+
+    class->stats.active_objects++;
+    class->stats.free_objects--;
+    return object;
+}
+
+static void small_free(slab_t* slab, void* ptr) {
+    size_class_t* class = &classes[slab->size_class];
+    free_object_t* object = ptr;
+
+    object->next = slab->free;
+    slab->free = object;
+    slab->in_use--;
+    class->stats.active_objects--;
+    class->stats.free_objects++;
 
-            free_blocks -= required_blocks;
-            return (void*)((uint8_t*)current + sizeof(Block));
+    if (!slab->on_partial) {
+        partial_push(class, slab);
+    }
+    if (slab->in_use == 0) {
+        partial_remove(class, slab);
+        if (!class->empty) {
+            class->empty = slab;
+            return;
+        }
+        class->stats.slabs--;
+        class->stats.free_objects -= slab->capacity;
+        page_free((uintptr_t)slab, class->slab_order);
+    }
+}
+
+void* kmalloc_track_caller(size_t size, const void* caller) {
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (size <= KMALLOC_MAX_SMALL) {
+        uint64_t flags = spin_lock_irqsave(&heap_lock);
+        int index = size_to_class(size);
+        void* ptr = small_alloc(index);
+        if (ptr) {
+            account_alloc(classes[index].object_size);
+            profile_alloc(ptr, size, classes[index].object_size, caller);
         }
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return ptr;
+    }
 
-        prev = current;
-        current = current->next;
+    unsigned order = 0;
+    while ((size_t)(PAGE_SIZE << order) < size) {
+        if (++order > PAGE_MAX_ORDER) {
+            return NULL;
+        }
     }
+    uint64_t address = page_alloc(order);
+    if (!address) {
+        return NULL;
+    }
+    page_set_owner(address, order, PAGE_OWNER_LARGE);
+
+    uint64_t flags = spin_lock_irqsave(&heap_lock);
+    large_blocks++;
+    large_pages += 1ULL << order;
+    account_alloc(PAGE_SIZE << order);
+    profile_alloc((void*)(uintptr_t)address, size, PAGE_SIZE << order, caller);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return (void*)(uintptr_t)address;
+}
 
-    return NULL; 
+void* kmalloc(size_t size) {
+    return kmalloc_track_caller(size, __builtin_return_address(0));
 }
 
 void kfree(void* ptr) {
-    Block* block = (Block*)((uint8_t*)ptr - sizeof(Block)); 
-    Block* current = free_list;
-    Block* prev = NULL;
+    if (!ptr) {
+        return;
+    }
+
+    unsigned order;
+    uint64_t address = (uintptr_t)ptr;
+    uint8_t owner = page_owner(address, &order);
+    // Slabs and large blocks are buddy blocks, so naturally aligned
+    uint64_t base = address & ~((uint64_t)(PAGE_SIZE << order) - 1);
+
+    if (owner == PAGE_OWNER_SLAB) {
+        uint64_t flags = spin_lock_irqsave(&heap_lock);
+        slab_t* slab = (slab_t*)(uintptr_t)base;
+        account_free(classes[slab->size_class].object_size);
+        profile_free(ptr, classes[slab->size_class].object_size, slab);
+        small_free(slab, ptr);
+        spin_unlock_irqrestore(&heap_lock, flags);
+    } else if (owner == PAGE_OWNER_LARGE && base == address) {
+        uint64_t flags = spin_lock_irqsave(&heap_lock);
+        large_blocks--;
+        large_pages -= 1ULL << order;
+        account_free(PAGE_SIZE << order);
+        profile_free(ptr, PAGE_SIZE << order, NULL);
+        spin_unlock_irqrestore(&heap_lock, flags);
+        page_free(address, order);
+    }
+}
+
+// Bytes actually reserved for ptr: its slot size or its whole block
+size_t ksize(const void* ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    unsigned order;
+    uint64_t address = (uintptr_t)ptr;
+    uint8_t owner = page_owner(address, &order);
+    if (owner == PAGE_OWNER_SLAB) {
+        const slab_t* slab = (const slab_t*)(uintptr_t)(address & ~((uint64_t)(PAGE_SIZE << order) - 1));
+        return classes[slab->size_class].object_size;
+    }
+    if (owner == PAGE_OWNER_LARGE) {
+        return PAGE_SIZE << order;
+    }
+    return 0;
+}
+
+void* krealloc_track_caller(void* ptr, size_t size, const void* caller) {
+    if (!ptr) {
+        return kmalloc_track_caller(size, caller);
+    }
+    if (size == 0) {
+        kfree(ptr);
+        return NULL;
+    }
+
+    // Still fits its slot or block: nothing to move
+    size_t old_size = ksize(ptr);
+    if (size <= old_size) {
+        uint64_t flags = spin_lock_irqsave(&heap_lock);
+        usage.realloc_in_place++;
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return ptr;
+    }
+
+    // A large block grows in place while its upper buddy is free
+    unsigned order;
+    uint64_t address = (uintptr_t)ptr;
+    if (page_owner(address, &order) == PAGE_OWNER_LARGE && size > KMALLOC_MAX_SMALL) {
+        unsigned grown = order;
+        while ((size_t)(PAGE_SIZE << grown) < size && page_extend(address, grown) == 0) {
+            grown++;
+        }
+        if (grown != order) {
+            page_set_owner(address, grown, PAGE_OWNER_LARGE);
+            uint64_t flags = spin_lock_irqsave(&heap_lock);
+            large_pages += (1ULL << grown) - (1ULL << order);
+            usage.live_bytes += (PAGE_SIZE << grown) - (PAGE_SIZE << order);
+            if (usage.live_bytes > usage.peak_bytes) {
+                usage.peak_bytes = usage.live_bytes;
+            }
+            profile_grow(ptr, (PAGE_SIZE << grown) - (PAGE_SIZE << order));
+            spin_unlock_irqrestore(&heap_lock, flags);
+        }
+        if ((size_t)(PAGE_SIZE << grown) >= size) {
+            uint64_t flags = spin_lock_irqsave(&heap_lock);
+            usage.realloc_in_place++;
+            spin_unlock_irqrestore(&heap_lock, flags);
+            return ptr;
+        }
+    }
+
+    void* new_ptr = kmalloc_track_caller(size, caller);
+    if (!new_ptr) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, ksize(ptr) < size ? ksize(ptr) : size);
+    kfree(ptr);
+
+    uint64_t flags = spin_lock_irqsave(&heap_lock);
+    usage.realloc_moved++;
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return new_ptr;
+}
+
+void* krealloc(void* ptr, size_t size) {
+    return krealloc_track_caller(ptr, size, __builtin_return_address(0));
+}
 
-    while (current && current < block) {
-        prev = current;
-        current = current->next;
+// Whole pages are cleared eight bytes at a time; small slots use memset
+void* kcalloc_track_caller(size_t count, size_t size, const void* caller) {
+    if (size && count > (size_t)-1 / size) {
+        return NULL;
+    }
+    size_t total = count * size;
+    void* ptr = kmalloc_track_caller(total, caller);
+    if (!ptr) {
+        return NULL;
     }
 
-    if (prev && (uint8_t*)prev + prev->size * BLOCK_SIZE == (uint8_t*)block) {
-        prev->size += block->size;
-        prev->next = block->next;
+    if (total > KMALLOC_MAX_SMALL) {
+        size_t quads = (total + 7) / 8;
+        void* dest = ptr;
+        __asm__ volatile("rep stosq" : "+D"(dest), "+c"(quads) : "a"(0ULL) : "memory");
     } else {
-        block->next = current;
-        if (prev) {
-            prev->next = block;
+        memset(ptr, 0, total);
+    }
+
+    uint64_t flags = spin_lock_irqsave(&heap_lock);
+    usage.callocs++;
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return ptr;
+}
+
+void* kcalloc(size_t count, size_t size) {
+    return kcalloc_track_caller(count, size, __builtin_return_address(0));
+}
+
+void kmalloc_get_stats(kmalloc_stats_t* stats) {
+    uint64_t flags = spin_lock_irqsave(&heap_lock);
+    stats->slab_pages = 0;
+    for (int i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+        stats->classes[i] = classes[i].stats;
+        stats->slab_pages += classes[i].stats.slabs << classes[i].slab_order;
+    }
+    stats->large_blocks = large_blocks;
+    stats->large_pages = large_pages;
+    stats->usage = usage;
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
+
+int kmalloc_get_profile(kmalloc_profile_t* profile) {
+#ifdef KMALLOC_PROFILE
+    memset(profile, 0, sizeof(kmalloc_profile_t));
+    uint64_t flags = spin_lock_irqsave(&heap_lock);
+    memcpy(profile->histogram, histogram, sizeof(histogram));
+    profile->requested_bytes = requested_bytes;
+    profile->granted_bytes = granted_bytes;
+    profile->untracked = untracked;
+    profile->site_count = site_count;
+
+    // Insertion into a short sorted list is plenty for KMALLOC_PROFILE_TOP
+    int count = 0;
+    for (int i = 0; i < PROFILE_SITES; i++) {
+        const kmalloc_site_t* site = &sites[i];
+        if (!site->caller) {
+            continue;
+        }
+        int slot = count < KMALLOC_PROFILE_TOP ? count++ : KMALLOC_PROFILE_TOP;
+        while (slot > 0 && profile->top[slot - 1].live_bytes < site->live_bytes) {
+            if (slot < KMALLOC_PROFILE_TOP) {
+                profile->top[slot] = profile->top[slot - 1];
+            }
+            slot--;
+        }
+        if (slot < KMALLOC_PROFILE_TOP) {
+            profile->top[slot] = *site;
+        }
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return 0;
+#else
+    (void)profile;
+    return -1;
+#endif
+}
+
+// Object caches. Each slab is a kmalloc block of PAGE_SIZE << slab_order
+// bytes, which is a naturally aligned buddy block, so an object finds its
+// slab by masking its address. The free link lives just past the object,
+// not inside it, so a freed object keeps its constructed state and the
+// next kmem_cache_alloc hands it straight back, still warm in cache.
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct cache_slab {
+    struct cache_slab* next; // Partial list of the cache
+    struct cache_slab* prev;
+    void* free; // Most recently freed object first
+    uint16_t in_use;
+    uint16_t capacity;
+    uint8_t on_partial;
+} cache_slab_t;
+
+struct kmem_cache {
+    const char* name;
+    kmem_ctor_t ctor;
+    uint32_t object_size;
+    uint32_t link_offset;
+    uint32_t slot_size;
+    uint32_t slab_order;
+    uint32_t capacity;
+    uint32_t colors;
+    uint32_t next_color;
+    cache_slab_t* partial;
+    cache_slab_t* empty; // One fully free slab kept back, like the size classes
+    uint64_t slabs;
+    uint64_t active_objects;
+    spinlock_t lock;
+    struct kmem_cache* next;
+};
+
+static kmem_cache_t* caches = NULL;
+static spinlock_t caches_lock = SPINLOCK_INIT;
+
+static void** object_link(kmem_cache_t* cache, void* object) {
+    return (void**)((uint8_t*)object + cache->link_offset);
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor_t ctor) {
+    if (align == 0) {
+        align = sizeof(void*);
+    }
+    if (size == 0 || (align & (align - 1)) || align > CACHE_LINE_SIZE) {
+        return NULL;
+    }
+
+    kmem_cache_t* cache = kmalloc(sizeof(kmem_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(kmem_cache_t));
+    cache->name = name;
+    cache->ctor = ctor;
+    cache->object_size = size;
+    cache->link_offset = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    cache->slot_size = (cache->link_offset + sizeof(void*) + align - 1) & ~(align - 1);
+
+    size_t usable;
+    while ((usable = (PAGE_SIZE << cache->slab_order) - SLAB_HEADER_SIZE) / cache->slot_size < SLAB_MIN_OBJECTS) {
+        if (cache->slab_order == PAGE_MAX_ORDER) {
+            break;
+        }
+        cache->slab_order++;
+    }
+    cache->capacity = usable / cache->slot_size;
+    if (cache->capacity == 0) {
+        kfree(cache);
+        return NULL;
+    }
+    // The space the objects leave over shifts each new slab by another
+    // cache line, so equal offsets in different slabs use different sets
+    cache->colors = (usable - cache->capacity * cache->slot_size) / CACHE_LINE_SIZE + 1;
+
+    uint64_t flags = spin_lock_irqsave(&caches_lock);
+    cache->next = caches;
+    caches = cache;
+    spin_unlock_irqrestore(&caches_lock, flags);
+    return cache;
+}
+
+static void cache_partial_push(kmem_cache_t* cache, cache_slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    cache->partial = slab;
+    slab->on_partial = 1;
+}
+
+static void cache_partial_remove(kmem_cache_t* cache, cache_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->on_partial = 0;
+}
+
+// Called without the cache lock: the constructor may allocate
+static cache_slab_t* cache_slab_create(kmem_cache_t* cache, uint32_t color) {
+    cache_slab_t* slab = kmalloc(PAGE_SIZE << cache->slab_order);
+    if (!slab) {
+        return NULL;
+    }
+    slab->in_use = 0;
+    slab->capacity = cache->capacity;
+    slab->on_partial = 0;
+    slab->free = NULL;
+
+    uint8_t* objects = (uint8_t*)slab + SLAB_HEADER_SIZE + color * CACHE_LINE_SIZE;
+    for (int i = slab->capacity - 1; i >= 0; i--) {
+        void* object = objects + i * cache->slot_size;
+        if (cache->ctor) {
+            cache->ctor(object);
+        }
+        *object_link(cache, object) = slab->free;
+        slab->free = object;
+    }
+    return slab;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+    cache_slab_t* slab = cache->partial;
+
+    if (!slab) {
+        slab = cache->empty;
+        cache->empty = NULL;
+        if (!slab) {
+            uint32_t color = cache->next_color;
+            cache->next_color = (color + 1) % cache->colors;
+            spin_unlock_irqrestore(&cache->lock, flags);
+            slab = cache_slab_create(cache, color);
+            if (!slab) {
+                return NULL;
+            }
+            flags = spin_lock_irqsave(&cache->lock);
+            cache->slabs++;
+        }
+        cache_partial_push(cache, slab);
+    }
+
+    void* object = slab->free;
+    slab->free = *object_link(cache, object);
+    slab->in_use++;
+    if (!slab->free) {
+        cache_partial_remove(cache, slab);
+    }
+    cache->active_objects++;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return object;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* object) {
+    if (!object) {
+        return;
+    }
+
+    cache_slab_t* slab = (cache_slab_t*)((uintptr_t)object & ~((uintptr_t)(PAGE_SIZE << cache->slab_order) - 1));
+    cache_slab_t* release = NULL;
+
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+    *object_link(cache, object) = slab->free;
+    slab->free = object;
+    slab->in_use--;
+    cache->active_objects--;
+
+    if (!slab->on_partial) {
+        cache_partial_push(cache, slab);
+    }
+    if (slab->in_use == 0) {
+        cache_partial_remove(cache, slab);
+        if (!cache->empty) {
+            cache->empty = slab;
         } else {
-            free_list = block;
+            cache->slabs--;
+            release = slab;
         }
     }
+    spin_unlock_irqrestore(&cache->lock, flags);
+    kfree(release);
+}
+
+void kmem_cache_shrink(kmem_cache_t* cache) {
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+    cache_slab_t* release = cache->empty;
+    cache->empty = NULL;
+    if (release) {
+        cache->slabs--;
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+    kfree(release);
+}
+
+void kmem_cache_get_stats(kmem_cache_t* cache, kmem_cache_stats_t* stats) {
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+    stats->name = cache->name;
+    stats->object_size = cache->object_size;
+    stats->slot_size = cache->slot_size;
+    stats->slab_order = cache->slab_order;
+    stats->colors = cache->colors;
+    stats->slabs = cache->slabs;
+    stats->total_objects = cache->slabs * cache->capacity;
+    stats->active_objects = cache->active_objects;
+    stats->free_objects = stats->total_objects - cache->active_objects;
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+kmem_cache_t* kmem_cache_next(kmem_cache_t* cache) {
+    uint64_t flags = spin_lock_irqsave(&caches_lock);
+    kmem_cache_t* next = cache ? cache->next : caches;
+    spin_unlock_irqrestore(&caches_lock, flags);
+    return next;
+}
 
-    free_blocks += block->size;
+uint64_t memory_usable_bytes(void) {
+    return usable_bytes;
 }
@@ -3,17 +3,101 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "boot_info.h"
 
-#define HEAP_SIZE 0x100000 // 1 MB
-#define BLOCK_SIZE 0x1000 // 4 KB
+#define KMALLOC_MIN_SIZE 16
+#define KMALLOC_MAX_SMALL 2048 // Larger requests get whole buddy blocks
+#define KMALLOC_CLASS_COUNT 8 // 16, 32, ... 2048
 
-typedef struct Block {
-    uint32_t size; 
-    struct Block* next; 
-} Block;
+typedef struct {
+    uint32_t object_size;
+    uint64_t slabs;
+    uint64_t active_objects;
+    uint64_t free_objects; // Unused slots in this class's slabs
+} kmalloc_class_stats_t;
 
-void init_memory();
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t callocs;
+    uint64_t realloc_in_place; // Grew or shrank without copying
+    uint64_t realloc_moved;
+    uint64_t live_bytes; // Slot and block sizes, not requested sizes
+    uint64_t peak_bytes;
+} kmalloc_usage_t;
+
+#define KMALLOC_HISTOGRAM_BUCKETS 16 // Requests up to 16 B, 32 B, ... and the rest
+#define KMALLOC_PROFILE_TOP 8
+
+// Heap profile, recorded only in kernels built with KMALLOC_PROFILE
+typedef struct {
+    uintptr_t caller; // Return address of the kmalloc (or malloc) call
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+} kmalloc_site_t;
+
+typedef struct {
+    uint64_t histogram[KMALLOC_HISTOGRAM_BUCKETS];
+    uint64_t requested_bytes; // Cumulative; against granted_bytes this is
+    uint64_t granted_bytes; // the internal fragmentation of the size classes
+    uint64_t untracked; // Allocations made after the site table filled up
+    uint32_t site_count;
+    kmalloc_site_t top[KMALLOC_PROFILE_TOP]; // Most live bytes first
+} kmalloc_profile_t;
+
+typedef struct {
+    kmalloc_class_stats_t classes[KMALLOC_CLASS_COUNT];
+    uint64_t slab_pages;
+    uint64_t large_blocks;
+    uint64_t large_pages;
+    kmalloc_usage_t usage;
+} kmalloc_stats_t;
+
+// Object caches: fixed-size objects carved from slabs that are themselves
+// kmalloc blocks. The constructor runs once per object when its slab is
+// created; kmem_cache_free must hand objects back in constructed state.
+typedef struct kmem_cache kmem_cache_t;
+typedef void (*kmem_ctor_t)(void* object);
+
+typedef struct {
+    const char* name;
+    uint32_t object_size;
+    uint32_t slot_size; // Object plus free link, rounded to the alignment
+    uint32_t slab_order;
+    uint32_t colors; // Distinct cache-line offsets slabs rotate through
+    uint64_t slabs;
+    uint64_t active_objects;
+    uint64_t free_objects;
+    uint64_t total_objects;
+} kmem_cache_stats_t;
+
+void init_memory(const boot_info_t* info);
+uint64_t memory_usable_bytes(void);
 void* kmalloc(size_t size);
 void kfree(void* ptr);
+void* krealloc(void* ptr, size_t size);
+void* kcalloc(size_t count, size_t size);
+size_t ksize(const void* ptr);
+void kmalloc_get_stats(kmalloc_stats_t* stats);
+// Returns -1 when the kernel was built without KMALLOC_PROFILE
+int kmalloc_get_profile(kmalloc_profile_t* profile);
+
+// Charge the allocation to `caller` in the heap profile, so wrappers such
+// as malloc() show up as their callers
+void* kmalloc_track_caller(size_t size, const void* caller);
+void* krealloc_track_caller(void* ptr, size_t size, const void* caller);
+void* kcalloc_track_caller(size_t count, size_t size, const void* caller);
+
+// align is a power of two up to 64, 0 for pointer alignment; ctor may be NULL
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor_t ctor);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* object);
+// Return fully free slabs to kmalloc
+void kmem_cache_shrink(kmem_cache_t* cache);
+void kmem_cache_get_stats(kmem_cache_t* cache, kmem_cache_stats_t* stats);
+// Walk all caches: NULL gives the first, NULL again after the last
+kmem_cache_t* kmem_cache_next(kmem_cache_t* cache);
 
 #endif 
\ No newline at end of file
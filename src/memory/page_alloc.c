@@ -0,0 +1,327 @@
+#include "page_alloc.h"
+#include "spinlock.h"
+#include "string.h"
+
+// Buddy allocator over the usable RAM in the boot memory map. Each zone
+// keeps one free list per order; a block's buddy is found by flipping bit
+// `order` of its page frame number, so split and coalesce are O(log n).
+
+#define DMA_LIMIT 0x1000000ULL // 16 MB
+// The boot tables identity map 4 GB but make the top GB uncached for device
+// memory, so only the first 3 GB is handed out as ordinary RAM
+#define DIRECT_MAP_LIMIT 0xC0000000ULL
+#define LOW_MEMORY_LIMIT 0x100000ULL // BIOS data, EBDA, AP trampoline, VGA
+
+#define FRAME_FREE 0x01 // Head page of a block on a free list
+
+#define MAX_RESERVED 16
+
+extern uint8_t _kernel_start[];
+extern uint8_t _kernel_end[];
+
+typedef struct free_block {
+    struct free_block* next;
+    struct free_block* prev;
+} free_block_t;
+
+typedef struct {
+    uint8_t flags;
+    uint8_t order;
+    uint8_t owner;
+} page_frame_t;
+
+typedef struct {
+    page_zone_info_t info;
+    free_block_t* free_lists[PAGE_MAX_ORDER + 1];
+} zone_t;
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} range_t;
+
+static zone_t zones[ZONE_COUNT] = {
+    { .info = { .name = "DMA", .start_pfn = 0, .end_pfn = DMA_LIMIT >> PAGE_SHIFT } },
+    { .info = { .name = "Normal", .start_pfn = DMA_LIMIT >> PAGE_SHIFT, .end_pfn = DIRECT_MAP_LIMIT >> PAGE_SHIFT } }
+};
+
+static page_frame_t* frames;
+static uint64_t frame_count;
+static range_t reserved[MAX_RESERVED];
+static int reserved_count;
+static spinlock_t lock = SPINLOCK_INIT;
+
+static zone_t* zone_of(uint64_t pfn) {
+    for (int i = 0; i < ZONE_COUNT; i++) {
+        if (pfn >= zones[i].info.start_pfn && pfn < zones[i].info.end_pfn) {
+            return &zones[i];
+        }
+    }
+    return 0;
+}
+
+static void list_push(zone_t* zone, uint64_t pfn, unsigned order) {
+    free_block_t* block = (free_block_t*)(uintptr_t)(pfn << PAGE_SHIFT);
+    block->prev = 0;
+    block->next = zone->free_lists[order];
+    if (block->next) {
+        block->next->prev = block;
+    }
+    zone->free_lists[order] = block;
+
+    frames[pfn].flags |= FRAME_FREE;
+    frames[pfn].order = order;
+    zone->info.free_blocks[order]++;
+    zone->info.free_pages += 1ULL << order;
+}
+
+static void list_remove(zone_t* zone, uint64_t pfn, unsigned order) {
+    free_block_t* block = (free_block_t*)(uintptr_t)(pfn << PAGE_SHIFT);
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        zone->free_lists[order] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+
+    frames[pfn].flags &= ~FRAME_FREE;
+    zone->info.free_blocks[order]--;
+    zone->info.free_pages -= 1ULL << order;
+}
+
+static void free_block(zone_t* zone, uint64_t pfn, unsigned order) {
+    // Merge upwards while the buddy is a free block of the same order
+    while (order < PAGE_MAX_ORDER) {
+        uint64_t buddy = pfn ^ (1ULL << order);
+        if (buddy < zone->info.start_pfn || buddy >= zone->info.end_pfn || buddy >= frame_count ||
+            !(frames[buddy].flags & FRAME_FREE) || frames[buddy].order != order) {
+            break;
+        }
+        list_remove(zone, buddy, order);
+        pfn &= ~(1ULL << order);
+        order++;
+    }
+    list_push(zone, pfn, order);
+}
+
+static uint64_t alloc_block(zone_t* zone, unsigned order) {
+    unsigned current = order;
+    while (current <= PAGE_MAX_ORDER && !zone->free_lists[current]) {
+        current++;
+    }
+    if (current > PAGE_MAX_ORDER) {
+        return 0;
+    }
+
+    uint64_t pfn = (uintptr_t)zone->free_lists[current] >> PAGE_SHIFT;
+    list_remove(zone, pfn, current);
+
+    // Hand the upper halves back until the block is the size asked for
+    while (current > order) {
+        current--;
+        list_push(zone, pfn + (1ULL << current), current);
+    }
+    frames[pfn].order = order;
+    return pfn << PAGE_SHIFT;
+}
+
+static void free_pages_range(uint64_t start_pfn, uint64_t end_pfn) {
+    uint64_t pfn = start_pfn;
+    while (pfn < end_pfn) {
+        zone_t* zone = zone_of(pfn);
+        if (!zone) {
+            return;
+        }
+        // Largest naturally aligned block that still fits; zone limits are
+        // multiples of the largest block so it never straddles two zones
+        unsigned order = PAGE_MAX_ORDER;
+        while (order > 0 && ((pfn & ((1ULL << order) - 1)) || pfn + (1ULL << order) > end_pfn)) {
+            order--;
+        }
+        zone->info.total_pages += 1ULL << order;
+        free_block(zone, pfn, order);
+        pfn += 1ULL << order;
+    }
+}
+
+// Free [start, end) minus every reserved range from index `first` on
+static void add_usable(uint64_t start, uint64_t end, int first) {
+    for (int i = first; i < reserved_count; i++) {
+        if (reserved[i].end <= start || reserved[i].start >= end) {
+            continue;
+        }
+        if (reserved[i].start > start) {
+            add_usable(start, reserved[i].start, i + 1);
+        }
+        if (reserved[i].end < end) {
+            add_usable(reserved[i].end, end, i + 1);
+        }
+        return;
+    }
+
+    uint64_t start_pfn = (start + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    uint64_t end_pfn = end >> PAGE_SHIFT;
+    if (start_pfn < end_pfn) {
+        free_pages_range(start_pfn, end_pfn);
+    }
+}
+
+static void reserve(uint64_t start, uint64_t end) {
+    if (reserved_count < MAX_RESERVED && start < end) {
+        reserved[reserved_count].start = start & ~(uint64_t)(PAGE_SIZE - 1);
+        reserved[reserved_count].end = (end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+        reserved_count++;
+    }
+}
+
+static uint64_t clip(uint64_t address) {
+    return address < DIRECT_MAP_LIMIT ? address : DIRECT_MAP_LIMIT;
+}
+
+void page_alloc_init(const boot_info_t* info) {
+    // The kernel image includes the boot page tables and stack (.bss)
+    reserve(0, LOW_MEMORY_LIMIT);
+    reserve((uintptr_t)_kernel_start, (uintptr_t)_kernel_end);
+    for (uint32_t i = 0; i < info->module_count; i++) {
+        reserve(info->modules[i].start, info->modules[i].end);
+    }
+
+    // One frame descriptor per page up to the highest usable address
+    uint64_t top = 0;
+    for (uint32_t i = 0; i < info->mmap_count; i++) {
+        const boot_mmap_entry_t* entry = &info->mmap[i];
+        if (entry->type == BOOT_MMAP_AVAILABLE && entry->base < DIRECT_MAP_LIMIT &&
+            clip(entry->base + entry->length) > top) {
+            top = clip(entry->base + entry->length);
+        }
+    }
+    frame_count = top >> PAGE_SHIFT;
+    uint64_t frames_size = frame_count * sizeof(page_frame_t);
+
+    // Put the descriptors in the first usable gap that holds them
+    frames = 0;
+    uint64_t candidate = ((uintptr_t)_kernel_end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    for (uint32_t i = 0; i < info->mmap_count && !frames; i++) {
+        const boot_mmap_entry_t* entry = &info->mmap[i];
+        uint64_t base = entry->base > candidate ? entry->base : candidate;
+        base = (base + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+        if (entry->type != BOOT_MMAP_AVAILABLE || base + frames_size > clip(entry->base + entry->length)) {
+            continue;
+        }
+        int clash = 0;
+        for (int r = 0; r < reserved_count; r++) {
+            if (base < reserved[r].end && base + frames_size > reserved[r].start) {
+                clash = 1;
+            }
+        }
+        if (!clash) {
+            frames = (page_frame_t*)(uintptr_t)base;
+        }
+    }
+    if (!frames) {
+        frame_count = 0;
+        return;
+    }
+    memset(frames, 0, frames_size);
+    reserve((uintptr_t)frames, (uintptr_t)frames + frames_size);
+
+    for (uint32_t i = 0; i < info->mmap_count; i++) {
+        const boot_mmap_entry_t* entry = &info->mmap[i];
+        if (entry->type == BOOT_MMAP_AVAILABLE) {
+            add_usable(clip(entry->base), clip(entry->base + entry->length), 0);
+        }
+    }
+}
+
+uint64_t page_alloc_zone(int zone, unsigned order) {
+    if (zone < 0 || zone >= ZONE_COUNT || order > PAGE_MAX_ORDER) {
+        return 0;
+    }
+    uint64_t flags = spin_lock_irqsave(&lock);
+    uint64_t address = alloc_block(&zones[zone], order);
+    spin_unlock_irqrestore(&lock, flags);
+    return address;
+}
+
+// Prefer Normal so the small DMA zone is left for devices that need it
+uint64_t page_alloc(unsigned order) {
+    if (order > PAGE_MAX_ORDER) {
+        return 0;
+    }
+    uint64_t flags = spin_lock_irqsave(&lock);
+    uint64_t address = 0;
+    for (int i = ZONE_COUNT - 1; i >= 0 && !address; i--) {
+        address = alloc_block(&zones[i], order);
+    }
+    spin_unlock_irqrestore(&lock, flags);
+    return address;
+}
+
+void page_free(uint64_t address, unsigned order) {
+    uint64_t pfn = address >> PAGE_SHIFT;
+    zone_t* zone = zone_of(pfn);
+    if (!zone || pfn >= frame_count || order > PAGE_MAX_ORDER || (pfn & ((1ULL << order) - 1))) {
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&lock);
+    if (!(frames[pfn].flags & FRAME_FREE)) {
+        for (uint64_t i = 0; i < (1ULL << order); i++) {
+            frames[pfn + i].owner = PAGE_OWNER_NONE;
+        }
+        free_block(zone, pfn, order);
+    }
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+int page_extend(uint64_t address, unsigned order) {
+    uint64_t pfn = address >> PAGE_SHIFT;
+    uint64_t buddy = pfn + (1ULL << order);
+    zone_t* zone = zone_of(pfn);
+    // Only a lower buddy can grow upwards
+    if (!zone || order >= PAGE_MAX_ORDER || (pfn & ((1ULL << (order + 1)) - 1)) ||
+        buddy >= zone->info.end_pfn || buddy >= frame_count) {
+        return -1;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&lock);
+    int result = -1;
+    if ((frames[buddy].flags & FRAME_FREE) && frames[buddy].order == order) {
+        list_remove(zone, buddy, order);
+        frames[pfn].order = order + 1;
+        result = 0;
+    }
+    spin_unlock_irqrestore(&lock, flags);
+    return result;
+}
+
+// Only the owner of the block writes these, so no lock is needed
+void page_set_owner(uint64_t address, unsigned order, uint8_t owner) {
+    uint64_t pfn = address >> PAGE_SHIFT;
+    if (pfn + (1ULL << order) > frame_count) {
+        return;
+    }
+    for (uint64_t i = 0; i < (1ULL << order); i++) {
+        frames[pfn + i].owner = owner;
+        frames[pfn + i].order = order;
+    }
+}
+
+uint8_t page_owner(uint64_t address, unsigned* order) {
+    uint64_t pfn = address >> PAGE_SHIFT;
+    if (pfn >= frame_count) {
+        return PAGE_OWNER_NONE;
+    }
+    *order = frames[pfn].order;
+    return frames[pfn].owner;
+}
+
+void page_zone_info(int zone, page_zone_info_t* info) {
+    if (zone < 0 || zone >= ZONE_COUNT) {
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&lock);
+    *info = zones[zone].info;
+    spin_unlock_irqrestore(&lock, flags);
+}
@@ -0,0 +1,49 @@
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stdint.h>
+#include "boot_info.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_SHIFT 12
+#define PAGE_MAX_ORDER 10 // Largest block is 2^10 pages (4 MB)
+
+#define ZONE_DMA 0 // Below 16 MB, for ISA-style DMA
+#define ZONE_NORMAL 1 // 16 MB up to the uncached top GB of the identity map
+#define ZONE_COUNT 2
+
+// Who an allocated block belongs to, so kfree can tell from the address alone
+#define PAGE_OWNER_NONE 0
+#define PAGE_OWNER_SLAB 1
+#define PAGE_OWNER_LARGE 2
+#define PAGE_OWNER_PAGE_TABLE 3
+
+typedef struct {
+    const char* name;
+    uint64_t start_pfn;
+    uint64_t end_pfn;
+    uint64_t total_pages; // Usable pages handed to the zone at boot
+    uint64_t free_pages;
+    uint64_t free_blocks[PAGE_MAX_ORDER + 1];
+} page_zone_info_t;
+
+// Build the free lists from the boot memory map
+void page_alloc_init(const boot_info_t* info);
+
+// 2^order contiguous pages, naturally aligned. Returns the physical
+// address (identity mapped) or 0 when no block is large enough.
+uint64_t page_alloc(unsigned order);
+uint64_t page_alloc_zone(int zone, unsigned order);
+void page_free(uint64_t address, unsigned order);
+// Double an allocated block in place by taking its upper buddy, if that
+// buddy is free and whole. Returns -1 when it is not.
+int page_extend(uint64_t address, unsigned order);
+
+// Tag every page of an allocated block; page_owner() then reports the tag
+// and block order for any address inside it
+void page_set_owner(uint64_t address, unsigned order, uint8_t owner);
+uint8_t page_owner(uint64_t address, unsigned* order);
+
+void page_zone_info(int zone, page_zone_info_t* info);
+
+#endif
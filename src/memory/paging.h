@@ -1,22 +0,0 @@
-#ifndef PAGING_H
-#define PAGING_H
-
-#include <stdint.h>
-
-typedef struct {
-    uint32_t present : 1;
-    uint32_t rw : 1;
-    uint32_t user : 1;
-    uint32_t reserved : 29;
-} pte_t;
-
-typedef struct {
-    uint32_t present : 1;
-    uint32_t rw : 1;
-    uint32_t user : 1;
-    uint32_t reserved : 29;
-} pde_t;
-
-void init_paging();
-
-#endif // PAGING_H
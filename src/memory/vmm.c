@@ -0,0 +1,781 @@
+#include "vmm.h"
+#include "page_alloc.h"
+#include "spinlock.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "lapic.h"
+#include "smp.h"
+#include "string.h"
+
+// Four-level page tables: PML4, PDPT, PD and PT. Levels are numbered the
+// way the walk meets them, 4 for the PML4 down to 1 for 4 KB entries; a
+// leaf at level 3 or 2 is a 1 GB or 2 MB page. The boot tables in
+// .boot.bss stay the kernel's tables, so the identity map of the first
+// 4 GB keeps working and the application processors keep sharing them.
+// The kernel image itself runs from its higher-half alias at
+// VMM_KERNEL_BASE, which has tables of its own.
+
+#define PTE_PRESENT (1ULL << 0)
+#define PTE_WRITE (1ULL << 1)
+#define PTE_USER (1ULL << 2)
+#define PTE_PWT (1ULL << 3)
+#define PTE_PCD (1ULL << 4)
+#define PTE_HUGE (1ULL << 7) // PS: this level-2 or level-3 entry is a leaf
+#define PTE_PAT_4K (1ULL << 7)
+#define PTE_PAT_HUGE (1ULL << 12)
+#define PTE_NX (1ULL << 63)
+#define PTE_ADDRESS 0x000FFFFFFFFFF000ULL
+
+#define CR0_WP (1ULL << 16) // Read-only pages are read-only for the kernel too
+
+#define IA32_EFER_MSR 0xC0000080
+#define EFER_NXE (1 << 11)
+#define IA32_PAT_MSR 0x277
+#define CPUID_1_EDX_PAT (1 << 16)
+#define CPUID_EXT_EDX_NX (1 << 20)
+#define CPUID_EXT_EDX_1GB_PAGES (1 << 26)
+
+// Entries 0-3 keep their power-on types (WB, WT, UC-, UC), so PWT and PCD
+// mean what they always did; entry 4, reached through the PAT bit alone,
+// is write-combining
+#define PAT_VALUE 0x0007040100070406ULL
+
+#define PF_PRESENT 0x01 // Error code: the page was present, so not ours to fill
+
+#define PAGE_FAULT_VECTOR 14
+#define DOUBLE_FAULT_VECTOR 8
+#define BOOT_STACK_SIZE (16 * 1024) // Must match main.asm
+
+#define MMIO_WINDOWS 16
+#define SHOOTDOWN_PAGES 32 // Past this many, the other CPUs flush everything
+#define RELEASE_BATCH 32
+
+typedef struct {
+    uint64_t phys;
+    uint64_t size;
+    uint32_t flags;
+    uint64_t virt;
+} mmio_window_t;
+
+// A reserved range of kernel virtual space. With a guard page, the first
+// page of the span is it and stays unmapped.
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t span;
+    uint32_t flags;
+    uint8_t guard;
+    uint8_t lazy;
+    uint8_t in_use;
+    uint64_t resident_pages;
+    uint64_t faults;
+} region_t;
+
+extern uint8_t boot_stack_guard[];
+// Section boundaries from linker.ld, all page aligned
+extern uint8_t _text_start[];
+extern uint8_t _rodata_start[];
+extern uint8_t _data_start[];
+extern uint8_t _kernel_image_end[];
+
+static uint64_t pml4_phys;
+static uint64_t table_offset = 0; // Page tables are reached at physical + this
+static uint64_t mmio_next = VMM_MMIO_BASE;
+static mmio_window_t mmio_windows[MMIO_WINDOWS];
+static int mmio_window_count = 0;
+static region_t regions[VMM_MAX_REGIONS];
+static uint64_t region_next = VMM_REGION_BASE;
+static vmm_stats_t stats;
+static int ready = 0;
+static spinlock_t lock = SPINLOCK_INIT;
+
+// Invalidations made under the lock that the other CPUs still have to
+// repeat. Only the lock holder fills it or sends it, so one is in flight
+// at a time; a CPU's pending flag stays set until it has done its part.
+static struct {
+    uint64_t pages[SHOOTDOWN_PAGES];
+    int count;
+    int all; // Drop every TLB entry instead
+    int caches; // A memory type changed, so write back and drop caches too
+    volatile uint8_t pending[SMP_MAX_CPUS];
+} shootdown;
+
+static uint64_t level_size(int level) {
+    return VMM_PAGE_4K << (9 * (level - 1));
+}
+
+static int table_index(uint64_t virt, int level) {
+    return (virt >> (PAGE_SHIFT + 9 * (level - 1))) & 511;
+}
+
+static uint64_t* table_at(uint64_t phys) {
+    return (uint64_t*)(uintptr_t)(phys + table_offset);
+}
+
+// This CPU only
+static void flush_tlb(void) {
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+static void invalidate(uint64_t virt) {
+    __asm__ volatile("invlpg (%0)" : : "r"(virt) : "memory");
+    stats.invalidations++;
+    if (shootdown.count < SHOOTDOWN_PAGES) {
+        shootdown.pages[shootdown.count++] = virt;
+    } else {
+        shootdown.all = 1;
+    }
+}
+
+static void invalidate_all(void) {
+    flush_tlb();
+    stats.invalidations++;
+    shootdown.all = 1;
+}
+
+// Runs on a CPU asked to repeat the queued invalidations, from the IPI or
+// while it spins on the lock with interrupts off
+static void shootdown_answer(void) {
+    uint32_t index = this_cpu()->index;
+    if (!__atomic_load_n(&shootdown.pending[index], __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    if (shootdown.caches) {
+        __asm__ volatile("wbinvd" : : : "memory");
+    }
+    if (shootdown.all) {
+        flush_tlb();
+    } else {
+        for (int i = 0; i < shootdown.count; i++) {
+            __asm__ volatile("invlpg (%0)" : : "r"(shootdown.pages[i]) : "memory");
+        }
+    }
+    __atomic_store_n(&shootdown.pending[index], 0, __ATOMIC_RELEASE);
+}
+
+static void shootdown_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    shootdown_answer();
+    lapic_eoi();
+}
+
+// Have every other online CPU repeat what invalidate() and invalidate_all()
+// queued, and wait until all of them have. Called with the lock held, and
+// before anything that was unmapped is freed.
+static void shootdown_send(void) {
+    if (!shootdown.count && !shootdown.all) {
+        return;
+    }
+    if (shootdown.caches) {
+        __asm__ volatile("wbinvd" : : : "memory");
+    }
+    uint32_t count = smp_cpu_count();
+    if (count > 1) {
+        uint32_t self = this_cpu()->index;
+        for (uint32_t i = 0; i < count; i++) {
+            cpu_local_t* cpu = smp_cpu(i);
+            if (i != self && __atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&shootdown.pending[i], 1, __ATOMIC_RELEASE);
+                lapic_send_ipi(cpu->apic_id, VMM_SHOOTDOWN_VECTOR);
+            }
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            while (__atomic_load_n(&shootdown.pending[i], __ATOMIC_ACQUIRE)) {
+                __asm__ volatile("pause");
+            }
+        }
+        stats.shootdowns++;
+    }
+    shootdown.count = 0;
+    shootdown.all = 0;
+    shootdown.caches = 0;
+}
+
+// The holder may be waiting for this CPU to answer a shootdown, and with
+// interrupts off here the IPI cannot get through, so answer it directly
+static uint64_t lock_acquire(void) {
+    uint64_t irq;
+    while (!spin_trylock_irqsave(&lock, &irq)) {
+        uint64_t flags = irq_save();
+        shootdown_answer();
+        irq_restore(flags);
+        __asm__ volatile("pause");
+    }
+    return irq;
+}
+
+static void lock_release(uint64_t irq) {
+    shootdown_send();
+    spin_unlock_irqrestore(&lock, irq);
+}
+
+static uint64_t leaf_bits(uint32_t flags, int level) {
+    uint64_t bits = PTE_PRESENT;
+    if (flags & VMM_WRITE) {
+        bits |= PTE_WRITE;
+    }
+    if (flags & VMM_USER) {
+        bits |= PTE_USER;
+    }
+    if (flags & VMM_WRITE_THROUGH) {
+        bits |= PTE_PWT;
+    }
+    if (flags & VMM_UNCACHED) {
+        bits |= PTE_PCD | PTE_PWT;
+    } else if ((flags & VMM_WRITE_COMBINING) && stats.pat) {
+        bits |= level > 1 ? PTE_PAT_HUGE : PTE_PAT_4K;
+    } else if (flags & VMM_WRITE_COMBINING) {
+        bits |= PTE_PCD | PTE_PWT;
+    }
+    if (!(flags & VMM_EXEC) && stats.nx) {
+        bits |= PTE_NX;
+    }
+    if (level > 1) {
+        bits |= PTE_HUGE;
+    }
+    return bits;
+}
+
+// The bits that pick a leaf's memory type
+static uint64_t type_bits(int level) {
+    return PTE_PWT | PTE_PCD | (level > 1 ? PTE_PAT_HUGE : PTE_PAT_4K);
+}
+
+static uint64_t table_alloc(void) {
+    uint64_t phys = page_alloc(0);
+    if (!phys) {
+        return 0;
+    }
+    page_set_owner(phys, 0, PAGE_OWNER_PAGE_TABLE);
+    memset(table_at(phys), 0, PAGE_SIZE);
+    stats.table_pages++;
+    return phys;
+}
+
+// Free a table and everything below it; the boot tables are not ours to free
+static void table_free(uint64_t phys, int level) {
+    unsigned order;
+    if (page_owner(phys, &order) != PAGE_OWNER_PAGE_TABLE) {
+        return;
+    }
+    uint64_t* entries = table_at(phys);
+    for (int i = 0; level > 1 && i < 512; i++) {
+        if ((entries[i] & PTE_PRESENT) && !(entries[i] & PTE_HUGE)) {
+            table_free(entries[i] & PTE_ADDRESS, level - 1);
+        }
+    }
+    page_free(phys, 0);
+    stats.table_pages--;
+}
+
+// Replace a large-page leaf with a table mapping the same memory in 512
+// pages of the next size down, so part of it can be changed
+static int split(uint64_t* entry, int level) {
+    uint64_t table = table_alloc();
+    if (!table) {
+        return -1;
+    }
+    uint64_t old = *entry;
+    uint64_t base = old & PTE_ADDRESS & ~(level_size(level) - 1);
+    uint64_t attributes = old & ~PTE_ADDRESS;
+    if (level - 1 == 1) {
+        // The PAT bit moves down to where PS was
+        attributes &= ~PTE_HUGE;
+        if (old & PTE_PAT_HUGE) {
+            attributes |= PTE_PAT_4K;
+        }
+    } else {
+        attributes |= old & PTE_PAT_HUGE;
+    }
+
+    uint64_t* entries = table_at(table);
+    for (int i = 0; i < 512; i++) {
+        entries[i] = (base + i * level_size(level - 1)) | attributes;
+    }
+    *entry = table | PTE_PRESENT | PTE_WRITE | (old & PTE_USER);
+    stats.splits++;
+    return 0;
+}
+
+// Entry for virt at `level`, creating missing tables and splitting larger
+// pages on the way down. `path` bits are added to every upper-level entry.
+static uint64_t* walk(uint64_t virt, int level, uint64_t path) {
+    uint64_t* table = table_at(pml4_phys);
+    for (int current = 4; current > level; current--) {
+        uint64_t* entry = &table[table_index(virt, current)];
+        if (!(*entry & PTE_PRESENT)) {
+            uint64_t phys = table_alloc();
+            if (!phys) {
+                return NULL;
+            }
+            *entry = phys | PTE_PRESENT | PTE_WRITE;
+        } else if (*entry & PTE_HUGE) {
+            if (split(entry, current) < 0) {
+                return NULL;
+            }
+        }
+        *entry |= path;
+        table = table_at(*entry & PTE_ADDRESS);
+    }
+    return &table[table_index(virt, level)];
+}
+
+// Leaf entry mapping virt, or NULL; *level is the level the walk stopped at
+static uint64_t* lookup(uint64_t virt, int* level) {
+    uint64_t* table = table_at(pml4_phys);
+    for (int current = 4; current >= 1; current--) {
+        uint64_t* entry = &table[table_index(virt, current)];
+        *level = current;
+        if (!(*entry & PTE_PRESENT)) {
+            return NULL;
+        }
+        if (current == 1 || (*entry & PTE_HUGE)) {
+            return entry;
+        }
+        table = table_at(*entry & PTE_ADDRESS);
+    }
+    return NULL;
+}
+
+static int map_range(uint64_t virt, uint64_t phys, uint64_t size, uint32_t flags) {
+    if ((virt | phys | size) & (VMM_PAGE_4K - 1)) {
+        return -1;
+    }
+
+    while (size) {
+        int level = 1;
+        for (int candidate = stats.gb_pages ? 3 : 2; candidate > 1; candidate--) {
+            uint64_t page = level_size(candidate);
+            if (!((virt | phys) & (page - 1)) && size >= page) {
+                level = candidate;
+                break;
+            }
+        }
+
+        uint64_t* entry = walk(virt, level, (flags & VMM_USER) ? PTE_USER : 0);
+        if (!entry) {
+            return -1;
+        }
+        uint64_t old = *entry;
+        *entry = phys | leaf_bits(flags, level);
+        if (old & PTE_PRESENT) {
+            if (level > 1 && !(old & PTE_HUGE)) {
+                // A whole table of smaller pages went away
+                invalidate_all();
+                shootdown_send();
+                table_free(old & PTE_ADDRESS, level - 1);
+            } else {
+                if ((old ^ *entry) & type_bits(level)) {
+                    shootdown.caches = 1;
+                }
+                invalidate(virt);
+            }
+        }
+
+        virt += level_size(level);
+        phys += level_size(level);
+        size -= level_size(level);
+    }
+    return 0;
+}
+
+// Unmap (unmap set) or re-flag every page in the range, splitting large
+// pages that are only partly covered
+static int change_range(uint64_t virt, uint64_t size, int unmap, uint32_t flags) {
+    if ((virt | size) & (VMM_PAGE_4K - 1)) {
+        return -1;
+    }
+
+    uint64_t end = virt + size;
+    while (virt < end) {
+        int level;
+        uint64_t* entry = lookup(virt, &level);
+        uint64_t page = level_size(level);
+        if (!entry) {
+            uint64_t next = (virt & ~(page - 1)) + page;
+            if (next <= virt) {
+                break; // Wrapped past the top of the address space
+            }
+            virt = next;
+            continue;
+        }
+        if ((virt & (page - 1)) || end - virt < page) {
+            if (split(entry, level) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        uint64_t old = *entry;
+        if (unmap) {
+            *entry = 0;
+        } else {
+            *entry = (old & PTE_ADDRESS & ~(page - 1)) | leaf_bits(flags, level);
+            if ((old ^ *entry) & type_bits(level)) {
+                shootdown.caches = 1;
+            }
+        }
+        invalidate(virt);
+        virt += page;
+    }
+    return 0;
+}
+
+// Callers of the region functions hold the lock
+static region_t* region_find(uint64_t address) {
+    for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+        region_t* region = &regions[i];
+        if (region->in_use && address >= region->start && address - region->start < region->span) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+static int in_guard(const region_t* region, uint64_t address) {
+    return region->guard && address - region->start < VMM_GUARD_SIZE;
+}
+
+// A released slot with the same span is reused along with its virtual
+// range and page tables; otherwise a fresh range is carved off, leaving an
+// unmapped page after it so an overrun never runs into the next region
+static region_t* region_create(const char* name, uint64_t span, int guard, uint32_t flags, int lazy) {
+    region_t* region = NULL;
+    for (int i = 0; i < VMM_MAX_REGIONS && !region; i++) {
+        if (!regions[i].in_use && regions[i].span == span) {
+            region = &regions[i];
+        }
+    }
+    for (int i = 0; i < VMM_MAX_REGIONS && !region; i++) {
+        if (!regions[i].span) {
+            region = &regions[i];
+            region->start = region_next;
+            region->span = span;
+            region_next += span + VMM_PAGE_4K;
+        }
+    }
+    if (!region) {
+        return NULL;
+    }
+
+    region->name = name;
+    region->flags = flags;
+    region->guard = guard;
+    region->lazy = lazy;
+    region->in_use = 1;
+    region->resident_pages = 0;
+    region->faults = 0;
+    return region;
+}
+
+static int region_commit(region_t* region, uint64_t virt) {
+    uint64_t phys = page_alloc(0);
+    if (!phys) {
+        return -1;
+    }
+    memset(table_at(phys), 0, PAGE_SIZE);
+    uint64_t* entry = walk(virt, 1, 0);
+    if (!entry) {
+        page_free(phys, 0);
+        return -1;
+    }
+    *entry = phys | leaf_bits(region->flags, 1);
+    region->resident_pages++;
+    return 0;
+}
+
+// A page is freed only once no CPU can still reach it through its TLB
+static void region_release(region_t* region) {
+    uint64_t pages[RELEASE_BATCH];
+    int count = 0;
+    uint64_t end = region->start + region->span;
+    for (uint64_t virt = region->start; virt < end; virt += VMM_PAGE_4K) {
+        int level;
+        uint64_t* entry = lookup(virt, &level);
+        if (entry && level == 1) {
+            pages[count++] = *entry & PTE_ADDRESS;
+            *entry = 0;
+            invalidate(virt);
+        }
+        if (count == RELEASE_BATCH || (count && virt + VMM_PAGE_4K >= end)) {
+            shootdown_send();
+            while (count) {
+                page_free(pages[--count], 0);
+            }
+        }
+    }
+    region->in_use = 0;
+    region->resident_pages = 0;
+}
+
+// First touch of a lazy region gets a zeroed page; anything else is fatal
+static void page_fault(interrupt_frame_t* frame) {
+    uint64_t address;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(address));
+
+    uint64_t irq = lock_acquire();
+    region_t* region = region_find(address);
+    if (region && region->lazy && !in_guard(region, address) && !(frame->error_code & PF_PRESENT)) {
+        uint64_t page = address & ~(VMM_PAGE_4K - 1);
+        int level;
+        int result = 0;
+        // Another CPU may have filled it in the meantime
+        if (!lookup(page, &level)) {
+            result = region_commit(region, page);
+            region->faults++;
+        }
+        lock_release(irq);
+        if (result < 0) {
+            interrupt_panic(frame, "Out of memory for a lazy region");
+        }
+        return;
+    }
+    int overflow = region && in_guard(region, address);
+    lock_release(irq);
+    interrupt_panic(frame, overflow ? "Kernel stack overflow" : 0);
+}
+
+// Runs on its own IST stack; a #PF that cannot push its frame because the
+// stack pointer is in a guard page ends up here. No lock: nothing resumes.
+static void double_fault(interrupt_frame_t* frame) {
+    uint64_t address;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(address));
+    region_t* region = region_find(address);
+    interrupt_panic(frame, region && in_guard(region, address) ? "Kernel stack overflow" : 0);
+}
+
+// The PAT is per CPU, and every CPU must agree on it
+static void pat_init(void) {
+    if (stats.pat) {
+        wrmsr(IA32_PAT_MSR, PAT_VALUE);
+        flush_tlb();
+    }
+}
+
+// So is CR0.WP, without which the kernel writes straight through .text
+static void write_protect_init(void) {
+    uint64_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_WP) : "memory");
+}
+
+// The boot code maps the image at VMM_KERNEL_BASE with writable 2 MB
+// pages. Trim that to the image and give each section only what it needs.
+static void kernel_image_protect(void) {
+    uint64_t text = (uintptr_t)_text_start;
+    uint64_t rodata = (uintptr_t)_rodata_start;
+    uint64_t data = (uintptr_t)_data_start;
+    uint64_t end = (uintptr_t)_kernel_image_end;
+    uint64_t mapped_end = (end + VMM_PAGE_2M - 1) & ~(VMM_PAGE_2M - 1);
+
+    change_range(VMM_KERNEL_BASE, text - VMM_KERNEL_BASE, 1, 0);
+    change_range(end, mapped_end - end, 1, 0);
+    change_range(text, rodata - text, 0, VMM_EXEC);
+    change_range(rodata, data - rodata, 0, 0);
+    change_range(data, end - data, 0, VMM_WRITE);
+    write_protect_init();
+}
+
+void vmm_init(const boot_info_t* info) {
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    stats.pat = (d & CPUID_1_EDX_PAT) != 0;
+    pat_init();
+
+    cpuid(0x80000000, &a, &b, &c, &d);
+    if (a >= 0x80000001) {
+        cpuid(0x80000001, &a, &b, &c, &d);
+        stats.nx = (d & CPUID_EXT_EDX_NX) != 0;
+        stats.gb_pages = (d & CPUID_EXT_EDX_1GB_PAGES) != 0;
+    }
+    // Application processors copy EFER from here, NXE included
+    if (stats.nx) {
+        wrmsr(IA32_EFER_MSR, rdmsr(IA32_EFER_MSR) | EFER_NXE);
+    }
+
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    pml4_phys = cr3 & PTE_ADDRESS;
+
+    // Only RAM goes into the direct map, so no device memory gets a
+    // cacheable alias there
+    uint64_t flags = lock_acquire();
+    for (uint32_t i = 0; i < info->mmap_count; i++) {
+        const boot_mmap_entry_t* entry = &info->mmap[i];
+        if (entry->type != BOOT_MMAP_AVAILABLE && entry->type != BOOT_MMAP_ACPI_RECLAIMABLE &&
+            entry->type != BOOT_MMAP_NVS) {
+            continue;
+        }
+        uint64_t start = entry->base & ~(VMM_PAGE_4K - 1);
+        uint64_t end = (entry->base + entry->length + VMM_PAGE_4K - 1) & ~(VMM_PAGE_4K - 1);
+        if (map_range(VMM_HHDM_BASE + start, start, end - start, VMM_WRITE) == 0) {
+            stats.hhdm_bytes += end - start;
+        }
+    }
+    table_offset = VMM_HHDM_BASE;
+
+    kernel_image_protect();
+
+    // The boot stack keeps running kernel_main, so give it a guard page too
+    region_t* boot_stack = &regions[0];
+    boot_stack->name = "boot stack";
+    boot_stack->start = (uintptr_t)boot_stack_guard;
+    boot_stack->span = VMM_GUARD_SIZE + BOOT_STACK_SIZE;
+    boot_stack->flags = VMM_WRITE;
+    boot_stack->guard = 1;
+    boot_stack->in_use = 1;
+    boot_stack->resident_pages = BOOT_STACK_SIZE / VMM_PAGE_4K;
+    change_range(boot_stack->start, VMM_GUARD_SIZE, 1, 0);
+    lock_release(flags);
+
+    interrupt_register_handler(PAGE_FAULT_VECTOR, page_fault);
+    interrupt_register_handler(DOUBLE_FAULT_VECTOR, double_fault);
+    interrupt_register_handler(VMM_SHOOTDOWN_VECTOR, shootdown_interrupt);
+    ready = 1;
+}
+
+int vmm_ready(void) {
+    return ready;
+}
+
+void vmm_init_ap(void) {
+    pat_init();
+    write_protect_init();
+}
+
+int vmm_map(uint64_t virt, uint64_t phys, uint64_t size, uint32_t flags) {
+    uint64_t irq = lock_acquire();
+    int result = map_range(virt, phys, size, flags);
+    lock_release(irq);
+    return result;
+}
+
+int vmm_unmap(uint64_t virt, uint64_t size) {
+    uint64_t irq = lock_acquire();
+    int result = change_range(virt, size, 1, 0);
+    lock_release(irq);
+    return result;
+}
+
+int vmm_protect(uint64_t virt, uint64_t size, uint32_t flags) {
+    uint64_t irq = lock_acquire();
+    int result = change_range(virt, size, 0, flags);
+    lock_release(irq);
+    return result;
+}
+
+uint64_t vmm_virt_to_phys(const void* virt) {
+    uint64_t address = (uintptr_t)virt;
+    uint64_t irq = lock_acquire();
+    int level;
+    uint64_t* entry = lookup(address, &level);
+    uint64_t page = level_size(level);
+    uint64_t phys = entry ? (*entry & PTE_ADDRESS & ~(page - 1)) + (address & (page - 1)) : 0;
+    lock_release(irq);
+    return phys;
+}
+
+void* vmm_map_mmio(uint64_t phys, uint64_t size, uint32_t flags) {
+    uint64_t offset = phys & (VMM_PAGE_4K - 1);
+    uint64_t base = phys - offset;
+    uint64_t length = (size + offset + VMM_PAGE_4K - 1) & ~(VMM_PAGE_4K - 1);
+
+    uint64_t irq = lock_acquire();
+    for (int i = 0; i < mmio_window_count; i++) {
+        mmio_window_t* window = &mmio_windows[i];
+        if (window->phys == base && window->size >= length && window->flags == flags) {
+            lock_release(irq);
+            return (void*)(uintptr_t)(window->virt + offset);
+        }
+    }
+
+    // Same offset into a 2 MB page as the device, so large pages fit
+    uint64_t virt = ((mmio_next + VMM_PAGE_2M - 1) & ~(VMM_PAGE_2M - 1)) + (base & (VMM_PAGE_2M - 1));
+    if (map_range(virt, base, length, flags) < 0) {
+        lock_release(irq);
+        return NULL;
+    }
+    mmio_next = virt + length;
+    stats.mmio_bytes += length;
+    if (mmio_window_count < MMIO_WINDOWS) {
+        mmio_windows[mmio_window_count++] = (mmio_window_t){ base, length, flags, virt };
+    }
+    lock_release(irq);
+    return (void*)(uintptr_t)(virt + offset);
+}
+
+void* vmm_reserve(const char* name, uint64_t size, uint32_t flags) {
+    size = (size + VMM_PAGE_4K - 1) & ~(VMM_PAGE_4K - 1);
+    uint64_t irq = lock_acquire();
+    region_t* region = region_create(name, size, 0, flags, 1);
+    lock_release(irq);
+    return region ? (void*)(uintptr_t)region->start : NULL;
+}
+
+// A region with every page committed up front, after an optional guard page
+static void* region_alloc(const char* name, uint64_t size, int guard, uint32_t flags) {
+    size = (size + VMM_PAGE_4K - 1) & ~(VMM_PAGE_4K - 1);
+    uint64_t guard_size = guard ? VMM_GUARD_SIZE : 0;
+    uint64_t irq = lock_acquire();
+    region_t* region = region_create(name, guard_size + size, guard, flags, 0);
+    if (!region) {
+        lock_release(irq);
+        return NULL;
+    }
+    uint64_t base = region->start + guard_size;
+    for (uint64_t virt = base; virt < base + size; virt += VMM_PAGE_4K) {
+        if (region_commit(region, virt) < 0) {
+            region_release(region);
+            lock_release(irq);
+            return NULL;
+        }
+    }
+    lock_release(irq);
+    return (void*)(uintptr_t)base;
+}
+
+void* vmm_alloc(const char* name, uint64_t size, uint32_t flags) {
+    return region_alloc(name, size, 0, flags);
+}
+
+// Stacks are committed up front: a fault while pushing an interrupt
+// frame could not be serviced on the same stack
+void* vmm_stack_alloc(const char* name, uint64_t size) {
+    return region_alloc(name, size, 1, VMM_WRITE);
+}
+
+void vmm_release(void* base) {
+    uint64_t address = (uintptr_t)base;
+    uint64_t irq = lock_acquire();
+    region_t* region = region_find(address);
+    // Never the boot stack, whose pages belong to the kernel image
+    if (region && region != &regions[0] && address == region->start + (region->guard ? VMM_GUARD_SIZE : 0)) {
+        region_release(region);
+    }
+    lock_release(irq);
+}
+
+int vmm_region_info(int index, vmm_region_info_t* info) {
+    if (index < 0 || index >= VMM_MAX_REGIONS) {
+        return -1;
+    }
+    uint64_t irq = lock_acquire();
+    const region_t* region = &regions[index];
+    uint64_t guard = region->guard ? VMM_GUARD_SIZE : 0;
+    info->name = region->in_use ? region->name : NULL;
+    info->base = region->start + guard;
+    info->size = region->span - guard;
+    info->guard = region->guard;
+    info->lazy = region->lazy;
+    info->resident_pages = region->resident_pages;
+    info->faults = region->faults;
+    lock_release(irq);
+    return 0;
+}
+
+void vmm_get_stats(vmm_stats_t* out) {
+    uint64_t irq = lock_acquire();
+    *out = stats;
+    lock_release(irq);
+}
@@ -0,0 +1,97 @@
+#ifndef VMM_H
+#define VMM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "boot_info.h"
+
+#define VMM_PAGE_4K 0x1000ULL
+#define VMM_PAGE_2M 0x200000ULL
+#define VMM_PAGE_1G 0x40000000ULL
+
+// All physical RAM appears at VMM_HHDM_BASE + physical address
+#define VMM_HHDM_BASE 0xFFFF800000000000ULL
+// Device windows handed out by vmm_map_mmio
+#define VMM_MMIO_BASE 0xFFFFC00000000000ULL
+// Reserved regions and kernel stacks
+#define VMM_REGION_BASE 0xFFFFD00000000000ULL
+// The kernel image is linked here; must match linker.ld
+#define VMM_KERNEL_BASE 0xFFFFFFFF80000000ULL
+
+#define VMM_SHOOTDOWN_VECTOR 0x33 // IPI asking the other CPUs to drop stale TLB entries
+
+#define VMM_MAX_REGIONS 128
+#define VMM_GUARD_SIZE VMM_PAGE_4K
+
+// Mapping flags; pages are always readable, and executable only with VMM_EXEC
+#define VMM_WRITE 0x01
+#define VMM_EXEC 0x02
+#define VMM_USER 0x04
+#define VMM_WRITE_THROUGH 0x08
+#define VMM_UNCACHED 0x10 // Strong UC, for device registers
+#define VMM_WRITE_COMBINING 0x20 // For framebuffers; UC without PAT
+
+typedef struct {
+    int nx; // No-execute is supported and enabled
+    int gb_pages; // 1 GB pages are supported
+    int pat; // PAT is programmed, so write-combining is available
+    uint64_t hhdm_bytes;
+    uint64_t mmio_bytes;
+    uint64_t table_pages;
+    uint64_t splits; // Large pages broken up to change part of them
+    uint64_t invalidations;
+    uint64_t shootdowns; // Rounds of invalidations sent to the other CPUs
+} vmm_stats_t;
+
+// Take over the boot page tables, enable NX and build the direct map
+void vmm_init(const boot_info_t* info);
+// Per-CPU part of vmm_init for application processors
+void vmm_init_ap(void);
+// vmm_init has run, so regions can be reserved; for code that also runs
+// before it
+int vmm_ready(void);
+
+// virt, phys and size must be 4 KB aligned. The largest page size that
+// fits is used; larger pages in the way are split. Returns 0 or -1.
+int vmm_map(uint64_t virt, uint64_t phys, uint64_t size, uint32_t flags);
+int vmm_unmap(uint64_t virt, uint64_t size);
+// Change the flags of every mapped page in the range
+int vmm_protect(uint64_t virt, uint64_t size, uint32_t flags);
+// Physical address behind virt, or 0 if it is not mapped
+uint64_t vmm_virt_to_phys(const void* virt);
+
+// Map a device region into the MMIO window; returns NULL on failure.
+// Mapping the same region again with the same flags reuses the window.
+void* vmm_map_mmio(uint64_t phys, uint64_t size, uint32_t flags);
+
+typedef struct {
+    const char* name; // NULL for an unused slot
+    uint64_t base; // First usable byte, above the guard page if any
+    uint64_t size;
+    int guard;
+    int lazy; // Pages are committed on first touch
+    uint64_t resident_pages;
+    uint64_t faults;
+} vmm_region_info_t;
+
+// Reserve `size` bytes of virtual space that are backed by zeroed pages
+// on first touch. Returns NULL when no region slot is left.
+void* vmm_reserve(const char* name, uint64_t size, uint32_t flags);
+// Like vmm_reserve, but every page is committed (and zeroed) up front,
+// for buffers that are filled whole as soon as they are used. Returns
+// NULL when out of region slots or memory.
+void* vmm_alloc(const char* name, uint64_t size, uint32_t flags);
+// A fully committed kernel stack with an unmapped guard page below it
+void* vmm_stack_alloc(const char* name, uint64_t size);
+// Unmap a region from vmm_reserve, vmm_alloc or vmm_stack_alloc and free its pages
+void vmm_release(void* base);
+// Region slot `index`; returns -1 past the last slot
+int vmm_region_info(int index, vmm_region_info_t* info);
+
+static inline void* vmm_phys_to_virt(uint64_t phys) {
+    return (void*)(uintptr_t)(VMM_HHDM_BASE + phys);
+}
+
+void vmm_get_stats(vmm_stats_t* stats);
+
+#endif
@@ -5,26 +5,35 @@
 #include "../drivers/graphics/gfx_print.h"
 #include "../filesystem/filesystem.h"
 #include <string.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "shell.h"
 #include "../datetime/datetime.h"
+#include "ktime.h"
+#include "idle.h"
+#include "timer.h"
+#include "thread.h"
+#include "smp.h"
+#include "fpu.h"
+#include "memops.h"
+#include "serial.h"
+#include "workpool.h"
+#include "boot_info.h"
+#include "../memory/memory.h"
+#include "../memory/page_alloc.h"
+#include "../memory/vmm.h"
 
 #define SCREEN_HEIGHT 25
 #define SCREEN_WIDTH 80
 #define MAX_INPUT 1000
 #define HISTORY_SIZE 100
 
-static char command_history[HISTORY_SIZE][MAX_INPUT] = {0};
+// Reserved on first run and committed a page at a time as history fills
+static char (*command_history)[MAX_INPUT] = NULL;
 static int history_count = 0;
 static int history_index = -1;
 
-struct vga_char
-{
-    char character;
-    char color;
-};
-
-volatile struct vga_char *terminal_buffer = (volatile struct vga_char *)0xB8000;
 static int cursor_x = 7;
 static int cursor_y = 1;
 
@@ -35,6 +44,7 @@ void clear_line(int y);
 void print_line_with_color(int x, int y, const char *line, int fg, int bg);
 void display_loading_animation(const char *filename);
 void scroll_screen();
+void shell_newline();
 void list_files_command();
 int open_file_command(const char *filename);
 void delete_file_command(const char *filename);
@@ -42,9 +52,24 @@ void set_first_line_color();
 void start_shell();
 void create_file_command(const char *filename);
 void dt_command(void);
+void uptime_command(void);
+void serial_command(void);
+void threads_command(void);
+void cpus_command(void);
+void workers_command(void);
+void checksum_command(void);
+void bootinfo_command(void);
+void pages_command(void);
+void kmbench_command(void);
+void heap_command(void);
+void slabinfo_command(void);
+void meminfo_command(void);
+void vmm_command(void);
+void gfxbench_command(void);
+void strbench_command(const char *op);
+void regions_command(void);
 void handle_command_history(unsigned char key, char *buffer, int *buffer_index);
 void print_int(int num);
-void itoa(int num, char *str, int base);
 
 
 void handle_special_keys(char key)
@@ -54,12 +79,8 @@ void handle_special_keys(char key)
 
     if (key == '\n')
     {
-        cursor_y++;
         cursor_x = 0;
-        if (cursor_y >= SCREEN_HEIGHT)
-        {
-            scroll_screen();
-        }
+        shell_newline();
     }
     else if (key == '\b' && input_length > 0)
     {
@@ -85,11 +106,7 @@ void handle_special_keys(char key)
         if (++cursor_x >= SCREEN_WIDTH)
         {
             cursor_x = 0;
-            cursor_y++;
-            if (cursor_y >= SCREEN_HEIGHT)
-            {
-                scroll_screen();
-            }
+            shell_newline();
         }
     }
 }
@@ -121,9 +138,16 @@ void run_shell()
 {
     const char *prompt = "Shell> ";
 
+    // Without room for it the shell runs with no history
+    if (!command_history)
+    {
+        command_history = vmm_reserve("command_history", HISTORY_SIZE * MAX_INPUT, VMM_WRITE);
+    }
+
     while (1)
     {
         print_clear();
+        print_set_scroll_top(1);
         set_first_line_color();
         print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
         print_set_cursor(0, 1);
@@ -138,10 +162,19 @@ void run_shell()
 
         while (1)
         {
-            unsigned char c = keyboard_get_char();
+            unsigned char c = keyboard_wait_char();
 
             if (c != 0)
             {
+                if (c == NAV_PAGE_UP || c == NAV_PAGE_DOWN)
+                {
+                    // A page at a time, keeping one line of overlap
+                    print_scrollback(c == NAV_PAGE_UP ? SCREEN_HEIGHT - 2 : -(SCREEN_HEIGHT - 2));
+                    continue;
+                }
+                // Anything else is typed at the live prompt
+                print_scrollback_end();
+
                 if (c == '\b')
                 {
                     if (cursor_position > 0)
@@ -170,13 +203,9 @@ void run_shell()
                 else if (c == '\n')
                 {
                     buffer[buffer_index] = '\0';
-                    cursor_y++;
-                    if (cursor_y >= SCREEN_HEIGHT)
-                    {
-                        scroll_screen();
-                    }
+                    shell_newline();
 
-                    if (buffer_index > 0)
+                    if (buffer_index > 0 && command_history)
                     {
                         strncpy(command_history[history_count % HISTORY_SIZE], buffer, MAX_INPUT);
                         history_count++;
@@ -252,6 +281,70 @@ void run_shell()
                     {
                         font_reset_command();
                     }
+                    else if (strncmp(buffer, "workers", 7) == 0)
+                    {
+                        workers_command();
+                    }
+                    else if (strncmp(buffer, "meminfo", 7) == 0)
+                    {
+                        meminfo_command();
+                    }
+                    else if (strncmp(buffer, "slabinfo", 8) == 0)
+                    {
+                        slabinfo_command();
+                    }
+                    else if (strncmp(buffer, "heap", 4) == 0)
+                    {
+                        heap_command();
+                    }
+                    else if (strncmp(buffer, "kmbench", 7) == 0)
+                    {
+                        kmbench_command();
+                    }
+                    else if (strncmp(buffer, "regions", 7) == 0)
+                    {
+                        regions_command();
+                    }
+                    else if (strncmp(buffer, "gfxbench", 8) == 0)
+                    {
+                        gfxbench_command();
+                    }
+                    else if (strncmp(buffer, "strbench", 8) == 0)
+                    {
+                        strbench_command(&buffer[8]);
+                    }
+                    else if (strncmp(buffer, "vmm", 3) == 0)
+                    {
+                        vmm_command();
+                    }
+                    else if (strncmp(buffer, "pages", 5) == 0)
+                    {
+                        pages_command();
+                    }
+                    else if (strncmp(buffer, "bootinfo", 8) == 0)
+                    {
+                        bootinfo_command();
+                    }
+                    else if (strncmp(buffer, "checksum", 8) == 0)
+                    {
+                        checksum_command();
+                    }
+                    else if (strncmp(buffer, "cpus", 4) == 0)
+                    {
+                        cpus_command();
+                    }
+                    else if (strncmp(buffer, "threads", 7) == 0)
+                    {
+                        threads_command();
+                    }
+                    else if (strncmp(buffer, "uptime", 6) == 0)
+                    {
+                        uptime_command();
+                    }
+                    else if (strncmp(buffer, "serial", 6) == 0)
+                    {
+                        serial_command();
+                    }
                     else if (strncmp(buffer, "help", 4) == 0)
                     {
                         help_command();
@@ -262,11 +355,7 @@ void run_shell()
                         print_set_cursor(0, cursor_y);
                         print_str("Unknown command: ");
                         print_str(buffer);
-                        cursor_y++;
-                        if (cursor_y >= SCREEN_HEIGHT)
-                        {
-                            scroll_screen();
-                        }
+                        shell_newline();
                     }
 
                     buffer_index = 0;
@@ -340,9 +429,6 @@ void run_shell()
                         print_set_cursor(cursor_x, cursor_y);
                     }
                 }
-            } else {
-                // Add small delay when no input to reduce CPU usage
-                for (volatile int i = 0; i < 500; i++) {}
             }
         }
     }
@@ -367,15 +453,8 @@ void handle_command_history(unsigned char key, char *buffer, int *buffer_index)
         }
     }
 
-    // Clear current input more efficiently
-    unsigned char* video_memory = (unsigned char*)0xB8000;
-    unsigned char color = PRINT_COLOR_WHITE | (PRINT_COLOR_BLACK << 4);
-    
-    for (int x = prompt_len; x < SCREEN_WIDTH; x++)
-    {
-        video_memory[(cursor_y * SCREEN_WIDTH + x) * 2] = ' ';
-        video_memory[(cursor_y * SCREEN_WIDTH + x) * 2 + 1] = color;
-    }
+    // Clear current input
+    print_fill(prompt_len, cursor_y, SCREEN_WIDTH - prompt_len, PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
 
     cursor_x = prompt_len;
     print_set_cursor(cursor_x, cursor_y);
@@ -409,15 +488,7 @@ void clear_line(int y)
 {
     if (y > 0)
     {
-        // Direct VGA memory access for faster clearing
-        unsigned char* video_memory = (unsigned char*)0xB8000;
-        unsigned char color = PRINT_COLOR_WHITE | (PRINT_COLOR_BLACK << 4);
-        
-        for (int i = 0; i < SCREEN_WIDTH; i++)
-        {
-            video_memory[(y * SCREEN_WIDTH + i) * 2] = ' ';
-            video_memory[(y * SCREEN_WIDTH + i) * 2 + 1] = color;
-        }
+        print_fill(0, y, SCREEN_WIDTH, PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
     }
 }
 
@@ -433,63 +504,650 @@ void print_line_with_color(int x, int y, const char *line, int fg, int bg)
 
 void scroll_screen()
 {
-    // Much faster scrolling using memory copy
-    unsigned char* video_memory = (unsigned char*)0xB8000;
-    unsigned char color = PRINT_COLOR_WHITE | (PRINT_COLOR_BLACK << 4);
-    
-    // Save first line
-    unsigned char first_line[SCREEN_WIDTH * 2];
-    for (int i = 0; i < SCREEN_WIDTH * 2; i++)
+    // Line 0 is the header and stays put
+    print_scroll(1, PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
+    cursor_y = SCREEN_HEIGHT - 1;
+}
+
+// Move down a row, scrolling when it runs off the bottom
+void shell_newline()
+{
+    cursor_y++;
+    if (cursor_y >= SCREEN_HEIGHT)
     {
-        first_line[i] = video_memory[i];
+        scroll_screen();
     }
-    
-    // Scroll up (copy line by line for better performance)
-    for (int y = 2; y < SCREEN_HEIGHT; y++)
+}
+
+// Start a new output row and print to it the way kprintf does
+static void __attribute__((format(printf, 1, 2))) shell_row(const char *format, ...)
+{
+    shell_newline();
+    print_set_cursor(0, cursor_y);
+    va_list args;
+    va_start(args, format);
+    vkprintf(format, args);
+    va_end(args);
+}
+
+void dt_command()
+{
+    struct tm time = get_rtc_time();
+    adjust_time_for_nepal(&time);
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    print_time(&time);
+    shell_newline();
+
+    cursor_x = 0;
+    print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
+    print_set_cursor(cursor_x, cursor_y);
+    print_str("Shell> ");
+    cursor_x = strlen("Shell> ");
+}
+
+void uptime_command()
+{
+    uint64_t uptime_ms = ktime_now() / NSEC_PER_MSEC;
+    uint64_t idle_ms = idle_time_ns() / NSEC_PER_MSEC;
+    int idle_percent = uptime_ms ? (int)(idle_ms * 100 / uptime_ms) : 0;
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("Up %llus, halted %llus (%d%% idle, %llu halts, %llu timer irqs)",
+            (unsigned long long)(uptime_ms / 1000), (unsigned long long)(idle_ms / 1000), idle_percent,
+            (unsigned long long)idle_halt_count(), (unsigned long long)timer_interrupt_count());
+    shell_newline();
+}
+
+void serial_command()
+{
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    if (!serial_present())
+    {
+        kprintf("No UART on COM1");
+    }
+    else
+    {
+        serial_stats_t stats;
+        serial_get_stats(&stats);
+        kprintf("COM1 %d baud: %llu bytes out (%llu irqs), %llu writes refused, %llu in",
+                SERIAL_BAUD, (unsigned long long)stats.tx_bytes, (unsigned long long)stats.tx_interrupts,
+                (unsigned long long)stats.tx_rejected, (unsigned long long)stats.rx_bytes);
+    }
+    shell_newline();
+}
+
+void threads_command()
+{
+    static const char* state_names[] = {"ready", "run", "block", "dead"};
+    thread_stats_t stats;
+    thread_get_stats(&stats);
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("ID  NAME          STATE PRIO  CPU(ms)  SWITCHES  MAXWAKE(us)");
+    for (thread_t* thread = thread_first(); thread; thread = thread->all_next)
+    {
+        shell_row("%-4llu%-14s%-6s%-6d%-9llu%-10llu%llu", (unsigned long long)thread->id, thread->name,
+                  state_names[thread->state], thread->priority,
+                  (unsigned long long)(thread_cpu_time_ns(thread) / NSEC_PER_MSEC),
+                  (unsigned long long)thread->switches_in, (unsigned long long)(thread->max_wakeup_ns / NSEC_PER_USEC));
+    }
+
+    shell_row("Switches %llu (%llu preempted), switch %lluns, wake avg %lluus max %lluus",
+              (unsigned long long)stats.switches, (unsigned long long)stats.preemptions,
+              (unsigned long long)(stats.switches ? ktime_cycles_to_ns(stats.switch_cycles) / stats.switches : 0),
+              (unsigned long long)(stats.wakeups ? stats.wakeup_ns_total / stats.wakeups / NSEC_PER_USEC : 0),
+              (unsigned long long)(stats.wakeup_ns_max / NSEC_PER_USEC));
+    shell_newline();
+}
+
+void cpus_command()
+{
+    uint64_t uptime = ktime_now();
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("CPU  APIC ID  STATE  IDLE%%  HALTS     JOBS");
+    for (uint32_t i = 0; i < smp_cpu_count(); i++)
+    {
+        cpu_local_t* cpu = smp_cpu(i);
+        shell_row("%-5u%-9u%-7s%-7d%-10llu%llu", (unsigned)cpu->index, (unsigned)cpu->apic_id,
+                  i == 0 ? "boot" : (smp_cpu_busy(i) ? "busy" : "idle"),
+                  uptime ? (int)(cpu_idle_time_ns(cpu) * 100 / uptime) : 0,
+                  (unsigned long long)cpu->halt_count, (unsigned long long)cpu->work_done);
+    }
+
+    fpu_stats_t fpu;
+    fpu_get_stats(&fpu);
+    shell_row("FPU:%s%s%s%s%s, %u B state", fpu.features & FPU_SSE ? " SSE" : "",
+              fpu.features & FPU_XSAVE ? " XSAVE" : " FXSAVE", fpu.features & FPU_XSAVEOPT ? " XSAVEOPT" : "",
+              fpu.features & FPU_AVX ? " AVX" : "", fpu.features & FPU_AVX2 ? " AVX2" : "", (unsigned)fpu.state_size);
+    shell_row("     %llu lazy restores, %llu saves, %llu parked for handlers", (unsigned long long)fpu.restores,
+              (unsigned long long)fpu.saves, (unsigned long long)fpu.interrupt_saves);
+    shell_newline();
+}
+
+void workers_command()
+{
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("CPU  CHUNKS    ITERATIONS  STEALS    FAILED");
+    for (uint32_t i = 0; i < smp_cpu_count(); i++)
+    {
+        workpool_stats_t stats;
+        workpool_get_stats(i, &stats);
+        shell_row("%-5u%-10llu%-12llu%-10llu%llu", (unsigned)i, (unsigned long long)stats.executed,
+                  (unsigned long long)stats.iterations, (unsigned long long)stats.steals,
+                  (unsigned long long)stats.failed_steals);
+    }
+    shell_newline();
+}
+
+void checksum_command()
+{
+    uint32_t checksum;
+    uint64_t start = ktime_now();
+
+    print_set_cursor(0, cursor_y);
+    if (fs_checksum(&checksum) < 0)
+    {
+        print_set_color(PRINT_COLOR_RED, PRINT_COLOR_BLACK);
+        kprintf("Disk read failed.");
+    }
+    else
+    {
+        print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+        kprintf("File table checksum %08X in %llu ms", (unsigned)checksum,
+                (unsigned long long)((ktime_now() - start) / NSEC_PER_MSEC));
+    }
+    shell_newline();
+}
+
+void bootinfo_command()
+{
+    const boot_info_t *info = boot_info();
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("BASE              LENGTH            TYPE");
+    for (uint32_t i = 0; i < info->mmap_count; i++)
+    {
+        shell_row("%016llX  %016llX  %u", (unsigned long long)info->mmap[i].base,
+                  (unsigned long long)info->mmap[i].length, (unsigned)info->mmap[i].type);
+    }
+
+    shell_row("Usable RAM: %llu MB", (unsigned long long)(memory_usable_bytes() >> 20));
+
+    if (info->has_framebuffer)
+    {
+        shell_row("Framebuffer: %08llX %ux%ux%u%s", (unsigned long long)info->framebuffer.address,
+                  (unsigned)info->framebuffer.width, (unsigned)info->framebuffer.height,
+                  (unsigned)info->framebuffer.bpp, info->framebuffer.type == BOOT_FRAMEBUFFER_TEXT ? " (text)" : "");
+    }
+    else
     {
-        for (int i = 0; i < SCREEN_WIDTH * 2; i++)
+        shell_row("Framebuffer: none");
+    }
+
+    shell_row("ACPI RSDP: %s", info->rsdp_length ? (info->rsdp_length > 20 ? "v2 from GRUB" : "v1 from GRUB") : "BIOS scan");
+    shell_row("Command line: %s", info->cmdline);
+
+    for (uint32_t i = 0; i < info->module_count; i++)
+    {
+        shell_row("Module %08llX-%08llX %s", (unsigned long long)info->modules[i].start,
+                  (unsigned long long)info->modules[i].end, info->modules[i].name);
+    }
+
+    shell_newline();
+}
+
+void pages_command()
+{
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("ZONE    TOTAL KB  FREE KB   FREE BLOCKS BY ORDER 0-10");
+    for (int zone = 0; zone < ZONE_COUNT; zone++)
+    {
+        page_zone_info_t info;
+        page_zone_info(zone, &info);
+        shell_row("%-8s%-10llu%-10llu", info.name, (unsigned long long)(info.total_pages * (PAGE_SIZE / 1024)),
+                  (unsigned long long)(info.free_pages * (PAGE_SIZE / 1024)));
+        for (int order = 0; order <= PAGE_MAX_ORDER; order++)
         {
-            video_memory[(y - 1) * SCREEN_WIDTH * 2 + i] = video_memory[y * SCREEN_WIDTH * 2 + i];
+            kprintf("%llu ", (unsigned long long)info.free_blocks[order]);
         }
     }
-    
-    // Clear last line
-    for (int i = 0; i < SCREEN_WIDTH; i++)
+
+    shell_newline();
+}
+
+#define KMBENCH_BATCH 256
+#define KMBENCH_ROUNDS 16
+#define KMBENCH_CHURN 20000
+
+static uint32_t kmbench_random(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+void kmbench_command()
+{
+    static void *ptrs[KMBENCH_BATCH];
+    static uint32_t sizes[KMBENCH_BATCH];
+    static const uint32_t bench_sizes[] = {16, 64, 256, 1024, 2048, 8192};
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("SIZE    ALLOC NS  FREE NS");
+
+    // Latency: fill a batch, then empty it, so slabs are created and retired
+    for (int s = 0; s < (int)(sizeof(bench_sizes) / sizeof(bench_sizes[0])); s++)
     {
-        video_memory[((SCREEN_HEIGHT - 1) * SCREEN_WIDTH + i) * 2] = ' ';
-        video_memory[((SCREEN_HEIGHT - 1) * SCREEN_WIDTH + i) * 2 + 1] = color;
+        uint64_t alloc_cycles = 0, free_cycles = 0;
+        for (int round = 0; round < KMBENCH_ROUNDS; round++)
+        {
+            uint64_t start = tsc_read();
+            for (int i = 0; i < KMBENCH_BATCH; i++)
+            {
+                ptrs[i] = kmalloc(bench_sizes[s]);
+            }
+            uint64_t mid = tsc_read();
+            for (int i = 0; i < KMBENCH_BATCH; i++)
+            {
+                kfree(ptrs[i]);
+            }
+            free_cycles += tsc_read() - mid;
+            alloc_cycles += mid - start;
+        }
+
+        shell_row("%-8u%-10llu%llu", (unsigned)bench_sizes[s],
+                  (unsigned long long)(ktime_cycles_to_ns(alloc_cycles) / (KMBENCH_ROUNDS * KMBENCH_BATCH)),
+                  (unsigned long long)(ktime_cycles_to_ns(free_cycles) / (KMBENCH_ROUNDS * KMBENCH_BATCH)));
     }
-    
-    // Restore first line
-    for (int i = 0; i < SCREEN_WIDTH * 2; i++)
+
+    // Fragmentation: random sizes, random frees, then compare what is
+    // live with what the slabs hold
+    uint32_t seed = 12345;
+    uint64_t live_bytes = 0;
+    for (int i = 0; i < KMBENCH_BATCH; i++)
     {
-        video_memory[i] = first_line[i];
+        ptrs[i] = NULL;
     }
-    
-    cursor_y = SCREEN_HEIGHT - 1;
+    for (int op = 0; op < KMBENCH_CHURN; op++)
+    {
+        int slot = kmbench_random(&seed) % KMBENCH_BATCH;
+        if (ptrs[slot])
+        {
+            kfree(ptrs[slot]);
+            live_bytes -= sizes[slot];
+            ptrs[slot] = NULL;
+        }
+        else
+        {
+            // Mostly small objects with a tail up to 2 KB
+            uint32_t size = (kmbench_random(&seed) & 3) ? 8 + kmbench_random(&seed) % 120 : 8 + kmbench_random(&seed) % 2040;
+            ptrs[slot] = kmalloc(size);
+            if (ptrs[slot])
+            {
+                sizes[slot] = size;
+                live_bytes += size;
+            }
+        }
+    }
+
+    kmalloc_stats_t stats;
+    kmalloc_get_stats(&stats);
+    uint64_t held = stats.slab_pages * PAGE_SIZE;
+    shell_row("Churn: %llu KB live in %llu KB of slabs (%d%% used)", (unsigned long long)(live_bytes / 1024),
+              (unsigned long long)(held / 1024), held ? (int)(live_bytes * 100 / held) : 0);
+
+    for (int i = 0; i < KMBENCH_BATCH; i++)
+    {
+        kfree(ptrs[i]);
+    }
+
+    shell_newline();
 }
 
-void dt_command()
+void heap_command()
 {
-    struct tm time = get_rtc_time();
-    adjust_time_for_nepal(&time);
-    char time_str[32];
-    simple_snprintf(time_str, time.tm_year + 1900, time.tm_mon + 1, time.tm_mday,
-                    time.tm_hour, time.tm_min, time.tm_sec);
+    kmalloc_stats_t stats;
+    kmalloc_get_stats(&stats);
+
     print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
     print_set_cursor(0, cursor_y);
-    print_str(time_str);
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT)
+    kprintf("Live %llu KB, peak %llu KB, %llu allocs, %llu frees, %llu callocs",
+            (unsigned long long)(stats.usage.live_bytes / 1024), (unsigned long long)(stats.usage.peak_bytes / 1024),
+            (unsigned long long)stats.usage.allocs, (unsigned long long)stats.usage.frees,
+            (unsigned long long)stats.usage.callocs);
+    shell_row("realloc: %llu in place, %llu moved; large blocks %llu (%llu KB)",
+              (unsigned long long)stats.usage.realloc_in_place, (unsigned long long)stats.usage.realloc_moved,
+              (unsigned long long)stats.large_blocks, (unsigned long long)(stats.large_pages * (PAGE_SIZE / 1024)));
+
+    shell_row("CLASS   SLABS     ACTIVE    FREE");
+    for (int i = 0; i < KMALLOC_CLASS_COUNT; i++)
     {
-        scroll_screen();
+        shell_row("%-8u%-10llu%-10llu%llu", (unsigned)stats.classes[i].object_size,
+                  (unsigned long long)stats.classes[i].slabs, (unsigned long long)stats.classes[i].active_objects,
+                  (unsigned long long)stats.classes[i].free_objects);
     }
 
-    cursor_x = 0;
-    print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
-    print_set_cursor(cursor_x, cursor_y);
-    print_str("Shell> ");
-    cursor_x = strlen("Shell> ");
+    shell_newline();
+}
+
+void meminfo_command()
+{
+    kmalloc_stats_t stats;
+    kmalloc_profile_t profile;
+    kmalloc_get_stats(&stats);
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("Heap live %llu KB, peak %llu KB", (unsigned long long)(stats.usage.live_bytes / 1024),
+            (unsigned long long)(stats.usage.peak_bytes / 1024));
+
+    // External fragmentation: how much of the free memory is unusable
+    // for a request as large as the largest free block
+    uint64_t free_pages = 0;
+    int largest_order = -1;
+    for (int zone = 0; zone < ZONE_COUNT; zone++)
+    {
+        page_zone_info_t info;
+        page_zone_info(zone, &info);
+        free_pages += info.free_pages;
+        for (int order = PAGE_MAX_ORDER; order > largest_order; order--)
+        {
+            if (info.free_blocks[order])
+            {
+                largest_order = order;
+            }
+        }
+    }
+    uint64_t largest_pages = largest_order >= 0 ? 1ULL << largest_order : 0;
+    shell_row("Free %llu KB, largest free block %llu KB, fragmentation %d%%",
+              (unsigned long long)(free_pages * (PAGE_SIZE / 1024)), (unsigned long long)(largest_pages * (PAGE_SIZE / 1024)),
+              free_pages ? (int)(100 - largest_pages * 100 / free_pages) : 0);
+
+    if (kmalloc_get_profile(&profile) < 0)
+    {
+        shell_row("Profiling disabled (KMALLOC_PROFILE=0)");
+        shell_newline();
+        return;
+    }
+
+    // Internal fragmentation: bytes granted beyond what callers asked for
+    shell_row("Requested %llu KB, granted %llu KB, waste %d%%, %llu untracked",
+              (unsigned long long)(profile.requested_bytes / 1024), (unsigned long long)(profile.granted_bytes / 1024),
+              profile.granted_bytes ? (int)(100 - profile.requested_bytes * 100 / profile.granted_bytes) : 0,
+              (unsigned long long)profile.untracked);
+
+    // Bucket b counts requests of up to 16 << b bytes, four to a row
+    shell_row("Sizes:");
+    for (int bucket = 0; bucket < KMALLOC_HISTOGRAM_BUCKETS; bucket++)
+    {
+        char cell[24];
+        int limit = KMALLOC_MIN_SIZE << bucket;
+        snprintf(cell, sizeof(cell), "<=%d%s%s %llu", bucket < 6 ? limit : limit / 1024, bucket < 6 ? "" : "K",
+                 bucket == KMALLOC_HISTOGRAM_BUCKETS - 1 ? "+" : "", (unsigned long long)profile.histogram[bucket]);
+        if (bucket % 4 == 0)
+        {
+            shell_row("  ");
+        }
+        kprintf("%-18s", cell);
+    }
+
+    shell_row("CALLER              LIVE KB  PEAK KB  ALLOCS   FREES");
+    for (int i = 0; i < KMALLOC_PROFILE_TOP && profile.top[i].caller; i++)
+    {
+        shell_row("%016llX    %-9llu%-9llu%-9llu%llu", (unsigned long long)profile.top[i].caller,
+                  (unsigned long long)(profile.top[i].live_bytes / 1024),
+                  (unsigned long long)(profile.top[i].peak_bytes / 1024), (unsigned long long)profile.top[i].allocs,
+                  (unsigned long long)profile.top[i].frees);
+    }
+
+    shell_newline();
+}
+void slabinfo_command()
+{
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("CACHE          SIZE  SLOT  ACTIVE  FREE    TOTAL   COLORS");
+    for (kmem_cache_t *cache = kmem_cache_next(NULL); cache; cache = kmem_cache_next(cache))
+    {
+        kmem_cache_stats_t stats;
+        kmem_cache_get_stats(cache, &stats);
+        shell_row("%-15s%-6u%-6u%-8llu%-8llu%-8llu%u", stats.name, (unsigned)stats.object_size,
+                  (unsigned)stats.slot_size, (unsigned long long)stats.active_objects,
+                  (unsigned long long)stats.free_objects, (unsigned long long)stats.total_objects,
+                  (unsigned)stats.colors);
+    }
+
+    shell_newline();
+}
+
+void vmm_command()
+{
+    vmm_stats_t stats;
+    vmm_get_stats(&stats);
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("NX %s, 1 GB pages %s, PAT write-combining %s", stats.nx ? "on" : "unsupported",
+            stats.gb_pages ? "yes" : "no", stats.pat ? "yes" : "no");
+    shell_row("Direct map: %llu MB at %016llX", (unsigned long long)(stats.hhdm_bytes / (1024 * 1024)), VMM_HHDM_BASE);
+    shell_row("MMIO: %llu KB at %016llX", (unsigned long long)(stats.mmio_bytes / 1024), VMM_MMIO_BASE);
+    shell_row("Table pages: %llu, splits %llu, TLB invalidations %llu, shootdowns %llu",
+              (unsigned long long)stats.table_pages, (unsigned long long)stats.splits,
+              (unsigned long long)stats.invalidations, (unsigned long long)stats.shootdowns);
+
+    shell_newline();
+}
+
+void regions_command()
+{
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    kprintf("REGION           SIZE KB  RESIDENT KB  FAULTS");
+    vmm_region_info_t info;
+    for (int i = 0; vmm_region_info(i, &info) == 0; i++)
+    {
+        if (!info.name)
+        {
+            continue;
+        }
+        shell_row("%-17s%-9llu%-13llu", info.name, (unsigned long long)(info.size / 1024),
+                  (unsigned long long)(info.resident_pages * (PAGE_SIZE / 1024)));
+        if (info.lazy)
+        {
+            kprintf("%llu", (unsigned long long)info.faults);
+        }
+        else
+        {
+            kprintf("%s", info.guard ? "- (guarded)" : "-");
+        }
+    }
+
+    shell_newline();
+}
+
+#define GFXBENCH_CLEARS 8
+#define GFXBENCH_SCROLLS 4
+
+// Average microseconds for a clear and a scroll with the framebuffer
+// mapped as `flags`
+static void gfxbench_run(const char *label, uint32_t flags)
+{
+    graphics_info_t *gfx = graphics_get_info();
+    vmm_protect((uintptr_t)gfx->framebuffer & ~(VMM_PAGE_4K - 1),
+                ((uint64_t)gfx->pitch * gfx->height + ((uintptr_t)gfx->framebuffer & (VMM_PAGE_4K - 1)) + VMM_PAGE_4K - 1) & ~(VMM_PAGE_4K - 1),
+                flags);
+
+    uint64_t start = tsc_read();
+    for (int i = 0; i < GFXBENCH_CLEARS; i++)
+    {
+        graphics_clear(i & 1 ? COLOR_BLACK : COLOR_DARK_GRAY);
+    }
+    uint64_t mid = tsc_read();
+    for (int i = 0; i < GFXBENCH_SCROLLS; i++)
+    {
+        gfx_print_scroll_up();
+    }
+    uint64_t end = tsc_read();
+
+    shell_row("%-16s%-12llu%llu", label, (unsigned long long)(ktime_cycles_to_ns(mid - start) / (GFXBENCH_CLEARS * 1000)),
+              (unsigned long long)(ktime_cycles_to_ns(end - mid) / (GFXBENCH_SCROLLS * 1000)));
+}
+
+void gfxbench_command()
+{
+    graphics_info_t *gfx = graphics_get_info();
+    bool was_initialized = gfx->initialized;
+    if (!was_initialized)
+    {
+        graphics_init(boot_info());
+    }
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    if (!gfx->initialized)
+    {
+        kprintf("No linear framebuffer");
+    }
+    else
+    {
+        vmm_stats_t stats;
+        vmm_get_stats(&stats);
+        kprintf("MAPPING         CLEAR US    SCROLL US");
+        gfxbench_run("Uncached", VMM_WRITE | VMM_UNCACHED);
+        gfxbench_run(stats.pat ? "Write-combining" : "WC (no PAT, UC)", VMM_WRITE | VMM_WRITE_COMBINING);
+        gfx->initialized = was_initialized;
+    }
+
+    shell_newline();
+}
+
+#define STRBENCH_MAX (8 * 1024 * 1024)
+#define STRBENCH_WORK (32 * 1024 * 1024) // Bytes processed per size and version
+
+enum { STRBENCH_MEMCPY, STRBENCH_MEMSET, STRBENCH_MEMCMP, STRBENCH_MEMCHR, STRBENCH_STRLEN };
+
+// Nanoseconds for `rounds` calls of one routine on `size` bytes. The
+// source holds no zero byte, so memchr and strlen scan to the end.
+static uint64_t strbench_run(const memops_t *ops, int op, uint8_t *dst, uint8_t *src, size_t size, uint64_t rounds)
+{
+    size_t acc = 0;
+
+    src[size] = 0;
+    uint64_t start = tsc_read();
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        switch (op)
+        {
+        case STRBENCH_MEMCPY:
+            ops->memcpy(dst, src, size);
+            break;
+        case STRBENCH_MEMSET:
+            ops->memset(dst, (int)i, size);
+            break;
+        case STRBENCH_MEMCMP:
+            acc += ops->memcmp(dst, src, size);
+            break;
+        case STRBENCH_MEMCHR:
+            acc += (size_t)ops->memchr(src, 0, size);
+            break;
+        default:
+            acc += ops->strlen((const char *)src);
+            break;
+        }
+    }
+    // Keep the results alive, and computed before the clock stops
+    __asm__ volatile("" : : "r"(acc));
+    uint64_t end = tsc_read();
+    src[size] = 'a';
+    return ktime_cycles_to_ns(end - start);
+}
+
+void strbench_command(const char *op_name)
+{
+    static const char *ops[] = {"memcpy", "memset", "memcmp", "memchr", "strlen"};
+    static const uint32_t sizes[] = {8, 64, 512, 4096, 32768, 262144, 2097152, STRBENCH_MAX};
+    static const char *size_names[] = {"8", "64", "512", "4K", "32K", "256K", "2M", "8M"};
+
+    while (*op_name == ' ')
+    {
+        op_name++;
+    }
+    int op = STRBENCH_MEMCPY;
+    if (*op_name)
+    {
+        for (op = 0; op < (int)(sizeof(ops) / sizeof(ops[0])); op++)
+        {
+            if (strcmp(op_name, ops[op]) == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    print_set_color(PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    print_set_cursor(0, cursor_y);
+    if (op == (int)(sizeof(ops) / sizeof(ops[0])))
+    {
+        kprintf("Usage: strbench [memcpy|memset|memcmp|memchr|strlen]");
+        shell_newline();
+        return;
+    }
+
+    // Source and destination in separate halves, with a byte past the
+    // largest source for strlen's terminator
+    uint8_t *buffer = vmm_reserve("strbench", 2 * STRBENCH_MAX + VMM_PAGE_4K, VMM_WRITE);
+    if (!buffer)
+    {
+        kprintf("Out of memory");
+        shell_newline();
+        return;
+    }
+    uint8_t *src = buffer;
+    uint8_t *dst = buffer + STRBENCH_MAX + VMM_PAGE_4K;
+    memset(buffer, 'a', 2 * STRBENCH_MAX + VMM_PAGE_4K);
+
+    kprintf("%s MB/s, active: %s, non-temporal from %llu KB", ops[op], memops.name,
+            (unsigned long long)(memops_nt_threshold() / 1024));
+
+    // A column per version; ones this CPU cannot run stay blank
+    shell_row("%-8s", "SIZE");
+    const memops_t *variant;
+    int result;
+    for (int v = 0; (result = memops_variant(v, &variant)) >= 0; v++)
+    {
+        kprintf("%-10s", result ? variant->name : "");
+    }
+
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        shell_row("%-8s", size_names[s]);
+        uint64_t rounds = STRBENCH_WORK / sizes[s];
+        for (int v = 0; (result = memops_variant(v, &variant)) >= 0; v++)
+        {
+            if (!result)
+            {
+                kprintf("%-10s", "");
+                continue;
+            }
+            // One untimed pass so the first version does not pay for the caches
+            strbench_run(variant, op, dst, src, sizes[s], 1);
+            uint64_t ns = strbench_run(variant, op, dst, src, sizes[s], rounds);
+            kprintf("%-10llu", (unsigned long long)(ns ? (uint64_t)STRBENCH_WORK * 1000 / ns : 0));
+        }
+    }
+
+    vmm_release(buffer);
+
+    shell_newline();
 }
 
 void create_file_command(const char *filename)
@@ -516,11 +1174,7 @@ void create_file_command(const char *filename)
         print_str(" could not be created");
     }
 
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT)
-    {
-        scroll_screen();
-    }
+    shell_newline();
 
     cursor_x = 0;
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
@@ -613,7 +1267,30 @@ void create_file_command(const char *filename)
 
 
 
+#define EDITOR_CONSOLE 1 // Alt+F2
+
+static char editor_filename[FILENAME_LENGTH];
+static volatile int editor_running = 0;
+
+// The editor gets its own thread and console, so the shell stays usable
+// on Alt+F1 while a file is open. Esc closes it and comes back here.
+static void editor_thread(void *arg) {
+    (void)arg;
+    print_set_console(EDITOR_CONSOLE);
+    print_show_console(EDITOR_CONSOLE);
+    display_textfile(editor_filename);
+    klog("Closed %s", editor_filename);
+    print_show_console(0);
+    editor_running = 0;
+}
+
 int open_file_command(const char *filename) {
+    if (editor_running) {
+        // One editor at a time: go back to the open one
+        print_show_console(EDITOR_CONSOLE);
+        return 0;
+    }
+
     int file_index = fs_open(filename);  
 
     if (file_index == -1) {
@@ -621,10 +1298,7 @@ int open_file_command(const char *filename) {
         print_str(filename);
         print_str(" does not exist");
 
-        cursor_y++;
-        if (cursor_y >= SCREEN_HEIGHT) {
-            scroll_screen();
-        }
+        shell_newline();
 
         cursor_x = 0;
         print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
@@ -634,14 +1308,21 @@ int open_file_command(const char *filename) {
         return -1;  
     }
 
-    FileEntry *file = &file_table[file_index];
-    display_textfile(filename);
-
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
+    strncpy(editor_filename, filename, FILENAME_LENGTH - 1);
+    editor_filename[FILENAME_LENGTH - 1] = '\0';
+    editor_running = 1;
+    thread_t *editor = thread_create("editor", editor_thread, 0, THREAD_PRIORITY_NORMAL);
+    if (editor) {
+        thread_detach(editor);
+        klog("Editing %s", editor_filename);
+        print_line_with_color(0, cursor_y, "Editing on Alt+F2; Esc closes it", PRINT_COLOR_LIGHT_CYAN, PRINT_COLOR_BLACK);
+    } else {
+        editor_running = 0;
+        print_line_with_color(0, cursor_y, "Error: No memory for the editor", PRINT_COLOR_RED, PRINT_COLOR_BLACK);
     }
 
+    shell_newline();
+
     cursor_x = 0;
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
     print_set_cursor(cursor_x, cursor_y);
@@ -653,46 +1334,7 @@ int open_file_command(const char *filename) {
 
 
 void print_int(int num) {
-    char buffer[16];
-    itoa(num, buffer, 10);
-    print_str(buffer);
-}
-
-void itoa(int num, char *str, int base) {
-    int i = 0;
-    int isNegative = 0;
-
-    if (num == 0) {
-        str[i++] = '0';
-        str[i] = '\0';
-        return;
-    }
-
-    if (num < 0 && base == 10) {
-        isNegative = 1;
-        num = -num;
-    }
-
-    while (num != 0) {
-        int rem = num % base;
-        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
-        num = num / base;
-    }
-
-    if (isNegative) {
-        str[i++] = '-';
-    }
-
-    str[i] = '\0';
-    int start = 0;
-    int end = i - 1;
-    while (start < end) {
-        char temp = str[start];
-        str[start] = str[end];
-        str[end] = temp;
-        start++;
-        end--;
-    }
+    kprintf("%d", num);
 }
 
 void delete_file_command(const char *file)
@@ -718,11 +1360,7 @@ void delete_file_command(const char *file)
         print_str(" does not exist");
     }
 
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT)
-    {
-        scroll_screen();
-    }
+    shell_newline();
 
     cursor_x = 0;
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
@@ -734,7 +1372,12 @@ void delete_file_command(const char *file)
 void list_files_command()
 {
     char *files = list_files();
-    if (files != NULL && strlen(files) > 0)
+    if (files == NULL)
+    {
+        print_line_with_color(0, cursor_y, "No memory for the file table.", PRINT_COLOR_RED, PRINT_COLOR_BLACK);
+        shell_newline();
+    }
+    else if (strlen(files) > 0)
     {
         char *file = strtok(files, "\n");
         while (file != NULL)
@@ -748,23 +1391,14 @@ void list_files_command()
             }
 
             print_str(file);
-            cursor_y++;
-            if (cursor_y >= SCREEN_HEIGHT)
-            {
-                scroll_screen();
-            }
+            shell_newline();
             file = strtok(NULL, "\n");
         }
-        free(files);
     }
     else
     {
         print_line_with_color(0, cursor_y, "No files found!", PRINT_COLOR_RED, PRINT_COLOR_BLACK);
-        cursor_y++;
-        if (cursor_y >= SCREEN_HEIGHT)
-        {
-            scroll_screen();
-        }
+        shell_newline();
     }
 
     cursor_x = 0;
@@ -826,8 +1460,8 @@ void font_demo_command() {
         graphics_draw_string_aa(50, 100, "Font Demo - SecureOS", COLOR_WHITE, COLOR_BLACK, &demo_style);
         graphics_draw_string_aa(50, 150, "Graphics Mode Active!", COLOR_GREEN, COLOR_BLACK, &demo_style);
         
-        // Wait for user input
-        for (volatile int i = 0; i < 100000000; i++) {}
+        // Leave the demo up for a moment
+        msleep(1500);
         
         // Return to text mode
         print_clear();
@@ -840,10 +1474,7 @@ void font_demo_command() {
         print_str("Graphics mode not available. Font demo requires graphics.");
     }
     
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
-    }
+    shell_newline();
 }
 
 void font_size_command(font_size_t size) {
@@ -862,10 +1493,7 @@ void font_size_command(font_size_t size) {
     print_str("Font size set to: ");
     print_str(size_name);
     
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
-    }
+    shell_newline();
 }
 
 void font_weight_command(font_weight_t weight) {
@@ -876,10 +1504,7 @@ void font_weight_command(font_weight_t weight) {
     print_str("Font weight set to: ");
     print_str(weight_name);
     
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
-    }
+    shell_newline();
 }
 
 void font_antialiasing_command(int enabled) {
@@ -890,10 +1515,7 @@ void font_antialiasing_command(int enabled) {
     print_str("Font anti-aliasing: ");
     print_str(status);
     
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
-    }
+    shell_newline();
 }
 
 void font_reset_command() {
@@ -910,10 +1532,7 @@ void font_reset_command() {
     print_set_cursor(0, cursor_y);
     print_str("  Anti-aliasing: Disabled");
     
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
-    }
+    shell_newline();
 }
 
 void help_command() {
@@ -940,6 +1559,24 @@ void help_command() {
         "  font-aa-on   - Enable anti-aliasing",
         "  font-aa-off  - Disable anti-aliasing",
         "  font-reset   - Reset font to defaults",
+        "  uptime       - Show uptime and idle time",
+        "  serial       - Show COM1 console traffic and writes turned away",
+        "  threads      - List threads and scheduler stats",
+        "  cpus         - List online CPUs and their APIC IDs",
+        "  workers      - Show parallel_for chunks and steals per CPU",
+        "  checksum     - Checksum the file table sectors on disk",
+        "  bootinfo     - Show the memory map and what GRUB passed in",
+        "  pages        - Show free pages per zone and buddy order",
+        "  vmm          - Show page table, direct map and MMIO mapping state",
+        "  gfxbench     - Time framebuffer clear and scroll, uncached vs write-combining",
+        "  strbench     - MB/s per string routine version (strbench memset, ...)",
+        "  regions      - Show reserved regions and stacks: size, resident, faults",
+        "  kmbench      - Time kmalloc/kfree and measure slab fragmentation",
+        "  heap         - Show malloc/kmalloc usage and size classes",
+        "  slabinfo     - Show object caches: active, free and total objects",
+        "  meminfo      - Show heap size histogram, top callers and fragmentation",
+        "  PageUp/Down  - Scroll back through output that went off the screen",
+        "  Alt+F1..F4   - Switch console: shell, editor, spare, kernel log",
         "  help         - Show this help"
     };
     
@@ -948,14 +1585,8 @@ void help_command() {
     for (int i = 0; i < num_commands; i++) {
         print_set_cursor(0, cursor_y);
         print_str(commands[i]);
-        cursor_y++;
-        if (cursor_y >= SCREEN_HEIGHT) {
-            scroll_screen();
-        }
+        shell_newline();
     }
     
-    cursor_y++;
-    if (cursor_y >= SCREEN_HEIGHT) {
-        scroll_screen();
-    }
+    shell_newline();
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #include "snake.h"
 #include "../intf/print.h"
+#include "stdio.h"
 #include "../drivers/keyboard/keyboard.h"
+#include "idle.h"
+#include "timer.h"
+#include <unistd.h>
 
 void kernel_main(void);
 
@@ -12,11 +16,15 @@ int snake_random(int min, int max) {
     return min + (snake_rand_seed % (max - min + 1));
 }
 
+static volatile int frame_due = 0;
+
+static void snake_frame_tick(void* data) {
+    (void)data;
+    frame_due = 1;
+}
+
 void snake_delay(int milliseconds) {
-    // Simple delay loop for kernel environment
-    for (volatile int i = 0; i < milliseconds * 1000; i++) {
-        // Busy wait
-    }
+    msleep(milliseconds);
 }
 
 void snake_clear_screen(void) {
@@ -47,31 +55,7 @@ void snake_draw_border(void) {
 void snake_draw_score(int score) {
     print_set_color(PRINT_COLOR_YELLOW, PRINT_COLOR_BLACK);
     print_set_cursor(5, GAME_HEIGHT + 3);
-    print_str("Score: ");
-    
-    // Convert score to string
-    char score_str[10];
-    int i = 0;
-    int temp = score;
-    
-    if (score == 0) {
-        score_str[i++] = '0';
-    } else {
-        while (temp > 0) {
-            score_str[i++] = (temp % 10) + '0';
-            temp /= 10;
-        }
-        
-        // Reverse the string
-        for (int j = 0; j < i / 2; j++) {
-            char swap = score_str[j];
-            score_str[j] = score_str[i - 1 - j];
-            score_str[i - 1 - j] = swap;
-        }
-    }
-    
-    score_str[i] = '\0';
-    print_str(score_str);
+    kprintf("Score: %d", score);
     
     print_set_cursor(25, GAME_HEIGHT + 3);
     print_str("Controls: Arrow Keys, ESC=Exit, P=Pause");
@@ -103,31 +87,7 @@ void snake_show_game_over(int score) {
     print_str("GAME OVER!");
     
     print_set_cursor(GAME_WIDTH / 2 - 8, GAME_HEIGHT / 2);
-    print_str("Final Score: ");
-    
-    // Convert score to string
-    char score_str[10];
-    int i = 0;
-    int temp = score;
-    
-    if (score == 0) {
-        score_str[i++] = '0';
-    } else {
-        while (temp > 0) {
-            score_str[i++] = (temp % 10) + '0';
-            temp /= 10;
-        }
-        
-        // Reverse the string
-        for (int j = 0; j < i / 2; j++) {
-            char swap = score_str[j];
-            score_str[j] = score_str[i - 1 - j];
-            score_str[i - 1 - j] = swap;
-        }
-    }
-    
-    score_str[i] = '\0';
-    print_str(score_str);
+    kprintf("Final Score: %d", score);
     
     print_set_color(PRINT_COLOR_YELLOW, PRINT_COLOR_BLACK);
     print_set_cursor(GAME_WIDTH / 2 - 12, GAME_HEIGHT / 2 + 3);
@@ -472,6 +432,7 @@ void snake_handle_input(snake_game_t* game, unsigned char key) {
 
 void run_snake_game(void) {
     snake_game_t game;
+    ktimer_t frame_timer = {0};
     
     snake_clear_screen();
     snake_init_game(&game);
@@ -482,9 +443,13 @@ void run_snake_game(void) {
     int render_counter = 0;
     const int moves_per_second = 1; // Base speed
     const int fps = 13; // Frame rate
-    const int frames_per_move = fps * 4 / moves_per_second; // 4x slower: 52 frames per move
+    const int frames_per_move = fps * 2 / moves_per_second; // 26 frames of SNAKE_FRAME_MS per move
     const int frames_per_render = 2; // Render every 2 frames to reduce flickering
     
+    // Frames are paced by the timer wheel so game speed does not depend on the host
+    frame_due = 0;
+    timer_start_periodic(&frame_timer, SNAKE_FRAME_MS, snake_frame_tick, 0);
+    
     while (game.state != GAME_EXIT) {
         // Handle input (check multiple times per move for responsiveness)
         unsigned char key = keyboard_get_char();
@@ -535,10 +500,16 @@ void run_snake_game(void) {
             render_counter = 0;
         }
         
-        // Much longer delay for 4x slower gameplay
-        snake_delay(100); // Increased from 75ms to 100ms for additional slowdown
+        if (timer_pending(&frame_timer)) {
+            wait_event(frame_due);
+            frame_due = 0;
+        } else {
+            snake_delay(SNAKE_FRAME_MS);
+        }
     }
     
+    timer_cancel(&frame_timer);
+    
     // Return to main
     kernel_main();
 }
\ No newline at end of file
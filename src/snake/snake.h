@@ -9,6 +9,7 @@ void run_snake_game(void);
 #define GAME_HEIGHT 23
 #define MAX_SNAKE_LENGTH 300
 #define INITIAL_SNAKE_LENGTH 3
+#define SNAKE_FRAME_MS 10 // 26 frames per horizontal move, about 4 moves per second
 
 // Game colors
 #define SNAKE_COLOR PRINT_COLOR_GREEN
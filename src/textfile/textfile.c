@@ -1,16 +1,23 @@
 #include "textfile.h"
 #include "../intf/print.h"
+#include "stdio.h"
 #include "../drivers/keyboard/keyboard.h"
 #include "../drivers/graphics/graphics.h"
 #include "../filesystem/filesystem.h"
 #include "../shell/shell.h"
+#include "idle.h"
+#include "timer.h"
+#include <unistd.h>
 
 #define SCREEN_HEIGHT 25
 #define SCREEN_WIDTH 80
 #define MAX_INPUT 1000   // And this too
 #define BUFFER_SIZE 1000   // This is the problem. Let's increase it to 1000.
+#define SAVE_MESSAGE_MS 800 // How long the save popup stays up
+#define AUTOSAVE_MS 30000 // Unsaved edits are written back this often
+
+static volatile int autosave_due = 0;
 
-void clear_and_reset_screen(void);
 void textfile_scroll_screen(void);
 void textfile_scroll_horizontal(int direction);
 void display_save_message(const char *message);
@@ -245,34 +252,13 @@ void sync_cursor_position(int x, int y) {
 }
 
 void clear_screen(void) {
-    // Much faster screen clearing with direct VGA memory access
-    unsigned char* video_memory = (unsigned char*)0xB8000;
-    unsigned char color = PRINT_COLOR_BLACK | (PRINT_COLOR_WHITE << 4);
-    
-    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
-        video_memory[i * 2] = ' ';
-        video_memory[i * 2 + 1] = color;
-    }
+    print_fill(0, 0, SCREEN_WIDTH * SCREEN_HEIGHT, PRINT_COLOR_BLACK, PRINT_COLOR_WHITE);
     print_set_cursor(0, 0); 
 }
 
+// The file name and the rule under it stay put
 void textfile_scroll_screen(void) {
-    // Much faster scrolling with direct memory operations
-    unsigned char* video_memory = (unsigned char*)0xB8000;
-    unsigned char color = PRINT_COLOR_BLACK | (PRINT_COLOR_WHITE << 4);
-    
-    // Move all lines up by one
-    for (int y = 1; y < SCREEN_HEIGHT; y++) {
-        for (int i = 0; i < SCREEN_WIDTH * 2; i++) {
-            video_memory[(y - 1) * SCREEN_WIDTH * 2 + i] = video_memory[y * SCREEN_WIDTH * 2 + i];
-        }
-    }
-    
-    // Clear the last line
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
-        video_memory[((SCREEN_HEIGHT - 1) * SCREEN_WIDTH + x) * 2] = ' ';
-        video_memory[((SCREEN_HEIGHT - 1) * SCREEN_WIDTH + x) * 2 + 1] = color;
-    }
+    print_scroll(2, PRINT_COLOR_BLACK, PRINT_COLOR_WHITE);
 }
 
 void textfile_scroll_horizontal(int direction) {
@@ -312,58 +298,21 @@ void update_char_count(int count) {
     }
 
     last_count = count;
-    char count_str[20];
-    
+
     // Save current cursor position
     int saved_x, saved_y;
     print_get_cursor(&saved_x, &saved_y);
     
-    // Update character count display
+    // Update character count display; the padding clears a longer old count
     print_set_color(PRINT_COLOR_BLACK, PRINT_COLOR_WHITE); 
     print_set_cursor(SCREEN_WIDTH - 25, 0);
-    print_str("Characters: ");
-
-    int temp = count;
-    int i = 0;
-    do {
-        count_str[i++] = (temp % 10) + '0';
-        temp /= 10;
-    } while (temp > 0);
-    if (i == 0) count_str[i++] = '0';
-    count_str[i] = '\0';
-
-    for (int j = 0; j < i / 2; j++) {
-        char tmp = count_str[j];
-        count_str[j] = count_str[i - j - 1];
-        count_str[i - j - 1] = tmp;
-    }
-
-    print_str(count_str);
-    for (int k = 0; k < 5; k++) {
-        print_char(' '); 
-    }
+    kprintf("Characters: %d     ", count);
     
     // Restore cursor position
     print_set_cursor(saved_x, saved_y);
     print_update_cursor();
 }
 
-void clear_and_reset_screen(void) {
-    clear_screen();
-    print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLACK);
-    print_set_cursor(0, 0);
-    print_str("Kernel v1");
-}
-
-void delay(int milliseconds) {
-    // More efficient delay - reduced cycles
-    volatile int cycles = milliseconds * 100;
-    
-    while (cycles > 0) {
-        cycles--;
-    }
-}
-
 void display_save_message(const char *message) {
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_BLUE); 
     int popup_start_x = (SCREEN_WIDTH - 30) / 2; 
@@ -379,7 +328,7 @@ void display_save_message(const char *message) {
     print_set_cursor(popup_start_x + 1, popup_start_y + 1); 
     print_str(message);
 
-    delay(80000);
+    msleep(SAVE_MESSAGE_MS);
     print_set_color(PRINT_COLOR_BLACK, PRINT_COLOR_WHITE); 
     for (int y = popup_start_y; y <= popup_start_y + 2; ++y) {
         print_set_cursor(popup_start_x, y);
@@ -392,12 +341,18 @@ void display_save_message(const char *message) {
 void save_current_file(const char *filename, const uint8_t *content, int length) {
     int save_result = save_file(filename, content, length);
     if (save_result < 0) {
+        klog("Saving %s failed", filename);
         display_save_message("Error saving file.");
     } else {
         display_save_message("File saved successfully.");
     }
 }
 
+static void autosave_tick(void* data) {
+    (void)data;
+    autosave_due = 1;
+}
+
 void update_text_content(const uint8_t *buffer, int length, int *final_x, int *final_y) {
     int cursor_x = 0;
     int cursor_y = 2; 
@@ -432,27 +387,39 @@ void update_text_content(const uint8_t *buffer, int length, int *final_x, int *f
     *final_y = cursor_y;
 }
 
+// Show why the file cannot be edited until a key is pressed; the caller
+// then returns and the console goes back to the shell
+static void editor_fail(const char *filename, const char *message, int y) {
+    klog("%s: %s", filename, message);
+    print_set_color(PRINT_COLOR_RED, PRINT_COLOR_WHITE);
+    print_set_cursor(0, y);
+    kprintf("%s Press any key.", message);
+    keyboard_wait_char();
+    force_text_mode();
+}
+
 void display_textfile(const char *filename) {
     char input[MAX_INPUT] = {0};    
     int input_length = 0;
     int cursor_x = 0;
     int cursor_y = 2;
     int cursor_position = 0; // Track position in input buffer
+    int dirty = 0; // Edits not yet written to disk
     unsigned char key;
     uint8_t file_buffer[BUFFER_SIZE];
+    ktimer_t autosave_timer = {0};
 
     // Ensure we're in VGA text mode for the text editor
     force_text_mode();
     
     clear_screen();
+    print_set_scroll_top(2);
     update_filename(filename);
 
     int file_index = fs_open(filename);
     if (file_index == -1) {
-        print_set_color(PRINT_COLOR_RED, PRINT_COLOR_WHITE);
-        print_set_cursor(0, 0);
-        print_str("Error: Unable to open file.");
-        while (1); 
+        editor_fail(filename, "Error: Unable to open file.", 0);
+        return;
     }
 
     int read_result = fs_read(file_index, file_buffer, BUFFER_SIZE);  
@@ -462,10 +429,9 @@ void display_textfile(const char *filename) {
             if (input_length < MAX_INPUT - 1) { 
                 input[input_length++] = file_buffer[i];
             } else {
-                print_set_color(PRINT_COLOR_RED, PRINT_COLOR_WHITE);
-                print_set_cursor(0, SCREEN_HEIGHT - 1);
-                print_str("Error: Input buffer overflow");
-                while (1);
+                fs_close(file_index);
+                editor_fail(filename, "Error: Input buffer overflow", SCREEN_HEIGHT - 1);
+                return;
             }
         }
         cursor_position = input_length; // Set cursor to end of loaded content
@@ -482,17 +448,33 @@ void display_textfile(const char *filename) {
     // Ensure cursor is at the correct position after file content
     sync_cursor_position(cursor_x, cursor_y);
 
+    autosave_due = 0;
+    timer_start_periodic(&autosave_timer, AUTOSAVE_MS, autosave_tick, 0);
+
     while (1) {
+        wait_event(keyboard_has_char() || autosave_due);
+
+        if (autosave_due) {
+            autosave_due = 0;
+            if (dirty) {
+                if (save_file(filename, input, input_length) < 0) {
+                    klog("Autosave of %s failed", filename);
+                    display_save_message("Autosave failed.");
+                    sync_cursor_position(cursor_x, cursor_y);
+                } else {
+                    dirty = 0;
+                }
+            }
+        }
+
         key = keyboard_get_char();
 
         if (key == 0x1B) {  
+            timer_cancel(&autosave_timer);
             fs_close(file_index);  
             
-            // Ensure we're back in proper text mode
+            // Leave a blank console; the shell's is still as it was
             force_text_mode();
-            
-            clear_and_reset_screen(); 
-            run_shell();  
             return;  
         } else if (key == '\n') {
             // Insert newline at cursor position
@@ -504,6 +486,7 @@ void display_textfile(const char *filename) {
                 input[cursor_position] = key;
                 input_length++;
                 cursor_position++;
+                dirty = 1;
                 
                 // Update display - refresh from cursor position onwards
                 clear_screen();
@@ -528,6 +511,7 @@ void display_textfile(const char *filename) {
             }
             input_length--;
             input[input_length] = '\0';
+            dirty = 1;
             
             // Update display - refresh from cursor position onwards
             clear_screen();
@@ -545,6 +529,7 @@ void display_textfile(const char *filename) {
             sync_cursor_position(cursor_x, cursor_y);
         } else if (key == 0x13) {  
             save_current_file(filename, (const uint8_t *)input, input_length);
+            dirty = 0;
         } else if (key == NAV_UP_ARROW || key == NAV_DOWN_ARROW || key == NAV_LEFT_ARROW || key == NAV_RIGHT_ARROW ||
                    key == NAV_PAGE_UP || key == NAV_PAGE_DOWN || key == NAV_HOME_KEY || key == NAV_END_KEY ||
                    key == CTRL_HOME || key == CTRL_END) {
@@ -562,6 +547,7 @@ void display_textfile(const char *filename) {
                 input[cursor_position] = key;
                 input_length++;
                 cursor_position++;
+                dirty = 1;
                 
                 // For simple character insertion, we can optimize by just redrawing affected area
                 // But for simplicity, let's refresh the whole content area
@@ -579,9 +565,6 @@ void display_textfile(const char *filename) {
                 get_cursor_coordinates_from_position(input, cursor_position, &cursor_x, &cursor_y);
                 sync_cursor_position(cursor_x, cursor_y);
             }
-        } else if (key == 0) {
-            // Add small delay when no input
-            for (volatile int i = 0; i < 300; i++) {}
         }
 
         // Only update cursor and char count when we have input